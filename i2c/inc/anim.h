@@ -0,0 +1,34 @@
+#ifndef ANIM_H
+#define ANIM_H
+
+#include <stdint.h>
+
+// Animation timer tick rate, frame durations are rounded down to it (at least one tick)
+#ifndef ANIM_TICK_HZ
+#define ANIM_TICK_HZ            1000u
+#endif
+
+// Step of an animation sequence
+typedef struct {
+    uint8_t frame;              // Frame of the sprite shown (index into its frames)
+    uint16_t durationMs;        // Time the frame is shown (at least 1)
+} ANIM_Frame;
+
+// On-screen frame durations measured against their durations in whole ticks
+typedef struct {
+    uint32_t frames;            // Frames measured
+    uint32_t skipped;           // Frames that were replaced before they reached the panel
+    int32_t minUs;              // Smallest deviation from the duration in whole ticks
+    int32_t maxUs;              // Largest deviation from the duration in whole ticks
+    uint32_t meanAbsUs;         // Mean absolute deviation
+} ANIM_Jitter;
+
+uint8_t ANIM_init(void);
+uint8_t ANIM_start(uint8_t sprite, const ANIM_Frame *frames, uint8_t count, uint8_t loop);
+uint8_t ANIM_stop(uint8_t sprite);
+uint8_t ANIM_isRunning(uint8_t sprite);
+void ANIM_presented(void);
+uint8_t ANIM_getJitter(uint8_t sprite, ANIM_Jitter *jitter);
+void TIM3_IRQHandler(void);
+
+#endif // ANIM_H
@@ -0,0 +1,9 @@
+#ifndef CRC_H
+#define CRC_H
+
+#include <stdint.h>
+
+void CRC_init(void);
+uint32_t CRC_calc(const uint32_t *data, uint32_t words);
+
+#endif // CRC_H
@@ -3,11 +3,42 @@
 
 #include <stdint.h>
 
-void I2C_init(void);
+// Bus speed
+typedef enum {
+    I2C_SPEED_STANDARD = 0,     // 100 kHz standard mode
+    I2C_SPEED_FAST,             // 400 kHz fast mode, T_low/T_high = 2
+    I2C_SPEED_FAST_DUTY,        // 400 kHz fast mode, T_low/T_high = 16/9
+} I2C_SPEED;
+
+// Register values for a bus speed
+typedef struct {
+    uint8_t freq;               // CR2 FREQ, PCLK1 in MHz
+    uint16_t ccr;               // CCR including F/S and DUTY bits
+    uint8_t trise;              // TRISE
+} I2C_Timing;
+
+// Called from interrupt context when an asynchronous transfer finishes (status: 0 for success/1 for failure)
+typedef void (*I2C_Callback)(uint8_t status);
+
+uint8_t I2C_computeTiming(uint32_t pclk1, I2C_SPEED speed, I2C_Timing *timing);
+uint8_t I2C_init(I2C_SPEED speed);
+void I2C_initDMA(void);
 void I2C_start(void);
 void I2C_stop(void);
 uint8_t I2C_write(uint8_t data, uint32_t timeout);
 uint8_t I2C_writeSlaveAddress(uint8_t address, uint32_t timeout);
-uint8_t I2C_writeMulti(uint8_t *data, uint8_t size, uint32_t timeout);
+uint8_t I2C_writeMulti(uint8_t *data, uint16_t size, uint32_t timeout);
+uint8_t I2C_writeMultiDMA(const uint8_t *data, uint16_t size, I2C_Callback callback);
+uint8_t I2C_isBusy(void);
+
+uint8_t I2C_queueWrite(uint8_t address, uint8_t control, const uint8_t *data, uint16_t size, I2C_Callback callback);
+uint8_t I2C_transfer(uint8_t address, uint8_t control, const uint8_t *data, uint16_t size, uint32_t timeout);
+void I2C_abort(void);
+
+uint8_t I2C_streamStart(uint8_t address, uint8_t setupControl, const uint8_t *setup, uint16_t setupSize,
+                        uint8_t control, const uint8_t *data, uint16_t size);
+uint8_t I2C_streamStop(uint32_t timeout);
+uint8_t I2C_isStreaming(void);
+uint32_t I2C_streamPasses(void);
 
 #endif // I2C_DRIVER_H
\ No newline at end of file
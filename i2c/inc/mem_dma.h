@@ -0,0 +1,12 @@
+#ifndef MEM_DMA_H
+#define MEM_DMA_H
+
+#include <stdint.h>
+
+void MEMDMA_init(void);
+uint8_t MEMDMA_copy(uint32_t *dst, const uint32_t *src, uint16_t words);
+uint8_t MEMDMA_fill(uint32_t *dst, uint32_t value, uint16_t words);
+uint8_t MEMDMA_isBusy(void);
+uint8_t MEMDMA_wait(uint32_t timeout);
+
+#endif // MEM_DMA_H
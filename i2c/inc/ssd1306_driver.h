@@ -5,6 +5,12 @@
 #include "ssd1306_fonts.h"
 #include "ssd1306_imgs.h"
 
+// Max encoded size of a command/data batch (control bytes included)
+#define SSD1306_BATCH_SIZE      64u
+
+// Number of entries in the sprite table
+#define SSD1306_MAX_SPRITES     16u
+
 typedef enum {
     BLACK = 0x00,               // Black color, no pixel
     WHITE = 0x01,               // Pixel is set. Color depends on LCD
@@ -18,15 +24,113 @@ typedef struct {
     uint8_t wrap_counter;       // Amount of times image/font wrapped around screen buffer
 } SSD1306_t;
 
+// Command/data bytes collected for a single transaction
+typedef struct {
+    uint8_t buf[SSD1306_BATCH_SIZE];    // Encoded stream, starting with a control byte
+    uint16_t len;                       // Bytes used in buf
+    uint16_t runStart;                  // Index of the control byte of the trailing run
+    uint8_t overflow;                   // Set if a byte did not fit
+} SSD1306_Batch;
+
+// How the buffer is transferred by SSD1306_update()
+typedef enum {
+    SSD1306_UPDATE_PAGE = 0,    // Page addressing, one transaction per page
+    SSD1306_UPDATE_HORIZONTAL,  // Horizontal addressing, one transaction per frame
+} SSD1306_UPDATE_MODE;
+
+// How SSD1306_update() detects which dirty bytes really changed
+typedef enum {
+    SSD1306_DIFF_NONE = 0,      // Send all dirty ranges
+    SSD1306_DIFF_SHADOW,        // Compare against a 1 KB copy of the panel GDDRAM
+    SSD1306_DIFF_CRC,           // Compare a CRC per 16-column block (CRC calculation unit)
+} SSD1306_DIFF_MODE;
+
+// How SSD1306_writeImg()/SSD1306_writeString() combine the image with the buffer, a byte at a time
+typedef enum {
+    SSD1306_DRAW_COPY = 0,      // Set pixels in color, clear pixels in the other color
+    SSD1306_DRAW_OR,            // Transparent: set pixels in color, clear pixels are left alone
+    SSD1306_DRAW_AND_NOT,       // Erase: set pixels in the other color, clear pixels are left alone
+    SSD1306_DRAW_XOR,           // Set pixels are inverted, drawing twice restores the buffer
+    SSD1306_DRAW_MASK,          // Like COPY inside the image mask (ImgDef.mask), transparent outside
+} SSD1306_DRAW_MODE;
+
+// Direction of the hardware scroll
+typedef enum {
+    SSD1306_SCROLL_RIGHT = 0,   // Columns move right, the last column wraps around to the first
+    SSD1306_SCROLL_LEFT,        // Columns move left, the first column wraps around to the last
+} SSD1306_SCROLL_DIR;
+
+// Frames between two scroll steps of one column (10.3.1: Horizontal Scroll Setup)
+typedef enum {
+    SSD1306_SCROLL_2_FRAMES = 0x07,
+    SSD1306_SCROLL_3_FRAMES = 0x04,
+    SSD1306_SCROLL_4_FRAMES = 0x05,
+    SSD1306_SCROLL_5_FRAMES = 0x00,
+    SSD1306_SCROLL_25_FRAMES = 0x06,
+    SSD1306_SCROLL_64_FRAMES = 0x01,
+    SSD1306_SCROLL_128_FRAMES = 0x02,
+    SSD1306_SCROLL_256_FRAMES = 0x03,
+} SSD1306_SCROLL_INTERVAL;
+
+// Called from interrupt context when a DMA frame update finishes (status: 0 for success/1 for failure)
+typedef void (*SSD1306_Callback)(uint8_t status);
+
+// Renders one page (0-7) of a frame into a buffer of one byte per column, used by SSD1306_updatePipelined()
+typedef void (*SSD1306_PageRenderer)(uint8_t page, uint8_t *buffer);
+
+// Draws a whole frame with the drawing functions, replayed once per page by SSD1306_updateStrips()
+typedef void (*SSD1306_DrawCallback)(void);
+
 uint8_t SSD1306_init(void);
+uint8_t SSD1306_setUpdateMode(SSD1306_UPDATE_MODE mode);
+uint8_t SSD1306_updatePipelined(SSD1306_PageRenderer render);
+uint8_t SSD1306_updateStrips(SSD1306_DrawCallback draw);
+uint8_t SSD1306_isBusy(void);
+uint8_t SSD1306_scrollStart(SSD1306_SCROLL_DIR dir, uint8_t startPage, uint8_t endPage, SSD1306_SCROLL_INTERVAL interval, uint8_t verticalOffset);
+uint8_t SSD1306_scrollStop(void);
+
+// Screenbuffer functions, left out when built with SSD1306_STRIP_ONLY
+#ifndef SSD1306_STRIP_ONLY
 uint8_t SSD1306_update(void);
+uint8_t SSD1306_updateDMA(SSD1306_Callback callback);
+void SSD1306_invalidate(void);
+uint8_t SSD1306_setDiffMode(SSD1306_DIFF_MODE mode);
+uint8_t SSD1306_mirrorStart(void);
+uint8_t SSD1306_mirrorStop(void);
+#endif
+
+uint8_t SSD1306_writeCommands(const uint8_t *commands, uint16_t size);
+void SSD1306_batchInit(SSD1306_Batch *batch);
+void SSD1306_batchCommand(SSD1306_Batch *batch, uint8_t command);
+void SSD1306_batchData(SSD1306_Batch *batch, uint8_t data);
+uint8_t SSD1306_batchSend(SSD1306_Batch *batch);
 void SSD1306_fill(SSD1306_COLOR color);
+void SSD1306_fillRect(int16_t x, int16_t y, uint16_t w, uint16_t h, SSD1306_COLOR color);
+uint8_t SSD1306_loadFrame(const uint8_t *frame);
 void SSD1306_setCursor(uint8_t x, uint8_t y);
+void SSD1306_setDrawMode(SSD1306_DRAW_MODE mode);
+void SSD1306_draw_pixel(uint8_t x, uint8_t y, SSD1306_COLOR color);
 
 char SSD1306_writeString(const char* str, FontDef Font, SSD1306_COLOR color, uint8_t wrap);
 void SSD1306_writeImg(ImgDef Img, SSD1306_COLOR color);
+void SSD1306_rowsToPages(const uint16_t *rows, uint8_t w, uint16_t h, uint8_t *pages);
+
+uint8_t SSD1306_spriteSet(uint8_t id, const ImgDef *const *frames, uint8_t frameCount, uint8_t x, uint8_t y, uint8_t z);
+uint8_t SSD1306_spriteMoveBy(uint8_t id, int16_t dx, int16_t dy);
+uint8_t SSD1306_spriteShow(uint8_t id, uint8_t visible);
+uint8_t SSD1306_spriteFrame(uint8_t id, uint8_t frame);
+uint8_t SSD1306_spriteNextFrame(uint8_t id);
+void SSD1306_spriteDraw(void);
+uint8_t SSD1306_imgCollide(const ImgDef *a, int16_t ax, int16_t ay, const ImgDef *b, int16_t bx, int16_t by);
+uint8_t SSD1306_spriteCollide(uint8_t a, uint8_t b);
+uint8_t SSD1306_spriteHitsFrame(uint8_t id, const uint8_t *frame);
 
-void SSD1306_moveImageRight(void);
-void SSD1306_moveImageLeft(void);
+#ifndef SSD1306_STRIP_ONLY
+void SSD1306_spriteBackground(const uint8_t *frame);
+uint8_t SSD1306_spriteCompose(void);
+uint8_t SSD1306_consoleInit(const FontDef *Font, SSD1306_COLOR color);
+uint8_t SSD1306_consoleWrite(const char *str);
+void SSD1306_consoleEnd(void);
+#endif
 
 #endif // SSD1306_DRIVER_H
@@ -8,10 +8,16 @@ typedef struct {
     const uint8_t FontWidth;    // Font width in pixels
     const uint8_t FontHeight;   // Font height in pixels
     const uint16_t *data;       // Pointer to data font data array
+    const uint8_t *pages;       // Same glyphs in page-major order (ssd1306_font_pages.c), may be NULL
 } FontDef;
 
 extern FontDef Font_7x10;
 extern FontDef Font_11x18;
 extern FontDef Font_16x26;
 
+// Page-major bitmaps, generated by tools/font_pages.py (ssd1306_font_pages.c)
+extern const uint8_t Font7x10Pages[];
+extern const uint8_t Font11x18Pages[];
+extern const uint8_t Font16x26Pages[];
+
 #endif // SSD1306_FONTS_H
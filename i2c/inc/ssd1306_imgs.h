@@ -9,6 +9,7 @@ typedef struct {
     uint8_t imgHeight;    // Font height in pixels
     uint16_t *data;       // Pointer to data font data array
     uint8_t imgSections;  // Number of sections in image
+    const uint16_t *mask; // Opaque pixels in the layout of data, used by SSD1306_DRAW_MASK (may be NULL)
 } ImgDef;
 
 extern ImgDef Ryu_32x36;
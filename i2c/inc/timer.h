@@ -4,8 +4,15 @@
 #include <stdint.h>
 
 uint8_t SysClockConfig(void);
+uint32_t SysClockGetHCLK(void);
+uint32_t SysClockGetPCLK1(void);
 uint8_t TIM2init(void);
-void Delay_us(uint16_t us);
-void Delay_ms(uint16_t ms);
+uint32_t Time_us(void);
+uint64_t Time_us64(void);
+uint32_t Time_elapsedUs(uint32_t since);
+void Delay_untilUs(uint32_t deadline);
+void Delay_us(uint32_t us);
+void Delay_ms(uint32_t ms);
+void TIM2_IRQHandler(void);
 
 #endif // TIMER_H
\ No newline at end of file
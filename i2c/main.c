@@ -9,6 +9,7 @@
 #include "../inc/timer.h"
 #include "../inc/i2c_driver.h"
 #include "../inc/ssd1306_driver.h"
+#include "../inc/anim.h"
 
 #include CMSIS_device_header
 
@@ -16,6 +17,18 @@
 #define NO_WRAP         0u
 #define WRAP            1u
 
+// Sprite moved by the buttons (gpio.c)
+#define DOG_SPRITE      0u
+
+// Animation frames of the dog
+static const ImgDef *const dogFrames[] = {&DogDown_22x20, &DogUp_22x20};
+
+// Animation sequence of the dog, played by the animation tick
+static const ANIM_Frame dogSequence[] = {
+    {0, 150},
+    {1, 150},
+};
+
 /**
  * @brief   Initialize modules
  * @return  0 for success/1 for failure
@@ -24,22 +37,43 @@ uint8_t initialize(void)
 {
     uint8_t rv = 0;
 
-    // Initialize system clock and GPIO timer
+    // Initialize system clock and the microsecond clock (TIM2)
     rv += SysClockConfig();
     rv += TIM2init();
+
+    // Start the animation tick
+    rv += ANIM_init();
     
     // Initialize GPIO and GPIO interrupts
     initGPIO();
     initGPIOInterrupt();
 
-    // Init I2C driver
-    I2C_init();
+    // Init I2C driver (400 kHz fast mode) and its DMA stream
+    rv += I2C_init(I2C_SPEED_FAST);
+    I2C_initDMA();
+    if (rv != 0) {
+        return 1;
+    }
 
     // Init SSD1306 (OLED)   
     rv = SSD1306_init();
     if (rv != 0) {
         return 1;
     }
+
+    // Send each frame as a single transaction
+    rv = SSD1306_setUpdateMode(SSD1306_UPDATE_HORIZONTAL);
+    if (rv != 0) {
+        return 1;
+    }
+
+#ifndef SSD1306_STRIP_ONLY
+    // Only send the bytes that differ from what the panel shows
+    rv = SSD1306_setDiffMode(SSD1306_DIFF_SHADOW);
+    if (rv != 0) {
+        return 1;
+    }
+#endif
     
     return rv;
 }
@@ -88,25 +122,74 @@ int main(void)
     //     return 1;
     // }
 
+    /////////////////////////////////
+    // Text marquee
+    /////////////////////////////////
+    // The panel scrolls pages 0-2 by itself, the screenbuffer is resent once the scroll stops
+    // SSD1306_setCursor(0, 0);
+    // SSD1306_writeString(myText, Font_11x18, WHITE, NO_WRAP);
+    // rv = SSD1306_update();
+    // rv += SSD1306_scrollStart(SSD1306_SCROLL_LEFT, 0, 2, SSD1306_SCROLL_5_FRAMES, 0);
+    // Delay_ms(5000);
+    // rv += SSD1306_scrollStop();
+    // rv += SSD1306_update();
+    // if (rv != 0) {
+    //     return 1;
+    // }
+
+    /////////////////////////////////
+    // Log console
+    /////////////////////////////////
+    // A newline scrolls by moving the display start line, only the new line is sent
+    // rv = SSD1306_consoleInit(&Font_7x10, WHITE);
+    // for (uint8_t i = 0; i < 10; i++) {
+    //     rv += SSD1306_consoleWrite("log line\n");
+    //     rv += SSD1306_update();
+    // }
+    // SSD1306_consoleEnd();
+    // if (rv != 0) {
+    //     return 1;
+    // }
+
+    /////////////////////////////////
+    // Always-on mirror
+    /////////////////////////////////
+    // The buffer is streamed to the panel by a circular DMA, no update calls are needed
+    // rv = SSD1306_mirrorStart();
+    // SSD1306_setCursor(5, 5);
+    // SSD1306_writeString(myText, Font_7x10, WHITE, WRAP);
+    // Delay_ms(100);
+    // rv += SSD1306_mirrorStop();
+    // if (rv != 0) {
+    //     return 1;
+    // }
+
+    /////////////////////////////////
+    // Set up the animated sprite
+    /////////////////////////////////
+    rv = SSD1306_spriteSet(DOG_SPRITE, dogFrames, 2, 10, 10, 0);
+    rv += ANIM_start(DOG_SPRITE, dogSequence, 2, 1);
+    if (rv != 0) {
+        return 1;
+    }
+
     while (1) {
         /////////////////////////////////
         // Draw animation 
         /////////////////////////////////
-        SSD1306_setCursor(10, 10);
-        SSD1306_writeImg(DogDown_22x20, WHITE);
-        SSD1306_update();
-        if (rv != 0) {
-            return 1;
-        }
-        Delay_ms(2);
-
-        SSD1306_setCursor(10, 10);
-        SSD1306_writeImg(DogUp_22x20, WHITE);
-        SSD1306_update();
+        // The animation tick selects the frames and the buttons move the sprite, both from their
+        // interrupts, only the old and new areas of the sprite are redrawn
+#ifndef SSD1306_STRIP_ONLY
+        SSD1306_spriteCompose();
+        rv = SSD1306_update();
+#else
+        // Without a screenbuffer the sprites are drawn again into every strip
+        rv = SSD1306_updateStrips(SSD1306_spriteDraw);
+#endif
         if (rv != 0) {
             return 1;
         }
-        Delay_ms(2);
+        ANIM_presented();
     }
     
 }
\ No newline at end of file
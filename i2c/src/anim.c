@@ -0,0 +1,298 @@
+/**
+ * This module plays sprite animations from a hardware timer tick without the use of the HAL library.
+ * TIM3 interrupts at ANIM_TICK_HZ and steps every running sequence through its frame list, so the
+ * frame timing does not depend on how long the main loop takes to draw or send a frame. A sequence
+ * only selects the frame of its sprite (SSD1306_spriteFrame()); the position stays with the sprite,
+ * so moving it (e.g. from a button interrupt) never disturbs the sequence.
+ *
+ * The main loop composes and sends the sprites as usual and calls ANIM_presented() after every
+ * update. The time between two presented frames of a sequence is compared with the time the frames
+ * in between were scheduled for (their durations in whole ticks), which gives the jitter statistics.
+*/
+
+#include "../inc/anim.h"
+#include <stddef.h>
+#include "../inc/ssd1306_driver.h"
+#include "../inc/timer.h"
+#include "stm32f4xx.h"
+
+#define ANIM_TIM                TIM3
+#define ANIM_IRQ_PRIORITY       2u              // Same level as the buttons, only sprite state is touched
+#define ANIM_TIM_HZ             1000000u        // Counter clock
+#define ANIM_TICK_US            (ANIM_TIM_HZ / ANIM_TICK_HZ)    // Tick period the timer counts
+
+// Playback and measurement state of a sprite
+typedef struct {
+    const ANIM_Frame *frames;   // Frame list, NULL when not running
+    uint8_t count;              // Number of frames
+    uint8_t index;              // Frame being shown
+    uint8_t loop;               // Start over after the last frame
+    uint16_t remaining;         // Ticks left of the frame
+    uint8_t changed;            // Set when a frame has been selected since the last present
+    uint32_t pendingUs;         // Scheduled time of the frames that ended since the last present
+    uint8_t shown;              // Set once a frame of the sequence has been presented
+    uint32_t shownAt;           // Time_us() of that present
+    uint32_t skipped;           // Frames replaced before they were presented
+    uint32_t measured;          // Frames measured
+    int32_t minUs;              // Smallest deviation
+    int32_t maxUs;              // Largest deviation
+    uint64_t sumAbsUs;          // Sum of the absolute deviations
+} ANIM_Sequence;
+
+// Sequences, indexed by sprite id
+static ANIM_Sequence sequences[SSD1306_MAX_SPRITES];
+
+// Local Prototypes
+static uint16_t ANIM_ticks(uint16_t durationMs);
+
+/**
+ * @brief       Start the animation tick (TIM3 update interrupt at ANIM_TICK_HZ)
+ *              Frames are timestamped with Time_us(), TIM2init() must have been called
+ * @return      0 for success/1 for failure (timer clock below 1 MHz)
+*/
+uint8_t ANIM_init(void)
+{
+    uint32_t timclk = SysClockGetPCLK1();
+
+    // APB1 timers run at twice PCLK1 when the APB1 prescaler divides (RM0368 6.2: Clocks)
+    if (RCC->CFGR & RCC_CFGR_PPRE1_2) {
+        timclk *= 2u;
+    }
+    if (timclk < ANIM_TIM_HZ) {
+        return 1;
+    }
+
+    // 1. Enable Timer clock
+    RCC->APB1ENR |= RCC_APB1ENR_TIM3EN;
+
+    // 2. Count at 1 MHz and overflow at the tick rate
+    ANIM_TIM->CR1 = 0;
+    ANIM_TIM->PSC = (timclk / ANIM_TIM_HZ) - 1u;
+    ANIM_TIM->ARR = (ANIM_TIM_HZ / ANIM_TICK_HZ) - 1u;
+
+    // 3. Load the prescaler now (UG) without taking the update as a tick
+    ANIM_TIM->EGR = TIM_EGR_UG;
+    ANIM_TIM->SR = 0;
+
+    // 4. Enable the update interrupt and the timer
+    ANIM_TIM->DIER = TIM_DIER_UIE;
+    NVIC_SetPriority(TIM3_IRQn, ANIM_IRQ_PRIORITY);
+    NVIC_EnableIRQ(TIM3_IRQn);
+    ANIM_TIM->CR1 |= TIM_CR1_CEN;
+
+    return 0;
+}
+
+/**
+ * @brief           Play a frame list on a sprite, starting with the first frame now
+ *                  A running sequence of the sprite is replaced and the jitter statistics are reset.
+ *                  The frame list is read from the tick interrupt and must stay valid while it runs.
+ * @param sprite    Sprite set up with SSD1306_spriteSet()
+ * @param frames    Frame list
+ * @param count     Number of frames
+ * @param loop      1 to start over after the last frame/0 to stop on it
+ * @return          0 for success/1 for failure (empty list, zero duration or no such sprite/frame)
+*/
+uint8_t ANIM_start(uint8_t sprite, const ANIM_Frame *frames, uint8_t count, uint8_t loop)
+{
+    if ((sprite >= SSD1306_MAX_SPRITES) || (frames == NULL) || (count == 0)) {
+        return 1;
+    }
+    for (uint8_t i = 0; i < count; i++) {
+        if (frames[i].durationMs == 0) {
+            return 1;
+        }
+    }
+
+    ANIM_Sequence *seq = &sequences[sprite];
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    if (SSD1306_spriteFrame(sprite, frames[0].frame) != 0) {
+        __set_PRIMASK(primask);
+        return 1;
+    }
+
+    seq->frames = frames;
+    seq->count = count;
+    seq->index = 0;
+    seq->loop = loop;
+    seq->remaining = ANIM_ticks(frames[0].durationMs);
+    seq->changed = 1;
+    seq->pendingUs = 0;
+    seq->shown = 0;
+    seq->skipped = 0;
+    seq->measured = 0;
+    seq->minUs = INT32_MAX;
+    seq->maxUs = INT32_MIN;
+    seq->sumAbsUs = 0;
+
+    __set_PRIMASK(primask);
+
+    return 0;
+}
+
+/**
+ * @brief           Stop the sequence of a sprite, its current frame stays
+ * @param sprite    Sprite
+ * @return          0 for success/1 for failure (no such sprite)
+*/
+uint8_t ANIM_stop(uint8_t sprite)
+{
+    if (sprite >= SSD1306_MAX_SPRITES) {
+        return 1;
+    }
+
+    sequences[sprite].frames = NULL;
+    return 0;
+}
+
+/**
+ * @brief           Check if a sequence is playing on a sprite
+ * @param sprite    Sprite
+ * @return          1 if running/0 if stopped or finished
+*/
+uint8_t ANIM_isRunning(uint8_t sprite)
+{
+    return ((sprite < SSD1306_MAX_SPRITES) && (sequences[sprite].frames != NULL)) ? 1 : 0;
+}
+
+/**
+ * @brief   Record that the frames selected so far are on the panel
+ *          Call after every SSD1306_update() (or from the SSD1306_updateDMA() callback). For every
+ *          sequence that changed frame since the last call, the time since its previous present
+ *          minus the scheduled time of the frames that ended in between is one jitter sample.
+*/
+void ANIM_presented(void)
+{
+    uint32_t now = Time_us();
+
+    for (uint8_t id = 0; id < SSD1306_MAX_SPRITES; id++) {
+        ANIM_Sequence *seq = &sequences[id];
+
+        uint32_t primask = __get_PRIMASK();
+        __disable_irq();
+
+        uint8_t changed = seq->changed;
+        uint32_t scheduledUs = seq->pendingUs;
+
+        seq->changed = 0;
+        seq->pendingUs = 0;
+
+        __set_PRIMASK(primask);
+
+        if (!changed) {
+            continue;
+        }
+
+        if (seq->shown) {
+            int32_t deviation = (int32_t)(now - seq->shownAt) - (int32_t)scheduledUs;
+
+            if (deviation < seq->minUs) {
+                seq->minUs = deviation;
+            }
+            if (deviation > seq->maxUs) {
+                seq->maxUs = deviation;
+            }
+            seq->sumAbsUs += (uint32_t)((deviation < 0) ? -deviation : deviation);
+            seq->measured++;
+        }
+
+        seq->shown = 1;
+        seq->shownAt = now;
+    }
+}
+
+/**
+ * @brief           Read the jitter statistics of a sprite's sequence
+ * @param sprite    Sprite
+ * @param jitter    Statistics since ANIM_start() (min/max are 0 before the first sample)
+ * @return          0 for success/1 for failure (no such sprite)
+*/
+uint8_t ANIM_getJitter(uint8_t sprite, ANIM_Jitter *jitter)
+{
+    if (sprite >= SSD1306_MAX_SPRITES) {
+        return 1;
+    }
+
+    const ANIM_Sequence *seq = &sequences[sprite];
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    jitter->frames = seq->measured;
+    jitter->skipped = seq->skipped;
+    jitter->minUs = (seq->measured != 0) ? seq->minUs : 0;
+    jitter->maxUs = (seq->measured != 0) ? seq->maxUs : 0;
+    jitter->meanAbsUs = (seq->measured != 0) ? (uint32_t)(seq->sumAbsUs / seq->measured) : 0;
+
+    __set_PRIMASK(primask);
+
+    return 0;
+}
+
+/**
+ * @brief               Ticks a frame is shown for
+ *                      Frames shorter than a tick are shown for one tick, the count down in the
+ *                      interrupt would wrap around at 0
+ * @param durationMs    Frame duration
+ * @return              Ticks (1 - 65535)
+*/
+static uint16_t ANIM_ticks(uint16_t durationMs)
+{
+    uint32_t ticks = ((uint32_t)durationMs * ANIM_TICK_HZ) / 1000u;
+
+    if (ticks == 0) {
+        return 1;
+    }
+    if (ticks > 0xFFFFu) {
+        return 0xFFFFu;
+    }
+    return (uint16_t)ticks;
+}
+
+/**
+ * @brief   Interrupt for TIM3 (animation tick)
+ *          Counts down the frame being shown of every running sequence and selects the next frame
+ *          when it runs out
+*/
+void TIM3_IRQHandler(void)
+{
+    if (!(ANIM_TIM->SR & TIM_SR_UIF)) {
+        return;
+    }
+
+    // Clear the update flag (rc_w0)
+    ANIM_TIM->SR = ~TIM_SR_UIF;
+
+    for (uint8_t id = 0; id < SSD1306_MAX_SPRITES; id++) {
+        ANIM_Sequence *seq = &sequences[id];
+        uint8_t next;
+
+        if ((seq->frames == NULL) || (--seq->remaining != 0)) {
+            continue;
+        }
+
+        next = seq->index + 1u;
+        if (next >= seq->count) {
+            if (!seq->loop) {
+                // Finished, the last frame stays
+                seq->frames = NULL;
+                continue;
+            }
+            next = 0;
+        }
+
+        // The frame shown so far was never presented if the last change is still pending
+        if (seq->changed) {
+            seq->skipped++;
+        }
+        seq->pendingUs += (uint32_t)ANIM_ticks(seq->frames[seq->index].durationMs) * ANIM_TICK_US;
+        seq->changed = 1;
+
+        seq->index = next;
+        seq->remaining = ANIM_ticks(seq->frames[next].durationMs);
+        (void)SSD1306_spriteFrame(id, seq->frames[next].frame);
+    }
+}
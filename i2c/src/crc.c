@@ -0,0 +1,66 @@
+/**
+ * This module computes CRC-32 checksums with the CRC calculation unit without the use of the HAL library.
+ * The unit uses the Ethernet polynomial 0x04C11DB7 on 32-bit words, starting from 0xFFFFFFFF, with
+ * no reflection and no final XOR (RM0368 4: CRC calculation unit).
+ *
+ * Define CRC_SOFTWARE to build the bitwise software version of the same CRC instead, e.g. to run
+ * code that depends on it on a host machine. Both versions return identical results.
+*/
+
+#include "../inc/crc.h"
+
+#ifndef CRC_SOFTWARE
+#include "stm32f4xx.h"
+#endif
+
+// CRC-32 settings of the calculation unit
+#define CRC_POLYNOMIAL  0x04C11DB7u     // Fixed polynomial
+#define CRC_INIT        0xFFFFFFFFu     // Value of DR after a reset
+
+/**
+ * @brief   Enable the CRC calculation unit clock
+*/
+void CRC_init(void)
+{
+#ifndef CRC_SOFTWARE
+    RCC->AHB1ENR |= RCC_AHB1ENR_CRCEN;
+#endif
+}
+
+/**
+ * @brief           Compute the CRC-32 of a block of words
+ *                  Every call starts a new checksum from CRC_INIT
+ * @param data      Words to be checked
+ * @param words     Number of words
+ * @return          CRC of the block
+*/
+uint32_t CRC_calc(const uint32_t *data, uint32_t words)
+{
+#ifndef CRC_SOFTWARE
+    // Reset DR to CRC_INIT
+    CRC->CR = CRC_CR_RESET;
+
+    for (uint32_t i = 0; i < words; i++) {
+        CRC->DR = data[i];
+    }
+
+    return CRC->DR;
+#else
+    uint32_t crc = CRC_INIT;
+
+    for (uint32_t i = 0; i < words; i++) {
+        crc ^= data[i];
+
+        // Shift the word out MSB first
+        for (uint8_t bit = 0; bit < 32; bit++) {
+            if (crc & 0x80000000u) {
+                crc = (crc << 1) ^ CRC_POLYNOMIAL;
+            } else {
+                crc <<= 1;
+            }
+        }
+    }
+
+    return crc;
+#endif
+}
@@ -5,6 +5,13 @@
 // Offset for Bit Set/Reset Register
 #define BSRR_OFFSET     16u
 
+// Button interrupts wait on the I2C bus, so they must run below the I2C/DMA interrupts
+#define EXTI_IRQ_PRIORITY   2u
+
+// Sprite moved by the buttons
+#define BUTTON_SPRITE       0u
+#define IMG_STEP_X          5               // Amount of steps to move the sprite left/right
+
 /**
  * @brief       Initialize GPIO
 */
@@ -63,6 +70,8 @@ void initGPIOInterrupt(void)
 
     // NVIC Enable
     __disable_irq();
+    NVIC_SetPriority(EXTI4_IRQn, EXTI_IRQ_PRIORITY);
+    NVIC_SetPriority(EXTI9_5_IRQn, EXTI_IRQ_PRIORITY);
     NVIC_EnableIRQ(EXTI4_IRQn);
     NVIC_EnableIRQ(EXTI9_5_IRQn);
     __enable_irq();
@@ -85,7 +94,7 @@ void ledToggle(void)
 
 /**
  * @brief       Callback for interrupt on PA8
- *              Used to move the image right
+ *              Used to move the sprite right, it is redrawn by the next SSD1306_spriteCompose()
  *              Note: Previously used to set the Bit Set/Reset Register (PC7)
 */
 void EXTI9_5_IRQHandler() 
@@ -96,12 +105,12 @@ void EXTI9_5_IRQHandler()
     // // Set register
     // GPIOC->BSRR = (1u << 7);
 
-    SSD1306_moveImageRight();
+    (void)SSD1306_spriteMoveBy(BUTTON_SPRITE, IMG_STEP_X, 0);
 }
 
 /**
  * @brief       Callback for interrupt on PA4
- *              Used to move the image left
+ *              Used to move the sprite left, it is redrawn by the next SSD1306_spriteCompose()
  *              Note: Previously used to reset the Bit Set/Reset Register (PC7)
 */
 void EXTI4_IRQHandler()
@@ -111,5 +120,5 @@ void EXTI4_IRQHandler()
 
     // // Reset register
     // GPIOC->BSRR = (1u << (7u + BSRR_OFFSET));
-    SSD1306_moveImageLeft();
+    (void)SSD1306_spriteMoveBy(BUTTON_SPRITE, -IMG_STEP_X, 0);
 }
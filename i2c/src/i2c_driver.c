@@ -4,13 +4,180 @@
 */
 
 #include "../inc/i2c_driver.h"
+#include "../inc/timer.h"
 #include "stm32f4xx.h"
+
+// Bus speeds
+#define I2C_SM_HZ               100000u         // Standard mode
+#define I2C_FM_HZ               400000u         // Fast mode
+
+// DMA mapping for I2C1_TX (RM0368 Table 27: DMA1 request mapping)
+#define I2C_DMA_STREAM          DMA1_Stream6
+#define I2C_DMA_CHANNEL         1u
+#define I2C_DMA_IRQ_PRIORITY    1u              // Must preempt the EXTI handlers that wait on the bus
+
+// Transaction engine
+#define I2C_QUEUE_SIZE          16u             // Max number of queued transactions
+#define I2C_IRQ_PRIORITY        1u              // Same level as the DMA so neither preempts the other
+#define I2C_DMA_MIN_SIZE        16u             // Payloads at least this long are handed to the DMA
+#define I2C_STOP_TIMEOUT        25u             // Max wait in us for the STOP bit to clear before the next START (2.5 bit times at 100 kHz)
+
+// Polled transfers (I2C_start() to I2C_stop())
+#define I2C_START_TIMEOUT       1000u           // Max wait in us for the START condition (SB)
+
+// CR2 interrupt enable bits
+#define I2C_CR2_IT_MASK         ((1u << 8) | (1u << 9) | (1u << 10))    // ITERREN | ITEVTEN | ITBUFEN
+
+// SR1 error flags (BERR, ARLO, AF, OVR, TIMEOUT)
+#define I2C_SR1_ERR_MASK        ((1u << 8) | (1u << 9) | (1u << 10) | (1u << 11) | (1u << 14))
+
+// Engine states
+typedef enum {
+    I2C_STATE_IDLE = 0,         // No transaction on the bus
+    I2C_STATE_START,            // Waiting for SB, address is sent next
+    I2C_STATE_ADDR,             // Waiting for ADDR, control byte is sent next
+    I2C_STATE_DATA,             // Payload is being fed from the TXE interrupt
+    I2C_STATE_DMA,              // Payload is being fed by the DMA
+} I2C_STATE;
+
+// Queued transaction
+typedef struct {
+    uint8_t address;            // Slave address (write)
+    uint8_t control;            // Control byte sent before the payload
+    const uint8_t *data;        // Payload
+    uint16_t size;              // Payload size
+    I2C_Callback callback;      // Called on completion (may be NULL)
+    volatile uint8_t *result;   // Set to I2C_RESULT_DONE | status on completion (may be NULL)
+    uint8_t circular;           // Payload is repeated by a circular DMA until the stream is stopped
+} I2C_Transaction;
+
+#define I2C_RESULT_DONE         0x80u
+
+// DMA transfer state
+static volatile uint8_t dmaBusy;
+static volatile uint8_t dmaEnding;      // All bytes handed to the I2C, the event interrupt waits for BTF
+static uint8_t dmaReady;
+static I2C_Callback dmaCallback;
+
+// Transaction queue (ring buffer, head is the transaction on the bus)
+static I2C_Transaction i2cQueue[I2C_QUEUE_SIZE];
+static volatile uint8_t queueHead;
+static volatile uint8_t queueCount;
+static volatile I2C_STATE i2cState;
+static volatile uint16_t txIndex;
+static volatile uint32_t i2cProgress;   // Incremented on every engine event, used for stall detection
+
+// Circular stream state
+static volatile uint8_t streamActive;   // Set from I2C_streamStart() until the stream has ended
+static volatile uint8_t streamStopping; // End the stream at the next pass boundary
+static volatile uint32_t streamPasses;  // Completed passes over the payload
+static uint8_t streamSetupControl;      // Setup transaction sent before the stream (re)starts
+static const uint8_t *streamSetup;
+static uint16_t streamSetupSize;
+
+// Polled transfer state
+static volatile uint8_t pollOwner;      // Bus claimed by I2C_start() until I2C_stop() (or the DMA interrupt)
+static volatile uint8_t pollFailed;     // I2C_start() was refused or a step failed, the next steps return 1
+
+// Local Prototypes
+static uint8_t I2C_enqueue(uint8_t address, uint8_t control, const uint8_t *data, uint16_t size,
+                           I2C_Callback callback, volatile uint8_t *result, uint8_t circular);
+static uint8_t I2C_queueStream(uint8_t address, uint8_t control, const uint8_t *data, uint16_t size);
+static void I2C_startDMA(const uint8_t *data, uint16_t size, I2C_Callback callback, uint8_t circular);
+static uint32_t I2C_progress(void);
+static void I2C_kick(void);
+static void I2C_startNext(void);
+static void I2C_chain(uint8_t stop);
+static void I2C_finish(uint8_t status, uint8_t stop);
+static void I2C_dmaEnd(uint8_t status, uint8_t stop);
+static void I2C_streamComplete(uint8_t status);
+static uint8_t I2C_waitFlag(uint32_t flag, uint32_t start, uint32_t timeout);
+static void I2C_generateStop(void);
  
 /**
- * @brief       Enable I2C1 (PB8 SCL/PB9 SDA)
+ * @brief           Compute the FREQ/CCR/TRISE register values for a bus speed
+ *                  Table 61. I2C characteristics give values for T_r(SCL) and T_w(SCLH/SCLL).
+ *                  CCR is rounded up so the bus never runs faster than requested.
+ *
+ *                  Standard mode (T_high = T_low = CCR * T_PCLK1):
+ *                      CCR = PCLK1 / (2 * 100 kHz)
+ *                      TRISE = (1000ns / T_PCLK1) + 1
+ *                      e.g. PCLK1 = 45 MHz: CCR = 225, TRISE = 46
+ *
+ *                  Fast mode, DUTY = 0 (T_high = CCR * T_PCLK1, T_low = 2 * T_high):
+ *                      CCR = PCLK1 / (3 * 400 kHz)
+ *                  Fast mode, DUTY = 1 (T_high = 9 * CCR * T_PCLK1, T_low = 16 * CCR * T_PCLK1):
+ *                      CCR = PCLK1 / (25 * 400 kHz)
+ *                  Both fast modes:
+ *                      TRISE = (300ns / T_PCLK1) + 1
+ * @param pclk1     APB1 clock in Hz
+ * @param speed     Target bus speed
+ * @param timing    Computed register values
+ * @return          0 for success/1 for failure (PCLK1 out of range for the speed)
 */
-void I2C_init(void)
+uint8_t I2C_computeTiming(uint32_t pclk1, I2C_SPEED speed, I2C_Timing *timing)
+{
+    uint32_t freq = pclk1 / 1000000u;
+    uint32_t ccr;
+    uint32_t trise;
+
+    // FREQ must be 2 - 50 MHz, fast mode needs at least 4 MHz
+    if ((freq < 2u) || (freq > 50u) || ((speed != I2C_SPEED_STANDARD) && (freq < 4u))) {
+        return 1;
+    }
+
+    switch (speed) {
+    case I2C_SPEED_STANDARD:
+        ccr = (pclk1 + (2u * I2C_SM_HZ) - 1u) / (2u * I2C_SM_HZ);
+        if (ccr < 4u) {
+            ccr = 4u;                                       // Minimum allowed in standard mode
+        }
+        trise = freq + 1u;
+        break;
+
+    case I2C_SPEED_FAST:
+        ccr = (pclk1 + (3u * I2C_FM_HZ) - 1u) / (3u * I2C_FM_HZ);
+        if (ccr < 1u) {
+            ccr = 1u;
+        }
+        ccr |= (1u << 15);                                  // F/S: Fast mode
+        trise = ((freq * 300u) / 1000u) + 1u;
+        break;
+
+    case I2C_SPEED_FAST_DUTY:
+        ccr = (pclk1 + (25u * I2C_FM_HZ) - 1u) / (25u * I2C_FM_HZ);
+        if (ccr < 1u) {
+            ccr = 1u;
+        }
+        ccr |= (1u << 15) | (1u << 14);                     // F/S: Fast mode | DUTY: 16/9
+        trise = ((freq * 300u) / 1000u) + 1u;
+        break;
+
+    default:
+        return 1;
+    }
+
+    timing->freq = (uint8_t)freq;
+    timing->ccr = (uint16_t)ccr;
+    timing->trise = (uint8_t)trise;
+
+    return 0;
+}
+
+/**
+ * @brief           Enable I2C1 (PB8 SCL/PB9 SDA)
+ *                  Timings are computed from the PCLK1 read back from the RCC
+ * @param speed     Target bus speed
+ * @return          0 for success/1 for failure
+*/
+uint8_t I2C_init(I2C_SPEED speed)
 {    
+    I2C_Timing timing;
+
+    if (I2C_computeTiming(SysClockGetPCLK1(), speed, &timing) != 0) {
+        return 1;
+    }
+
     // 1. Enable I2C clock and GPIO clock
     RCC->APB1ENR |= RCC_APB1ENR_I2C1EN;
     RCC->AHB1ENR |= RCC_AHB1ENR_GPIOBEN;
@@ -37,76 +204,120 @@ void I2C_init(void)
 
     // 4. Program peripheral input clock in I2C_CR2 register in order
     //    to generate correct timings
-    I2C1->CR2 |= (45 << 0); // PLCK1 Frequency running at 45 MHz
+    I2C1->CR2 = (I2C1->CR2 & ~(0x3Fu << 0)) | (timing.freq << 0);
 
     // 5. Configure the clock control registers (CCR)
-    // Table 61. I2C characteristics give values for T_r(SCL) and T_w(SCLH)
-    // Using SM mode with the formula for T_high 
-    // where T_high = T_r(SCL) + T_w(SCLH) and T_PCLK1 = 1/45 MHz:
-    //      T_high = CCR * T_PCLK1
-    //      CCR = T_high / T_PCLK1
-    //      CCR = (T_r(SCL) + T_w(SCLH)) / T_PCLK1
-    //      CCR = (1000ns + 4000ns) / (22.222ns)
-    //      CCR = 225
-    
-    I2C1->CCR = (225 << 0);                  // Standard Mode | Duty Mode
+    I2C1->CCR = timing.ccr;
 
     // 6. Configure the rise time register
-    // Formula for TRISE:
-    //      TRISE = (T_r(SCL) / T_PCLK1) + 1
-    //      TRISE = (1000ns / 22.22ns) + 1
-    //      TRISE = 45 + 1 = 46
-    I2C1->TRISE = 46;
+    I2C1->TRISE = timing.trise;
 
     // 7. Program the I2C_CR1 register to enable the peripheral
     I2C1->CR1 |= (1u << 0);   
+
+    // 8. Enable the event/error interrupts in the NVIC. The sources stay masked in CR2
+    //    until a transaction is queued
+    queueHead = 0;
+    queueCount = 0;
+    i2cState = I2C_STATE_IDLE;
+    NVIC_SetPriority(I2C1_EV_IRQn, I2C_IRQ_PRIORITY);
+    NVIC_SetPriority(I2C1_ER_IRQn, I2C_IRQ_PRIORITY);
+    NVIC_EnableIRQ(I2C1_EV_IRQn);
+    NVIC_EnableIRQ(I2C1_ER_IRQn);
+
+    return 0;
 }
 
 /**
  * @brief       Start an I2C transfer
+ *              Claims the bus for the polled functions below until I2C_stop(). While the transaction
+ *              engine or a DMA transfer owns the bus the START is not generated and every following
+ *              step returns 1.
 */
 void I2C_start(void)
 {
+    uint32_t start = Time_us();
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    // Refuse while queued transactions or a DMA transfer are on (or waiting for) the bus. A repeated
+    // START is allowed in a polled transfer
+    if (dmaBusy || (!pollOwner && ((i2cState != I2C_STATE_IDLE) || queueCount))) {
+        pollFailed = 1;
+        __set_PRIMASK(primask);
+        return;
+    }
+    pollOwner = 1;
+    pollFailed = 0;
+
+    __set_PRIMASK(primask);
+
     // 1. Set the start bit in the I2C_CR1 register to generate Start condition
     I2C1->CR1 |= (1u << 8);                // Generate Start
 
     // 2. Wait for the start bit (SB, bit 0 in SR1) to set. This indicates that the start 
     //    condition is generated
-    while (!(I2C1->SR1 & (1u << 0)));      // Wait for SB to set
+    (void)I2C_waitFlag(1u << 0, start, I2C_START_TIMEOUT);
 }
 
 /**
- * @brief       End an I2C transfer
+ * @brief       End an I2C transfer started by I2C_start()
+ *              Generates the STOP and hands the bus back to the transaction engine
 */
 void I2C_stop(void)
 {
-    // 1. Stop generation by writing to the STOP register (bit 9 in CR1)
-    I2C1->CR1 |= (1u << 9);
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    // A transfer started by I2C_writeMultiDMA() is ended by the DMA interrupt
+    if (pollOwner && dmaBusy) {
+        __set_PRIMASK(primask);
+        return;
+    }
+
+    if (pollOwner) {
+        // 1. Drop a START that never got on the bus (bit 8 in CR1), it would be generated later
+        I2C1->CR1 &= ~(1u << 8);
+
+        // 2. Stop generation by writing to the STOP register (bit 9 in CR1)
+        I2C_generateStop();
+
+        // 3. Clear a NACK left by a failed step (AF, bit 10 in SR1, rc_w0)
+        I2C1->SR1 = ~(1u << 10) & 0xFFFFu;
+        pollOwner = 0;
+    }
+    pollFailed = 0;
+
+    __set_PRIMASK(primask);
+
+    // Run transactions that were queued while the bus was claimed
+    I2C_kick();
 }
 
 /**
  * @brief           Write to the I2C address
  * @param address   I2C address of device (Slave address)
- * @param timeout   Timeout to check if byte transfer finished
+ * @param timeout   Max wait in us for the byte transfer to finish
  * @return          0 for success/1 for failure
 */
 uint8_t I2C_writeSlaveAddress(uint8_t address, uint32_t timeout)
 {
-    uint32_t counter = 0;
+    uint32_t start = Time_us();
+
+    if (!pollOwner || pollFailed) {
+        return 1;
+    }
 
     // 1. Send the Slave Address to the DR register
     I2C1->DR = address;
 
     // 2. Wait for the Address Bit (ADDR, bit 1 in SR1) to set. This indicates the end of address transmission
-    while (!(I2C1->SR1 & (1u << 1))) {
-        if (counter >= timeout) {
-            return 1;
-        }
-        counter++;
+    if (I2C_waitFlag(1u << 1, start, timeout) != 0) {
+        return 1;
     }
 
     // 3. Clear the ADDR by reading the SR1 and SR2
-    uint8_t temp = I2C1->SR1 | I2C1->SR2;
+    (void)(I2C1->SR1 | I2C1->SR2);
 
     return 0;
 }
@@ -114,61 +325,743 @@ uint8_t I2C_writeSlaveAddress(uint8_t address, uint32_t timeout)
 /**
  * @brief           Write data to I2C device
  * @param data      Data to be written to device
- * @param timeout   Timeout to check if byte transfer finished
+ * @param timeout   Max wait in us for the byte transfer to finish
  * @return          0 for success/1 for failure
 */
 uint8_t I2C_write(uint8_t data, uint32_t timeout)
 {
-    uint32_t counter = 0;
+    uint32_t start = Time_us();
+
+    if (!pollOwner || pollFailed) {
+        return 1;
+    }
 
     // From Figure 164. Transfer sequence diagram for master transmitter
     // 1. Wait for the Data register empty for TX (TXE, bit 7 in SR1) to set. This indicates that the DR is empty
-    while (!(I2C1->SR1 & (1u << 7)));      // Wait for TXE bit to set;
+    if (I2C_waitFlag(1u << 7, start, timeout) != 0) {
+        return 1;
+    }
     
     // 2. Send the DATA to the DR register
     I2C1->DR = data;
 
     // 3. Wait for the Byte Transfer Finished (BTF, bit 2 in SR1) to set. 
     //    This indicates the end of LAST DATA transmission
-    while (!(I2C1->SR1 & (1u << 2))) {
-        if (counter >= timeout) {
+    return I2C_waitFlag(1u << 2, start, timeout);
+}
+
+/**
+ * @brief           Write multiple data to I2C device
+ * @param data      Data to be written to device
+ * @param size      Amount of data to be written
+ * @param timeout   Max wait in us for each byte transfer to finish
+ * @return          0 for success/1 for failure
+*/
+uint8_t I2C_writeMulti(uint8_t *data, uint16_t size, uint32_t timeout)
+{
+    if (!pollOwner || pollFailed) {
+        return 1;
+    }
+
+    // 1. Keep sending DATA to the DR register after performing the check if the TXE bit (bit 7 in SR1) is set
+    while (size) {
+        if (I2C_waitFlag(1u << 7, Time_us(), timeout) != 0) {
+            return 1;
+        }
+        I2C1->DR = (uint8_t)*data++;   // Send data
+        size--;
+    }
+
+    // 2. Once the DATA transfer is complete, wait for the BTF (bit 2 in SR1) to set. This indicates the end of
+    //    LAST DATA transmission
+    return I2C_waitFlag(1u << 2, Time_us(), timeout);
+}
+
+/**
+ * @brief           Wait for an SR1 flag during a polled transfer
+ *                  A timeout or a NACK (AF, bit 10 in SR1) fails the rest of the transfer until I2C_stop()
+ * @param flag      SR1 flag to wait for
+ * @param start     Time_us() at the start of the wait
+ * @param timeout   Max wait in us
+ * @return          0 for success/1 for failure
+*/
+static uint8_t I2C_waitFlag(uint32_t flag, uint32_t start, uint32_t timeout)
+{
+    uint32_t sr1;
+
+    while (!((sr1 = I2C1->SR1) & flag)) {
+        if ((sr1 & (1u << 10)) || (Time_elapsedUs(start) >= timeout)) {
+            pollFailed = 1;
             return 1;
         }
-        counter++;
     }
 
     return 0;
 }
 
 /**
- * @brief           Write multiple data to I2C device
+ * @brief       Generate a STOP condition (bit 9 in CR1)
+*/
+static void I2C_generateStop(void)
+{
+    I2C1->CR1 |= (1u << 9);
+}
+
+/**
+ * @brief       Configure DMA1 Stream 6 (Channel 1) for I2C1 transmission
+ *              The stream is left disabled until I2C_writeMultiDMA() starts a transfer
+*/
+void I2C_initDMA(void)
+{
+    // 1. Enable DMA1 clock
+    RCC->AHB1ENR |= RCC_AHB1ENR_DMA1EN;
+
+    // 2. Disable the stream and wait until it can be configured
+    I2C_DMA_STREAM->CR &= ~DMA_SxCR_EN;
+    while (I2C_DMA_STREAM->CR & DMA_SxCR_EN);
+
+    // 3. Select channel, memory-to-peripheral, memory increment, byte sizes, high priority
+    //    and enable the transfer complete/error interrupts
+    I2C_DMA_STREAM->CR = (I2C_DMA_CHANNEL << DMA_SxCR_CHSEL_Pos) | DMA_SxCR_DIR_0 | DMA_SxCR_MINC |
+                         DMA_SxCR_PL_1 | DMA_SxCR_TCIE | DMA_SxCR_TEIE;
+
+    // 4. Peripheral address is the I2C data register, direct mode (no FIFO)
+    I2C_DMA_STREAM->PAR = (uint32_t)(uintptr_t)&I2C1->DR;
+    I2C_DMA_STREAM->FCR = 0;
+
+    dmaBusy = 0;
+    dmaCallback = 0;
+    dmaReady = 1;
+
+    // 5. NVIC Enable
+    NVIC_SetPriority(DMA1_Stream6_IRQn, I2C_DMA_IRQ_PRIORITY);
+    NVIC_EnableIRQ(DMA1_Stream6_IRQn);
+}
+
+/**
+ * @brief           Write multiple data to I2C device using DMA
+ *                  Like I2C_writeMulti(), the START, slave address and any control byte must already
+ *                  have been sent. The function returns as soon as the DMA is running; the STOP is
+ *                  generated from the DMA interrupt, which also ends the I2C_start() claim on the bus
+ *                  (I2C_stop() is not needed), after which the callback is called.
+ * @param data      Data to be written to device (must stay valid until the callback)
+ * @param size      Amount of data to be written
+ * @param callback  Called on completion from interrupt context (may be NULL), with a failure status
+ *                  if the transfer ended on a bus error
+ * @return          0 for success/1 for failure (bus not claimed, DMA busy or nothing to send)
+*/
+uint8_t I2C_writeMultiDMA(const uint8_t *data, uint16_t size, I2C_Callback callback)
+{
+    if (!pollOwner || pollFailed || dmaBusy || (size == 0)) {
+        return 1;
+    }
+
+    // An error on the bus (e.g. a NACK) ends the transfer from I2C1_ER_IRQHandler() with a failure
+    I2C1->CR2 |= (1u << 8);                 // ITERREN
+    I2C_startDMA(data, size, callback, 0);
+
+    return 0;
+}
+
+/**
+ * @brief           Start the DMA on a payload
  * @param data      Data to be written to device
  * @param size      Amount of data to be written
- * @param timeout   Timeout to check if byte transfer finished
+ * @param callback  Called on completion from interrupt context (may be NULL)
+ * @param circular  Restart from the first byte after the last one until stopped (circular mode)
+*/
+static void I2C_startDMA(const uint8_t *data, uint16_t size, I2C_Callback callback, uint8_t circular)
+{
+    dmaBusy = 1;
+    dmaCallback = callback;
+
+    // 1. Clear any stale stream 6 flags
+    DMA1->HIFCR = DMA_HIFCR_CTCIF6 | DMA_HIFCR_CHTIF6 | DMA_HIFCR_CTEIF6 | DMA_HIFCR_CDMEIF6 | DMA_HIFCR_CFEIF6;
+
+    // 2. Program source, length and mode (CIRC can only be changed while the stream is disabled),
+    //    then enable the stream
+    I2C_DMA_STREAM->M0AR = (uint32_t)(uintptr_t)data;
+    I2C_DMA_STREAM->NDTR = size;
+    if (circular) {
+        I2C_DMA_STREAM->CR |= DMA_SxCR_CIRC;
+    } else {
+        I2C_DMA_STREAM->CR &= ~DMA_SxCR_CIRC;
+    }
+    I2C_DMA_STREAM->CR |= DMA_SxCR_EN;
+
+    // 3. Let the I2C request a byte from the DMA every time TXE is set (DMAEN, bit 11 in CR2)
+    I2C1->CR2 |= (1u << 11);
+}
+
+/**
+ * @brief       Check if an asynchronous transfer is in progress
+ *              Covers both the DMA and the transaction queue
+ * @return      1 if busy/0 if idle
+*/
+uint8_t I2C_isBusy(void)
+{
+    return (dmaBusy || (i2cState != I2C_STATE_IDLE)) ? 1 : 0;
+}
+
+/**
+ * @brief           Queue a write transaction: START, address, control byte, payload, STOP
+ *                  The transaction is run from the I2C1 event/error interrupts; the function
+ *                  returns immediately
+ * @param address   I2C address of device (Slave address)
+ * @param control   Control byte sent before the payload
+ * @param data      Payload (must stay valid until the callback)
+ * @param size      Amount of payload bytes
+ * @param callback  Called on completion from interrupt context (may be NULL)
+ * @return          0 for success/1 for failure (queue full)
+*/
+uint8_t I2C_queueWrite(uint8_t address, uint8_t control, const uint8_t *data, uint16_t size, I2C_Callback callback)
+{
+    uint8_t rv = I2C_enqueue(address, control, data, size, callback, 0, 0);
+
+    I2C_kick();
+    return rv;
+}
+
+/**
+ * @brief               Start a stream that sends a payload over and over in one transaction
+ *                      START, address and control byte are sent once, then a circular DMA repeats the
+ *                      payload without a STOP until I2C_streamStop(). Transactions queued meanwhile are
+ *                      not starved: the stream ends at the next pass boundary, they run, and the stream
+ *                      starts again behind them with the setup transaction first.
+ * @param address       I2C address of device (Slave address)
+ * @param setupControl  Control byte of the setup transaction
+ * @param setup         Setup payload sent before every (re)start of the stream (must stay valid, may be NULL)
+ * @param setupSize     Amount of setup bytes (0 for none)
+ * @param control       Control byte sent before the payload
+ * @param data          Payload, read by the DMA on every pass (must stay valid until the stream ends)
+ * @param size          Amount of payload bytes (at least I2C_DMA_MIN_SIZE)
+ * @return              0 for success/1 for failure (already streaming, no DMA, payload too short or queue full)
+*/
+uint8_t I2C_streamStart(uint8_t address, uint8_t setupControl, const uint8_t *setup, uint16_t setupSize,
+                        uint8_t control, const uint8_t *data, uint16_t size)
+{
+    if (streamActive || !dmaReady || (size < I2C_DMA_MIN_SIZE)) {
+        return 1;
+    }
+
+    streamSetupControl = setupControl;
+    streamSetup = setup;
+    streamSetupSize = (setup != 0) ? setupSize : 0;
+    streamStopping = 0;
+    streamPasses = 0;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    uint8_t rv = I2C_queueStream(address, control, data, size);
+    if (rv == 0) {
+        streamActive = 1;
+    }
+
+    __set_PRIMASK(primask);
+
+    I2C_kick();
+    return rv;
+}
+
+/**
+ * @brief           Stop the stream at the end of the current pass and wait until it has ended
+ *                  The payload is always sent whole, the STOP follows its last byte.
+ * @param timeout   Max wait in us without bus progress before the engine is aborted
  * @return          0 for success/1 for failure
 */
-uint8_t I2C_writeMulti(uint8_t *data, uint8_t size, uint32_t timeout)
+uint8_t I2C_streamStop(uint32_t timeout)
 {
-    uint32_t counter = 0;
+    uint32_t start = Time_us();
+    uint32_t progress = I2C_progress();
 
-    // 1. Wait for the Data register empty for TX (TXE, bit 7 in SR1) to set. This indicates that the DR is empty
-    while (!(I2C1->SR1 & (1u << 7)));           // Wait for TXE bit to set;
+    streamStopping = 1;
 
-    // 2. Keep sending DATA to the DR register after performing the check if the TXe bit is set
-    while (size) {
-        while (!(I2C1->SR1 & (1u << 7)));       // Wait for TXE bit to set;
-        I2C1->DR = (uint8_t)*data++;   // Send data
-        size--;
+    while (streamActive) {
+        if (progress != I2C_progress()) {
+            progress = I2C_progress();
+            start = Time_us();
+        }
+        if (Time_elapsedUs(start) >= timeout) {
+            I2C_abort();
+            return 1;
+        }
     }
 
-    // 3. Once the DATA transfer is complete, wait for the BTF (bit 2 in SR1) to set. This indicates the end of
-    //    LAST DATA transmission
-    while (!(I2C1->SR1 & (1u << 2))) {
-        if (counter >= timeout) {
+    return 0;
+}
+
+/**
+ * @brief   Check if a stream is running (or waiting behind queued transactions)
+ * @return  1 if streaming/0 if not (never started, stopped, or ended by a bus error)
+*/
+uint8_t I2C_isStreaming(void)
+{
+    return streamActive;
+}
+
+/**
+ * @brief   Number of completed passes over the stream payload since I2C_streamStart()
+ * @return  Passes
+*/
+uint32_t I2C_streamPasses(void)
+{
+    return streamPasses;
+}
+
+/**
+ * @brief           Blocking write transaction
+ *                  Thin wrapper that queues the transaction and waits for it to finish
+ * @param address   I2C address of device (Slave address)
+ * @param control   Control byte sent before the payload
+ * @param data      Payload
+ * @param size      Amount of payload bytes
+ * @param timeout   Max wait in us without bus progress before the engine is aborted
+ * @return          0 for success/1 for failure
+*/
+uint8_t I2C_transfer(uint8_t address, uint8_t control, const uint8_t *data, uint16_t size, uint32_t timeout)
+{
+    volatile uint8_t result = 0;
+    uint32_t start = Time_us();
+    uint32_t progress = I2C_progress();
+
+    // Wait for room in the queue
+    while (I2C_enqueue(address, control, data, size, 0, &result, 0) != 0) {
+        if (Time_elapsedUs(start) >= timeout) {
+            return 1;
+        }
+    }
+    I2C_kick();
+
+    // Wait for completion, restarting the timeout whenever the engine makes progress
+    start = Time_us();
+    while (!(result & I2C_RESULT_DONE)) {
+        if (progress != I2C_progress()) {
+            progress = I2C_progress();
+            start = Time_us();
+        }
+        if (Time_elapsedUs(start) >= timeout) {
+            // Bus is stuck, fail everything that is queued (including this transaction)
+            I2C_abort();
             return 1;
         }
-        counter++;        
-    };
+    }
+
+    return result & ~I2C_RESULT_DONE;
+}
+
+/**
+ * @brief       Abort the transaction engine
+ *              Generates a STOP, stops the DMA and fails every queued transaction and a polled transfer
+*/
+void I2C_abort(void)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    I2C1->CR2 &= ~(I2C_CR2_IT_MASK | (1u << 11));
+    if (dmaBusy) {
+        I2C_DMA_STREAM->CR &= ~DMA_SxCR_EN;
+        dmaBusy = 0;
+        dmaEnding = 0;
+    }
+    if ((i2cState != I2C_STATE_IDLE) || pollOwner) {
+        I2C_generateStop();
+    }
+
+    // A polled transfer loses the bus, its next steps fail until I2C_stop()
+    if (pollOwner) {
+        pollOwner = 0;
+        pollFailed = 1;
+    }
+
+    // Fail everything that is queued
+    i2cState = I2C_STATE_IDLE;
+    while (queueCount) {
+        I2C_Transaction *t = &i2cQueue[queueHead];
+        queueHead = (queueHead + 1) % I2C_QUEUE_SIZE;
+        queueCount--;
+        if (t->result) {
+            *t->result = I2C_RESULT_DONE | 1u;
+        }
+        if (t->callback) {
+            t->callback(1);
+        }
+    }
+
+    __set_PRIMASK(primask);
+}
+
+/**
+ * @brief           Add a transaction to the queue
+ *                  A running engine picks it up by itself, an idle one is started with I2C_kick()
+ * @return          0 for success/1 for failure (queue full)
+*/
+static uint8_t I2C_enqueue(uint8_t address, uint8_t control, const uint8_t *data, uint16_t size,
+                           I2C_Callback callback, volatile uint8_t *result, uint8_t circular)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    if (queueCount >= I2C_QUEUE_SIZE) {
+        __set_PRIMASK(primask);
+        return 1;
+    }
+
+    I2C_Transaction *t = &i2cQueue[(queueHead + queueCount) % I2C_QUEUE_SIZE];
+    t->address = address;
+    t->control = control;
+    t->data = data;
+    t->size = size;
+    t->callback = callback;
+    t->result = result;
+    t->circular = circular;
+    queueCount++;
 
+    __set_PRIMASK(primask);
     return 0;
 }
+
+/**
+ * @brief           Queue the setup transaction and the stream transaction
+ *                  Called with interrupts disabled or from interrupt context
+ * @param address   I2C address of device (Slave address)
+ * @param control   Control byte sent before the payload
+ * @param data      Payload
+ * @param size      Amount of payload bytes
+ * @return          0 for success/1 for failure (queue full, nothing is queued)
+*/
+static uint8_t I2C_queueStream(uint8_t address, uint8_t control, const uint8_t *data, uint16_t size)
+{
+    if ((queueCount + ((streamSetupSize != 0) ? 2u : 1u)) > I2C_QUEUE_SIZE) {
+        return 1;
+    }
+
+    if (streamSetupSize != 0) {
+        (void)I2C_enqueue(address, streamSetupControl, streamSetup, streamSetupSize, 0, 0, 0);
+    }
+    return I2C_enqueue(address, control, data, size, I2C_streamComplete, 0, 1);
+}
+
+/**
+ * @brief   Progress mark for stall detection
+ *          Changes with every engine event and with every byte the DMA moves, so a long DMA payload
+ *          (or a stream pass) is not mistaken for a stuck bus
+ * @return  Progress mark
+*/
+static uint32_t I2C_progress(void)
+{
+    return i2cProgress + (I2C_DMA_STREAM->NDTR << 16);
+}
+
+/**
+ * @brief       Start the engine on the queue if it is idle and the bus is free
+ *              Called from thread context after queuing (from interrupt context the engine is found
+ *              running). The STOP that ended the last transaction (bit 9 in CR1) may still be on its
+ *              way out and a START must not be requested before it is; it is polled here with the
+ *              interrupts enabled, the interrupt handlers never wait for it (see I2C_chain()).
+*/
+static void I2C_kick(void)
+{
+    uint32_t start = Time_us();
+
+    for (;;) {
+        uint32_t primask = __get_PRIMASK();
+        __disable_irq();
+
+        // Running, the bus claimed by a polled or direct DMA transfer, or nothing to send
+        if ((i2cState != I2C_STATE_IDLE) || dmaBusy || pollOwner || (queueCount == 0)) {
+            __set_PRIMASK(primask);
+            return;
+        }
+
+        if (!(I2C1->CR1 & (1u << 9)) || (Time_elapsedUs(start) >= I2C_STOP_TIMEOUT)) {
+            I2C_startNext();
+            __set_PRIMASK(primask);
+            return;
+        }
+
+        __set_PRIMASK(primask);
+    }
+}
+
+/**
+ * @brief       Start the transaction at the head of the queue
+ *              Never waits, no STOP may be pending. Right after another transaction this is a
+ *              repeated START, which only clears BTF once it is on the bus, so BTF is cleared here
+ *              (SR1 then DR read) and the next event is SB.
+*/
+static void I2C_startNext(void)
+{
+    i2cState = I2C_STATE_START;
+    I2C1->CR1 |= (1u << 8);                                             // Generate Start
+    (void)(I2C1->SR1 | I2C1->DR);
+    I2C1->CR2 = (I2C1->CR2 & ~(1u << 10)) | (1u << 8) | (1u << 9);     // ITERREN | ITEVTEN
+}
+
+/**
+ * @brief       End the transaction on the bus and carry on with the queue, from interrupt context
+ *              The I2C raises no event once a master STOP is on the bus, so a queued transaction
+ *              follows with a repeated START instead of a STOP and a START and the handlers never
+ *              wait for the bus. The STOP is only generated when the queue is empty.
+ * @param stop  The bus is still ours (0 after an arbitration loss, the START then waits for a free bus)
+*/
+static void I2C_chain(uint8_t stop)
+{
+    if (queueCount != 0) {
+        I2C_startNext();
+        return;
+    }
+
+    i2cState = I2C_STATE_IDLE;
+    I2C1->CR2 &= ~I2C_CR2_IT_MASK;
+    if (stop) {
+        I2C_generateStop();
+    }
+}
+
+/**
+ * @brief           Complete the transaction at the head of the queue and start the next one
+ * @param status    0 for success/1 for failure
+ * @param stop      The bus is still ours, end the transaction with a STOP or a repeated START
+*/
+static void I2C_finish(uint8_t status, uint8_t stop)
+{
+    I2C_Transaction *t = &i2cQueue[queueHead];
+    I2C_Callback callback = t->callback;
+    volatile uint8_t *result = t->result;
+
+    // Release the slot before notifying so the callback can queue more work, which then follows
+    // with a repeated START. The clock is stretched (BTF) until the transaction is ended
+    queueHead = (queueHead + 1) % I2C_QUEUE_SIZE;
+    queueCount--;
+    i2cProgress++;
+
+    if (result) {
+        *result = I2C_RESULT_DONE | status;
+    }
+    if (callback) {
+        callback(status);
+    }
+
+    // Carry on unless the callback aborted the engine
+    if (i2cState != I2C_STATE_IDLE) {
+        I2C_chain(stop);
+    }
+}
+
+/**
+ * @brief           Completion of a stream transaction
+ *                  A stream that ended for queued transactions has already been queued again behind them
+ * @param status    0 for success/1 for failure
+*/
+static void I2C_streamComplete(uint8_t status)
+{
+    if ((status != 0) || streamStopping) {
+        streamActive = 0;
+    }
+}
+
+/**
+ * @brief       Interrupt for I2C1 events
+ *              Follows Figure 164. Transfer sequence diagram for master transmitter
+*/
+void I2C1_EV_IRQHandler(void)
+{
+    uint32_t sr1 = I2C1->SR1;
+    I2C_Transaction *t = &i2cQueue[queueHead];
+
+    i2cProgress++;
+
+    // EV8_2 after a DMA transfer (queued or I2C_writeMultiDMA()): BTF set after the last byte, end it
+    if (dmaEnding) {
+        if (sr1 & (1u << 2)) {
+            I2C_dmaEnd(0, 1);
+        }
+        return;
+    }
+
+    switch (i2cState) {
+    case I2C_STATE_START:
+        // EV5: SB set, send the slave address
+        if (sr1 & (1u << 0)) {
+            I2C1->DR = t->address;
+            i2cState = I2C_STATE_ADDR;
+        }
+        break;
+
+    case I2C_STATE_ADDR:
+        // EV6: ADDR set, clear it by reading SR2 and send the control byte
+        if (sr1 & (1u << 1)) {
+            (void)I2C1->SR2;
+            I2C1->DR = t->control;
+            txIndex = 0;
+
+            if (t->circular && streamStopping) {
+                // Stream stopped while it was waiting, end with the control byte only
+                i2cState = I2C_STATE_DATA;
+                t->size = 0;
+            } else if (dmaReady && (t->size >= I2C_DMA_MIN_SIZE)) {
+                // Long payloads are fed by the DMA, I2C_dmaEnd() finishes the transaction
+                i2cState = I2C_STATE_DMA;
+                I2C1->CR2 &= ~((1u << 9) | (1u << 10));
+                I2C_startDMA(t->data, t->size, 0, t->circular);
+            } else {
+                i2cState = I2C_STATE_DATA;
+                if (t->size) {
+                    I2C1->CR2 |= (1u << 10);                            // ITBUFEN
+                }
+            }
+        }
+        break;
+
+    case I2C_STATE_DATA:
+        // EV8: TXE set, feed the next byte
+        if ((sr1 & (1u << 7)) && (txIndex < t->size)) {
+            I2C1->DR = t->data[txIndex++];
+            if (txIndex >= t->size) {
+                I2C1->CR2 &= ~(1u << 10);                               // Wait for BTF only
+            }
+        } else if ((sr1 & (1u << 2)) && (txIndex >= t->size)) {
+            // EV8_2: BTF set after the last byte, end the transaction
+            I2C_finish(0, 1);
+        }
+        break;
+
+    default:
+        // Spurious event, mask the sources until the next transaction
+        I2C1->CR2 &= ~((1u << 9) | (1u << 10));
+        break;
+    }
+}
+
+/**
+ * @brief       Interrupt for I2C1 errors
+ *              Fails the current transaction (queued or I2C_writeMultiDMA()) and moves on to the next one
+*/
+void I2C1_ER_IRQHandler(void)
+{
+    uint32_t sr1 = I2C1->SR1;
+    uint8_t stop = (sr1 & (1u << 9)) ? 0 : 1;   // On arbitration lost the bus is no longer ours, no STOP is generated
+
+    // Clear error flags (rc_w0)
+    I2C1->SR1 = ~(sr1 & I2C_SR1_ERR_MASK) & 0xFFFFu;
+
+    // Stop a running DMA, its completion will not arrive
+    if (dmaBusy) {
+        I2C1->CR2 &= ~(1u << 11);
+        I2C_DMA_STREAM->CR &= ~DMA_SxCR_EN;
+        I2C_dmaEnd(1, stop);
+        return;
+    }
+
+    if (i2cState == I2C_STATE_IDLE) {
+        return;
+    }
+
+    I2C_finish(1, stop);
+}
+
+/**
+ * @brief           End a DMA transfer: release the DMA, notify and end it on the bus
+ *                  Called once the last byte is out (BTF) or on a transfer or bus error
+ * @param status    0 for success/1 for failure
+ * @param stop      The bus is still ours, end the transfer with a STOP or a repeated START
+*/
+static void I2C_dmaEnd(uint8_t status, uint8_t stop)
+{
+    I2C_Callback callback = dmaCallback;
+
+    // Disable DMA requests and the BTF interrupt (the next transaction enables it again)
+    dmaEnding = 0;
+    I2C1->CR2 &= ~((1u << 11) | (1u << 9));
+    dmaBusy = 0;
+
+    // A queued transaction is finished by the engine
+    if (i2cState == I2C_STATE_DMA) {
+        I2C_finish(status, stop);
+        return;
+    }
+
+    // A direct transfer (I2C_writeMultiDMA()) hands the bus back to the engine. The callback runs
+    // before the transfer is ended so that it can chain the next transfer
+    pollOwner = 0;
+    pollFailed = 0;
+    if (callback) {
+        callback(status);
+    }
+
+    // Unless the callback claimed the bus again or queued work, which started the engine: STOP, or a
+    // repeated START for transactions queued while the transfer owned the bus
+    if (!pollOwner && (i2cState == I2C_STATE_IDLE)) {
+        I2C_chain(stop);
+    }
+}
+
+/**
+ * @brief       Interrupt for DMA1 Stream 6 (I2C1_TX)
+ *              The last byte is still being shifted out when the DMA completes, so the STOP is left
+ *              to the event interrupt, on BTF
+*/
+void DMA1_Stream6_IRQHandler(void)
+{
+    // A stream disabled by an error or I2C_abort() flags its end as well, nothing is running
+    if (!dmaBusy) {
+        DMA1->HIFCR = DMA_HIFCR_CTCIF6 | DMA_HIFCR_CHTIF6 | DMA_HIFCR_CTEIF6;
+        return;
+    }
+
+    if (DMA1->HISR & DMA_HISR_TEIF6) {
+        // Transfer error
+        DMA1->HIFCR = DMA_HIFCR_CTEIF6;
+        I2C_DMA_STREAM->CR &= ~DMA_SxCR_EN;
+        I2C_dmaEnd(1, 1);
+        return;
+    }
+    if (!(DMA1->HISR & DMA_HISR_TCIF6)) {
+        return;
+    }
+
+    // Transfer complete
+    DMA1->HIFCR = DMA_HIFCR_CTCIF6 | DMA_HIFCR_CHTIF6;
+
+    if (I2C_DMA_STREAM->CR & DMA_SxCR_CIRC) {
+        // A stream pass is done, the DMA has reloaded for the next one
+        const I2C_Transaction *t = &i2cQueue[queueHead];
+
+        streamPasses++;
+        i2cProgress++;
+
+        // The stream is the head of the queue, anything behind it is waiting for the bus
+        if (!streamStopping && (queueCount <= 1u)) {
+            return;
+        }
+
+        // Come back behind the waiting transactions
+        if (!streamStopping) {
+            if (I2C_queueStream(t->address, t->control, t->data, t->size) != 0) {
+                streamStopping = 1;
+            }
+        }
+
+        // End at a pass boundary. The reloaded DMA serves the next TXE at once, so bytes of the next
+        // pass may already be out when this interrupt runs late: stop the stream and send the rest
+        // of that pass in a last, non-circular run
+        I2C_DMA_STREAM->CR &= ~DMA_SxCR_EN;
+        while (I2C_DMA_STREAM->CR & DMA_SxCR_EN);
+
+        uint16_t left = (uint16_t)I2C_DMA_STREAM->NDTR;
+        if (left != t->size) {
+            DMA1->HIFCR = DMA_HIFCR_CTCIF6 | DMA_HIFCR_CHTIF6;
+            I2C_DMA_STREAM->M0AR = (uint32_t)(uintptr_t)(t->data + (t->size - left));
+            I2C_DMA_STREAM->NDTR = left;
+            I2C_DMA_STREAM->CR &= ~DMA_SxCR_CIRC;
+            I2C_DMA_STREAM->CR |= DMA_SxCR_EN;
+            return;
+        }
+    }
+
+    // No more DMA requests, the event interrupt ends the transfer once the last byte is out
+    dmaEnding = 1;
+    I2C1->CR2 = (I2C1->CR2 & ~((1u << 11) | (1u << 10))) | (1u << 9);     // ~DMAEN, ~ITBUFEN, ITEVTEN
+}
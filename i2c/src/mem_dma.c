@@ -0,0 +1,215 @@
+/**
+ * This module copies and fills word aligned memory with DMA2 without the use of the HAL library.
+ * Only DMA2 can do memory-to-memory transfers (RM0368 9.3.6: Memory-to-memory mode). Stream 0 is used
+ * with 32-bit transfers, the source on the peripheral port and the FIFO enabled (direct mode is not
+ * allowed in memory-to-memory mode).
+ *
+ * Transfers are queued and started back to back from the completion interrupt, so the CPU is free
+ * until it touches the memory again. MEMDMA_wait() is the completion point for everything queued.
+*/
+
+#include "../inc/mem_dma.h"
+#include <stddef.h>
+#include "../inc/timer.h"
+#include "stm32f4xx.h"
+
+#define MEMDMA_STREAM           DMA2_Stream0
+#define MEMDMA_IRQ_PRIORITY     1u              // Must preempt the EXTI handlers that wait for a transfer
+#define MEMDMA_QUEUE_SIZE       4u              // Max number of queued transfers
+
+// All interrupt flags of stream 0
+#define MEMDMA_FLAGS            (DMA_LIFCR_CTCIF0 | DMA_LIFCR_CHTIF0 | DMA_LIFCR_CTEIF0 | DMA_LIFCR_CDMEIF0 | DMA_LIFCR_CFEIF0)
+
+// Queued transfer
+typedef struct {
+    uint32_t *dst;              // Destination
+    const uint32_t *src;        // Source, NULL for a fill
+    uint32_t value;             // Fill value, read by the DMA from here
+    uint16_t words;             // Number of words
+} MEMDMA_Transfer;
+
+// Transfer queue (ring buffer, head is the transfer on the stream)
+static MEMDMA_Transfer memQueue[MEMDMA_QUEUE_SIZE];
+static volatile uint8_t memHead;
+static volatile uint8_t memCount;
+static volatile uint8_t memStatus;      // Set by a transfer error, reported by MEMDMA_wait()
+
+// Local Prototypes
+static uint8_t MEMDMA_enqueue(uint32_t *dst, const uint32_t *src, uint32_t value, uint16_t words);
+static void MEMDMA_start(void);
+
+/**
+ * @brief       Configure DMA2 Stream 0 for memory-to-memory transfers
+ *              The stream is left disabled until a transfer is queued
+*/
+void MEMDMA_init(void)
+{
+    // 1. Enable DMA2 clock
+    RCC->AHB1ENR |= RCC_AHB1ENR_DMA2EN;
+
+    // 2. Disable the stream and wait until it has stopped
+    MEMDMA_STREAM->CR &= ~DMA_SxCR_EN;
+    while (MEMDMA_STREAM->CR & DMA_SxCR_EN);
+
+    // 3. FIFO mode, threshold full FIFO
+    MEMDMA_STREAM->FCR = DMA_SxFCR_DMDIS | DMA_SxFCR_FTH;
+
+    memHead = 0;
+    memCount = 0;
+    memStatus = 0;
+
+    // 4. Enable the stream interrupt
+    NVIC_SetPriority(DMA2_Stream0_IRQn, MEMDMA_IRQ_PRIORITY);
+    NVIC_EnableIRQ(DMA2_Stream0_IRQn);
+}
+
+/**
+ * @brief           Queue a copy of words
+ *                  The source may be in flash. Neither side may be touched until MEMDMA_wait().
+ * @param dst       Destination (word aligned)
+ * @param src       Source (word aligned)
+ * @param words     Number of words (1-65535)
+ * @return          0 for success/1 for failure (queue full or misaligned, nothing is queued)
+*/
+uint8_t MEMDMA_copy(uint32_t *dst, const uint32_t *src, uint16_t words)
+{
+    if (src == NULL) {
+        return 1;
+    }
+
+    return MEMDMA_enqueue(dst, src, 0, words);
+}
+
+/**
+ * @brief           Queue a fill of words with a value
+ * @param dst       Destination (word aligned)
+ * @param value     Fill value
+ * @param words     Number of words (1-65535)
+ * @return          0 for success/1 for failure (queue full or misaligned, nothing is queued)
+*/
+uint8_t MEMDMA_fill(uint32_t *dst, uint32_t value, uint16_t words)
+{
+    return MEMDMA_enqueue(dst, NULL, value, words);
+}
+
+/**
+ * @brief   Check for queued transfers
+ * @return  1 while a transfer is queued or running/0 when idle
+*/
+uint8_t MEMDMA_isBusy(void)
+{
+    return (memCount != 0) ? 1 : 0;
+}
+
+/**
+ * @brief           Wait until every queued transfer has finished
+ * @param timeout   Max wait time in us
+ * @return          0 for success/1 for failure (timeout, or a transfer failed since the last wait)
+*/
+uint8_t MEMDMA_wait(uint32_t timeout)
+{
+    uint32_t start = Time_us();
+    uint8_t rv;
+
+    while (memCount != 0) {
+        if (Time_elapsedUs(start) >= timeout) {
+            return 1;
+        }
+    }
+
+    rv = memStatus;
+    memStatus = 0;
+
+    return rv;
+}
+
+/**
+ * @brief           Add a transfer to the queue and start it if the stream is idle
+ * @param dst       Destination (word aligned)
+ * @param src       Source (word aligned), NULL to fill with value
+ * @param value     Fill value
+ * @param words     Number of words
+ * @return          0 for success/1 for failure
+*/
+static uint8_t MEMDMA_enqueue(uint32_t *dst, const uint32_t *src, uint32_t value, uint16_t words)
+{
+    uint8_t rv = 0;
+
+    // Word transfers need word aligned addresses on both ports
+    if ((words == 0) || ((uintptr_t)dst & 3u) || ((uintptr_t)src & 3u)) {
+        return 1;
+    }
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    if (memCount >= MEMDMA_QUEUE_SIZE) {
+        rv = 1;
+    } else {
+        MEMDMA_Transfer *t = &memQueue[(memHead + memCount) % MEMDMA_QUEUE_SIZE];
+
+        t->dst = dst;
+        t->src = src;
+        t->value = value;
+        t->words = words;
+        memCount++;
+
+        if (memCount == 1) {
+            MEMDMA_start();
+        }
+    }
+
+    __set_PRIMASK(primask);
+
+    return rv;
+}
+
+/**
+ * @brief   Start the transfer at the head of the queue
+ *          Called with interrupts disabled or from the stream interrupt
+*/
+static void MEMDMA_start(void)
+{
+    const MEMDMA_Transfer *t = &memQueue[memHead];
+    uint32_t cr = DMA_SxCR_DIR_1 | DMA_SxCR_MINC | DMA_SxCR_PSIZE_1 | DMA_SxCR_MSIZE_1 |
+                  DMA_SxCR_TCIE | DMA_SxCR_TEIE;
+
+    DMA2->LIFCR = MEMDMA_FLAGS;
+
+    // The peripheral port reads the source, a fill reads the same word every time
+    if (t->src) {
+        MEMDMA_STREAM->PAR = (uint32_t)(uintptr_t)t->src;
+        cr |= DMA_SxCR_PINC;
+    } else {
+        MEMDMA_STREAM->PAR = (uint32_t)(uintptr_t)&t->value;
+    }
+
+    MEMDMA_STREAM->M0AR = (uint32_t)(uintptr_t)t->dst;
+    MEMDMA_STREAM->NDTR = t->words;
+    MEMDMA_STREAM->CR = cr;
+    MEMDMA_STREAM->CR = cr | DMA_SxCR_EN;
+}
+
+/**
+ * @brief   Interrupt for DMA2 Stream 0 (memory-to-memory)
+ *          Retires the finished transfer and starts the next one
+*/
+void DMA2_Stream0_IRQHandler(void)
+{
+    if (DMA2->LISR & DMA_LISR_TEIF0) {
+        // Transfer error, the stream has been disabled by hardware
+        memStatus = 1;
+    } else if (!(DMA2->LISR & DMA_LISR_TCIF0)) {
+        return;
+    }
+
+    DMA2->LIFCR = MEMDMA_FLAGS;
+    MEMDMA_STREAM->CR &= ~DMA_SxCR_EN;
+
+    memHead = (memHead + 1) % MEMDMA_QUEUE_SIZE;
+    memCount--;
+
+    if (memCount != 0) {
+        MEMDMA_start();
+    }
+}
@@ -3,14 +3,18 @@
  * The library, https://github.com/4ilo/ssd1306-stm32HAL, is referenced.
 */
 #include "../inc/ssd1306_driver.h"
+#include <stddef.h>
 #include "../inc/i2c_driver.h"
 #include "../inc/timer.h"
+#include "../inc/crc.h"
+#include "../inc/mem_dma.h"
 #include "stm32f4xx.h"
 
 // SSD1306 config
 #define SSD1306_I2C_ADDR        0x78            // Slave address: “b0111 1000”
 #define SSD1306_WIDTH           128u            // OLED width
 #define SSD1306_HEIGHT          64u             // OLED height
+#define SSD1306_BUFFER_SIZE     ((SSD1306_WIDTH * SSD1306_HEIGHT) / 8)
 
 // Address increment table
 #define SSD1306_WRITE_COMMAND   0x00            // DC 0, RW 0
@@ -24,20 +28,191 @@
 #define I2C_MEMADD_SIZE_16BIT   0x00000010u     // Used to check if memory address is 16-bit
 
 // Configurable settings
-#define IMG_STEP_X              5u              // Amount of steps to move image left/right
-#define TIMEOUT_MS              100000u         // Max wait time
-
-// Screenbuffer
-static uint8_t SSD1306_Buffer[(SSD1306_WIDTH * SSD1306_HEIGHT) / 8];
+#define TIMEOUT_US              100000u         // Max wait time in us (100 ms)
+#define UPDATE_TIMEOUT_US       250000u         // Max wait time in us for a queued frame update (a whole frame is ~95 ms at 100 kHz)
+#define SSD1306_DIFF_GAP        8u              // Unchanged bytes between two changed runs that are sent anyway
+#define SSD1306_DIFF_RUNS       4u              // Max runs per page, further changes are merged into the last run
+#define SSD1306_CRC_BLOCK       16u             // Columns per CRC block (multiple of 4)
+
+// Define SSD1306_STRIP_ONLY to leave out the screenbuffers and everything built on them.
+// Frames are then only drawn with SSD1306_updateStrips(), which needs 2 x 128 bytes instead.
+#ifndef SSD1306_STRIP_ONLY
+
+// Screenbuffers (word aligned for the shadow compare and the CRC unit)
+// Drawing goes to the back buffer, the front buffer holds the presented frame while it is sent
+static __ALIGNED(4) uint8_t SSD1306_Buffer[2][SSD1306_BUFFER_SIZE];
+static uint8_t *backBuffer = SSD1306_Buffer[0];
+static uint8_t *frontBuffer = SSD1306_Buffer[1];
+
+// Define SSD1306_MEMDMA to hand full clears, frame loads and the back buffer copy of
+// SSD1306_present() to DMA2 (mem_dma.c). The CPU carries on while they run; drawing and the next
+// update wait for them first.
+
+// Copy of the GDDRAM contents of the panel, used by the shadow diff
+// Define SSD1306_NO_SHADOW to save the 1 KB, SSD1306_DIFF_SHADOW is then rejected
+#ifndef SSD1306_NO_SHADOW
+static __ALIGNED(4) uint8_t SSD1306_Shadow[SSD1306_BUFFER_SIZE];
+#endif
+
+// CRC of every block as last sent to the panel, used by the CRC diff (256 bytes)
+static uint32_t blockCrc[SSD1306_HEIGHT / 8][SSD1306_WIDTH / SSD1306_CRC_BLOCK];
+
+#endif // SSD1306_STRIP_ONLY
+
+// Define SSD1306_BITBAND to set pixels with one store to the bit-band alias of their bit
+// (PM0214 2.2.5: Bit-banding) instead of a read-modify-write of the byte.
+// Define SSD1306_BITBAND_EMULATE as well for a host build: the low 20 bits of the pointer stand for
+// the offset in the bit-band region, the same alias address is computed and decoded back to the bit
+// instead of being written.
+#define BITBAND_SRAM_BASE       0x20000000u     // Start of the SRAM bit-band region
+#define BITBAND_ALIAS_BASE      0x22000000u     // Start of the SRAM bit-band alias region
+#define BITBAND_REGION_SIZE     0x00100000u     // 1 MB of SRAM, 32 MB of alias words
+
+// Control byte Continuation bit: only one data/command byte follows before the next control byte
+#define SSD1306_CONTROL_CO      0x80
+
+// Dirty column range of a page that is clean
+#define SSD1306_CLEAN_MIN       0xFFu
+#define SSD1306_CLEAN_MAX       0x00u
+
+// Transfer segment: address window commands followed by the buffer bytes inside the window
+typedef struct {
+    uint8_t commands[7];        // Window commands (page or horizontal addressing), may lead with a start line
+    uint8_t commandLen;         // Number of command bytes
+    uint8_t *data;              // First buffer byte of the window
+    uint16_t size;              // Number of buffer bytes
+} SSD1306_Segment;
+
+// Sprite table entry
+typedef struct {
+    const ImgDef *const *frames;    // Animation frames, NULL for an unused entry
+    uint8_t frameCount;             // Number of frames
+    uint8_t frame;                  // Frame being shown
+    uint8_t x;                      // Left column
+    uint8_t y;                      // Top row
+    uint8_t z;                      // Sprites with a higher z are drawn on top
+    uint8_t visible;                // Drawn if set
+} SSD1306_Sprite;
 
 // Screen Object
 static SSD1306_t SSD1306;
-static ImgDef lastImg;
+static SSD1306_UPDATE_MODE updateMode = SSD1306_UPDATE_PAGE;
+static SSD1306_DRAW_MODE drawMode = SSD1306_DRAW_COPY;
+
+// Sprites, indexed by id
+static SSD1306_Sprite sprites[SSD1306_MAX_SPRITES];
+
+#ifndef SSD1306_STRIP_ONLY
+// Dirty column range per page of the back buffer, updated by the drawing functions (min > max when clean)
+static uint8_t dirtyMin[SSD1306_HEIGHT / 8];
+static uint8_t dirtyMax[SSD1306_HEIGHT / 8];
+
+// Column range per page covered by sprites since the last SSD1306_spriteCompose() (min > max when clean)
+static uint8_t damageMin[SSD1306_HEIGHT / 8];
+static uint8_t damageMax[SSD1306_HEIGHT / 8];
+static const uint8_t *spriteBackground;     // Frame under the sprites, NULL for black
+
+// Dirty column range per page of the front buffer, taken over from the back buffer when presented
+static uint8_t frameMin[SSD1306_HEIGHT / 8];
+static uint8_t frameMax[SSD1306_HEIGHT / 8];
+
+// Segments of the update in progress
+static SSD1306_Segment segments[(SSD1306_HEIGHT / 8) * SSD1306_DIFF_RUNS];
+static uint8_t segmentCount;
+
+// Change detection state
+static SSD1306_DIFF_MODE diffMode = SSD1306_DIFF_NONE;
+static uint8_t diffValid;               // Set once the shadow/block CRCs match the panel
+
+// Display start line the panel should use (40h~7Fh), sent ahead of the next update while pending
+static uint8_t startLine;
+static uint8_t startLinePending;
+
+// Console state: the 8 pages of the screenbuffer form a ring, consoleTop is the page shown at the top
+static const uint8_t *consoleGlyphs;    // Page-major glyphs of the console font, NULL while not in use
+static uint8_t consoleWidth;            // Glyph width
+static uint8_t consolePages;            // Pages per text line
+static uint8_t consoleLines;            // Text lines on the screen
+static uint8_t consoleTop;              // Ring page at the top of the screen
+static uint8_t consoleLine;             // Cursor line (0 is the top line)
+static uint8_t consoleCol;              // Cursor column
+static SSD1306_COLOR consoleColor;
+
+// Mirror state: the back buffer is streamed to the panel by a circular DMA
+static uint8_t mirrorActive;
+static uint8_t mirrorSetup[9];          // Commands sent before every (re)start of the stream
+
+// Queued update state
+static volatile uint8_t updateSegment;  // Segment currently being transmitted
+static volatile uint8_t updateStatus;   // Accumulated status of the queued frame update
+static SSD1306_Callback updateCallback;
+#endif // SSD1306_STRIP_ONLY
+
+// Set while a queued frame update is in progress
+static volatile uint8_t updateBusy;
+
+// Hardware scroll state: the GDDRAM of these pages is being rotated by the panel (bit n = page n)
+static uint8_t scrollPages;
+static uint8_t scrollVertical;          // Set if the scroll moves rows too (29h/2Ah)
+
+// Pipelined update state: one page is sent while the next one is rendered
+static __ALIGNED(4) uint8_t pipeBuffer[2][SSD1306_WIDTH];
+static uint8_t pipeCommands[2][6];
+static volatile uint8_t pipeDone;       // Pages finished (sent or failed)
+static volatile uint8_t pipeStatus;     // Accumulated status of the pipelined update
+
+// Strip rendering state: while stripBuffer is set, drawing goes to the 8 rows of stripPage in it
+static uint8_t *stripBuffer;
+static uint8_t stripPage;
+static SSD1306_DrawCallback stripDraw;
+static SSD1306_t stripCursor;           // Cursor state every replay of the draw callback starts from
 
 // Local Prototypes
+static uint8_t SSD1306_startTransfer(uint16_t memAddress, uint16_t memSize);
+static uint8_t SSD1306_waitIdle(void);
+#ifndef SSD1306_STRIP_ONLY
+static uint8_t SSD1306_present(void);
+static void SSD1306_buildSegments(void);
+static void SSD1306_addSegment(uint8_t page, uint8_t start, uint8_t end);
+static void SSD1306_diffPage(uint8_t page, uint8_t start, uint8_t end);
+static void SSD1306_crcPage(uint8_t page, uint8_t start, uint8_t end);
+static void SSD1306_updateFailed(void);
+static uint8_t SSD1306_mirrorRunning(void);
+static uint8_t SSD1306_queueSegment(uint8_t index);
+static void SSD1306_commandComplete(uint8_t status);
+static void SSD1306_segmentComplete(uint8_t status);
+#endif
+static void SSD1306_pipeComplete(uint8_t status);
+static void SSD1306_pipePageComplete(uint8_t status);
+static uint8_t SSD1306_pipeWait(uint8_t pages);
+static void SSD1306_markDirty(int16_t x0, int16_t y0, int16_t x1, int16_t y1);
+static void SSD1306_setPixel(uint8_t x, uint8_t y, SSD1306_COLOR color);
+#ifdef SSD1306_BITBAND
+static uint32_t SSD1306_bitbandAlias(uint32_t address, uint8_t bit);
+static void SSD1306_bitbandWrite(uint8_t *byte, uint8_t bit, uint32_t value);
+#endif
+static uint8_t *SSD1306_target(uint8_t x, uint8_t y);
+static void SSD1306_fillBytes(uint8_t *dst, uint8_t value, uint16_t count);
+static void SSD1306_memWait(void);
+static void SSD1306_targetRows(int16_t y, uint16_t h, uint16_t *first, uint16_t *end);
+static void SSD1306_blitRows(const uint16_t *rows, const uint16_t *maskRows, uint16_t x, uint16_t y, uint8_t w, uint16_t h, SSD1306_COLOR color);
+static void SSD1306_transposeRows(const uint16_t *rows, uint8_t count, uint32_t *columns);
+static void SSD1306_transpose8(uint32_t x, uint32_t y, uint32_t *columns);
+static void SSD1306_blitPages(const uint8_t *pages, uint16_t x, uint16_t y, uint8_t w, uint16_t h, SSD1306_COLOR color);
+static uint8_t SSD1306_blend(uint8_t ink, uint8_t opaque, uint8_t rows, SSD1306_COLOR color, uint8_t *clear);
+static void SSD1306_writeColumn(uint16_t x, uint16_t y, uint8_t bits, uint8_t mask);
+static void SSD1306_renderStrip(uint8_t page, uint8_t *buffer);
+static void SSD1306_damageSprite(uint8_t id);
+static void SSD1306_sortSprites(const SSD1306_Sprite *table, uint8_t *order);
+static void SSD1306_drawSprite(const SSD1306_Sprite *sprite);
+static uint32_t SSD1306_imgWindow(const ImgDef *img, uint16_t row, int16_t col);
+#ifndef SSD1306_STRIP_ONLY
+static void SSD1306_consoleNewline(void);
+static void SSD1306_consoleClearPages(uint8_t page, uint8_t count);
+#endif
+static void SSD1306_batchAppend(SSD1306_Batch *batch, uint8_t control, uint8_t value);
 uint8_t SSD1306_write(uint8_t data, uint16_t memAddress, uint16_t memSize);
-uint8_t SSD1306_writeMulti(uint8_t *data, uint8_t size, uint16_t memAddress, uint16_t memSize);
-void SSD1306_draw_pixel(uint8_t x, uint8_t y, SSD1306_COLOR color);
+uint8_t SSD1306_writeMulti(uint8_t *data, uint16_t size, uint16_t memAddress, uint16_t memSize);
 char SSD1306_write_char(char ch, FontDef Font, SSD1306_COLOR color, uint8_t wrap);
 
 /**
@@ -47,6 +222,9 @@ char SSD1306_write_char(char ch, FontDef Font, SSD1306_COLOR color, uint8_t wrap
 uint8_t SSD1306_init(void)
 {
     uint8_t rv = 0;
+    SSD1306_Batch batch;
+
+    SSD1306_batchInit(&batch);
 
     // Wait for screen to boot
     Delay_ms(100);
@@ -56,79 +234,99 @@ uint8_t SSD1306_init(void)
     //////////////////
 
     // Set Display ON/OFF (AFh/AEh)
-    rv += SSD1306_write(0xAE, SSD1306_WRITE_COMMAND, 1);    // Set Display off
+    SSD1306_batchCommand(&batch, 0xAE);                     // Set Display off
+
+    // Deactivate scroll (2Eh), it survives a reset of the MCU
+    SSD1306_batchCommand(&batch, 0x2E);
 
     // Set Memory Addressing mode (20h)
-    rv += SSD1306_write(0x20, SSD1306_WRITE_COMMAND, 1);    // Set Memory Addressing Mode
-    rv += SSD1306_write(0x10, SSD1306_WRITE_COMMAND, 1);    // Set to Page Addressing Mode
+    SSD1306_batchCommand(&batch, 0x20);                     // Set Memory Addressing Mode
+    SSD1306_batchCommand(&batch, 0x10);                     // Set to Page Addressing Mode
                                                             // 00: Horizontal Addressing Mode;
                                                             // 01: Vertical Addressing Mode;
                                                             // 10: Page Addressing Mode (RESET);
                                                             // 11: Invalid;
-    rv += SSD1306_write(0xB0, SSD1306_WRITE_COMMAND, 1);    // Set the page start address (B0h - B7h)
-    rv += SSD1306_write(0x00, SSD1306_WRITE_COMMAND, 1);    // Set low column address for page adressing
-    rv += SSD1306_write(0x10, SSD1306_WRITE_COMMAND, 1);    // Set high column address for page adressing
+    SSD1306_batchCommand(&batch, 0xB0);                     // Set the page start address (B0h - B7h)
+    SSD1306_batchCommand(&batch, 0x00);                     // Set low column address for page adressing
+    SSD1306_batchCommand(&batch, 0x10);                     // Set high column address for page adressing
 
     // Set COM Output Scan Direction (C0h/C8h)
-    rv += SSD1306_write(0xC8, SSD1306_WRITE_COMMAND, 1);    // COM output scan from COM63 to COM0
+    SSD1306_batchCommand(&batch, 0xC8);                     // COM output scan from COM63 to COM0
 
     // Set Display Start Line (40h~7Fh)
-    rv += SSD1306_write(0x40, SSD1306_WRITE_COMMAND, 1);    // Set start line address
+    SSD1306_batchCommand(&batch, 0x40);                     // Set start line address
 
     // Set contrast control register (81h)
-    rv += SSD1306_write(0x81, SSD1306_WRITE_COMMAND, 1);    // Set contrast control register
-    rv += SSD1306_write(0xFF, SSD1306_WRITE_COMMAND, 1);    // Set contrast steps from 00h to FFh
+    SSD1306_batchCommand(&batch, 0x81);                     // Set contrast control register
+    SSD1306_batchCommand(&batch, 0xFF);                     // Set contrast steps from 00h to FFh
                                                             // Output current increases as step value increases
 
     // Set Segment Re-map (A0h/A1h)
-    rv += SSD1306_write(0xA1, SSD1306_WRITE_COMMAND, 1);    // Set segment re-map 0 to 127
+    SSD1306_batchCommand(&batch, 0xA1);                     // Set segment re-map 0 to 127
 
     // Set Normal/Inverse Display (A6h/A7h)
-    rv += SSD1306_write(0xA6, SSD1306_WRITE_COMMAND, 1);    // Set normal display
+    SSD1306_batchCommand(&batch, 0xA6);                     // Set normal display
 
     // Set multiplex ratio(1 to 64)
-    rv += SSD1306_write(0xA8, SSD1306_WRITE_COMMAND, 1);                    // Set multiplex ratio(1 to 64)
-    rv += SSD1306_write(SSD1306_HEIGHT - 1, SSD1306_WRITE_COMMAND, 1);      // Set Value of Multiplex Ratio
-    rv += SSD1306_write(0xA4, SSD1306_WRITE_COMMAND, 1);                    // 0xA4: Output follows RAM content
+    SSD1306_batchCommand(&batch, 0xA8);                                     // Set multiplex ratio(1 to 64)
+    SSD1306_batchCommand(&batch, SSD1306_HEIGHT - 1);                       // Set Value of Multiplex Ratio
+    SSD1306_batchCommand(&batch, 0xA4);                                     // 0xA4: Output follows RAM content
                                                                             // 0xA5: Output ignores RAM content
     
      // Set display offset (D3)
-    rv += SSD1306_write(0xD3, SSD1306_WRITE_COMMAND, 1);  // Set display offset
-    rv += SSD1306_write(0x00, SSD1306_WRITE_COMMAND, 1);  // No offset
+    SSD1306_batchCommand(&batch, 0xD3);                   // Set display offset
+    SSD1306_batchCommand(&batch, 0x00);                   // No offset
 
     // Set display clock divide ratio/oscillator frequency (D5h)
-    rv += SSD1306_write(0xD5, SSD1306_WRITE_COMMAND, 1);  // Set display clock divide ratio/oscillator frequency
-    rv += SSD1306_write(0xF0, SSD1306_WRITE_COMMAND, 1);  // Set divide ratio
+    SSD1306_batchCommand(&batch, 0xD5);                   // Set display clock divide ratio/oscillator frequency
+    SSD1306_batchCommand(&batch, 0xF0);                   // Set divide ratio
 
     // Set pre-charge period (D9h)
-    rv += SSD1306_write(0xD9, SSD1306_WRITE_COMMAND, 1);  // Set pre-charge period
-    rv += SSD1306_write(0x22, SSD1306_WRITE_COMMAND, 1);  // Precharge set to 34 counts
+    SSD1306_batchCommand(&batch, 0xD9);                   // Set pre-charge period
+    SSD1306_batchCommand(&batch, 0x22);                   // Precharge set to 34 counts
 
     // Set com pins hardware configuration (DAh)
-    rv += SSD1306_write(0xDA, SSD1306_WRITE_COMMAND, 1);                                // Set com pins hardware configuration
-    rv += SSD1306_write(((0u << 5) | (1u << 4) | (0x02)), SSD1306_WRITE_COMMAND, 1);    // Disable L/R remap | Alt COM config
+    SSD1306_batchCommand(&batch, 0xDA);                                                 // Set com pins hardware configuration
+    SSD1306_batchCommand(&batch, ((0u << 5) | (1u << 4) | (0x02)));                     // Disable L/R remap | Alt COM config
 
     // Set V_comh Deselect level (DBh)
-    rv += SSD1306_write(0xDB, SSD1306_WRITE_COMMAND, 1);  // Set vcomh
-    rv += SSD1306_write(0x20, SSD1306_WRITE_COMMAND, 1);  // 0x20: ~0.77 x Vcc
+    SSD1306_batchCommand(&batch, 0xDB);                   // Set vcomh
+    SSD1306_batchCommand(&batch, 0x20);                   // 0x20: ~0.77 x Vcc
 
     // Set Charge Pump Settings (0x8D)
-    rv += SSD1306_write(0x8D, SSD1306_WRITE_COMMAND, 1);  // Set DC-DC enable
-    rv += SSD1306_write(0x14, SSD1306_WRITE_COMMAND, 1);  // Enable Charge Pump
+    SSD1306_batchCommand(&batch, 0x8D);                   // Set DC-DC enable
+    SSD1306_batchCommand(&batch, 0x14);                   // Enable Charge Pump
 
     // Set Display ON/OFF (AFh/AEh)
-    rv += SSD1306_write(0xAF, SSD1306_WRITE_COMMAND, 1);  // Set Display off
+    SSD1306_batchCommand(&batch, 0xAF);                   // Set Display on
+
+    // Send the whole sequence in a single transaction
+    rv = SSD1306_batchSend(&batch);
 
     // Check return values
     if (rv != 0) {
         return 1;
     }
 
+#ifndef SSD1306_STRIP_ONLY
+#ifdef SSD1306_MEMDMA
+    MEMDMA_init();
+#endif
+
+    for (uint8_t page = 0; page < (SSD1306_HEIGHT / 8); page++) {
+        damageMin[page] = SSD1306_CLEAN_MIN;
+        damageMax[page] = SSD1306_CLEAN_MAX;
+    }
+
     // Clear Screen
     SSD1306_fill(BLACK);
 
     // Flush buffer
     rv += SSD1306_update();
+#else
+    // Clear Screen (every strip starts out black)
+    rv += SSD1306_updateStrips(NULL);
+#endif
     if (rv != 0) {
         return 1;
     }
@@ -141,55 +339,76 @@ uint8_t SSD1306_init(void)
 }
 
 /**
- * @brief               Write data to SSD1306
- *                      Writes data to a particular memory address of the SSD1306
- * @param data          Data to be written
+ * @brief               Start a transfer to the SSD1306
+ *                      Sends the START condition, the slave address and the memory address (control byte)
+ *                      and leaves the bus open for the data bytes
  * @param memAddress    Memory address of the internal register of the SSD1306
  * @param memSize       Size of the memory address
  * @return              0 for success/1 for failure
 */
-uint8_t SSD1306_write(uint8_t data, uint16_t memAddress, uint16_t memSize)
+static uint8_t SSD1306_startTransfer(uint16_t memAddress, uint16_t memSize)
 {
+    uint32_t start = Time_us();
     uint8_t rv = 0;
 
-    I2C_start();
+    // Wait for the transaction queue and DMA to release the bus
+    while (I2C_isBusy()) {
+        if (Time_elapsedUs(start) >= TIMEOUT_US) {
+            return 1;
+        }
+    }
 
-    // Wait for busy
-    while (!(I2C1->SR2 & (1u << 1)));
+    // Claim the bus, the steps below fail if the engine got it first. SB is only set once the
+    // START is on the bus, so BUSY needs no separate wait
+    I2C_start();
 
     // Send Slave Address
-    rv = I2C_writeSlaveAddress(SSD1306_I2C_ADDR, TIMEOUT_MS);
+    rv = I2C_writeSlaveAddress(SSD1306_I2C_ADDR, TIMEOUT_US);
+
+    // Check if memory address is 8 or 16 bit, send the MSB first
+    if ((rv == 0) && (memSize != I2C_MEMADD_SIZE_8BIT)) {
+        rv = I2C_write(I2C_MEM_ADD_MSB(memAddress), TIMEOUT_US);
+    }
+
+    // Send LSB
+    if (rv == 0) {
+        rv = I2C_write(I2C_MEM_ADD_LSB(memAddress), TIMEOUT_US);
+    }
+
     if (rv != 0) {
-        return rv;
+        I2C_stop();
+        return 1;
     }
 
-    // Wait for TXE bit to set;
-    while (!(I2C1->SR1 & (1u << 7)));
+    return 0;
+}
 
-    // Check if memory address is 8 or 16 bit;
-    if (memSize == I2C_MEMADD_SIZE_8BIT) {
-        // Send LSB
-        I2C1->DR = I2C_MEM_ADD_LSB(memAddress);
-    } else {
-        // Send MSB
-        I2C1->DR = I2C_MEM_ADD_MSB(memAddress);
+/**
+ * @brief               Write data to SSD1306
+ *                      Writes data to a particular memory address of the SSD1306
+ * @param data          Data to be written
+ * @param memAddress    Memory address of the internal register of the SSD1306
+ * @param memSize       Size of the memory address
+ * @return              0 for success/1 for failure
+*/
+uint8_t SSD1306_write(uint8_t data, uint16_t memAddress, uint16_t memSize)
+{
+    uint8_t rv = 0;
 
-        // Wait for TXE bit to set;
-        while (!(I2C1->SR1 & (1u << 7)));
-        
-        // Send LSB
-        I2C1->DR = I2C_MEM_ADD_LSB(memAddress);
+    // 8-bit memory addresses go through the transaction queue
+    if (memSize == I2C_MEMADD_SIZE_8BIT) {
+        return I2C_transfer(SSD1306_I2C_ADDR, I2C_MEM_ADD_LSB(memAddress), &data, 1, TIMEOUT_US);
     }
 
-    // Wait for TXE bit to set;
-    while (!(I2C1->SR1 & (1u << 7)));
-
-    // Write data
-    rv = I2C_write(data, TIMEOUT_MS);
+    // Send START, slave address and memory address
+    rv = SSD1306_startTransfer(memAddress, memSize);
     if (rv != 0) {
         return rv;
     }
 
+    // Write data
+    rv = I2C_write(data, TIMEOUT_US);
+
     I2C_stop();
 
     return rv;
@@ -204,280 +423,2567 @@ uint8_t SSD1306_write(uint8_t data, uint16_t memAddress, uint16_t memSize)
  * @param memSize       Size of the memory address
  * @return              0 for success/1 for failure
 */
-uint8_t SSD1306_writeMulti(uint8_t *data, uint8_t size, uint16_t memAddress, uint16_t memSize)
+uint8_t SSD1306_writeMulti(uint8_t *data, uint16_t size, uint16_t memAddress, uint16_t memSize)
 {
     uint8_t rv = 0;
 
-    I2C_start();
-
-    // Wait for busy
-    while (!(I2C1->SR2 & (1u << 1)));
-    
-    // Send Slave Address
-    rv = I2C_writeSlaveAddress(SSD1306_I2C_ADDR, TIMEOUT_MS);
-    if (rv != 0) {
-        return rv;
-    }
-    
-    // Wait for TXE bit to set;
-    while (!(I2C1->SR1 & (1u << 7)));               
-
-    // Check if memory address is 8 or 16 bit;
+    // 8-bit memory addresses go through the transaction queue
     if (memSize == I2C_MEMADD_SIZE_8BIT) {
-        // Send LSB
-        I2C1->DR = I2C_MEM_ADD_LSB(memAddress);
-    } else {
-        // Send MSB
-        I2C1->DR = I2C_MEM_ADD_MSB(memAddress);
-
-        // Wait for TXE bit to set;
-        while (!(I2C1->SR1 & (1u << 7)));
-        
-        // Send LSB
-        I2C1->DR = I2C_MEM_ADD_LSB(memAddress);
+        return I2C_transfer(SSD1306_I2C_ADDR, I2C_MEM_ADD_LSB(memAddress), data, size, TIMEOUT_US);
     }
-    
-    // Wait for TXE bit to set;
-    while (!(I2C1->SR1 & (1u << 7)));
 
-    // Write data
-    rv = I2C_writeMulti(data, size, TIMEOUT_MS);
+    // Send START, slave address and memory address
+    rv = SSD1306_startTransfer(memAddress, memSize);
     if (rv != 0) {
         return rv;
     }
 
+    // Write data
+    rv = I2C_writeMulti(data, size, TIMEOUT_US);
+
     I2C_stop();
 
     return rv;
 }
 
 /**
- * @brief   Updates the SSD1306 by writing the data in the buffer
- *          1. Writes to the page start address
- *          2. Writes to the low column address
- *          3. Writes to the high column address
- *          4. Writes buffer to SSD1306 (Table 9-3: Address increment table)
- * @return  0 for success/1 for failure
+ * @brief               Write a list of commands to SSD1306 in a single transaction
+ *                      All commands follow one control byte with Co = 0 (Table 8-7: Control byte)
+ * @param commands      Commands, including their parameter bytes
+ * @param size          Number of bytes
+ * @return              0 for success/1 for failure
 */
-uint8_t SSD1306_update(void)
+uint8_t SSD1306_writeCommands(const uint8_t *commands, uint16_t size)
 {
-    uint8_t rv = 0;
-
-    for (uint8_t i = 0; i < 8; i++) {
-        // Writes to the page start address
-        rv += SSD1306_write((0xB0 + i), SSD1306_WRITE_COMMAND, 1);
+    return I2C_transfer(SSD1306_I2C_ADDR, SSD1306_WRITE_COMMAND, commands, size, TIMEOUT_US);
+}
 
-        // Writes to the low column address
-        rv += SSD1306_write(0x00, SSD1306_WRITE_COMMAND, 1);
-        
-        // Writes to the high column address
-        rv += SSD1306_write(0x10, SSD1306_WRITE_COMMAND, 1);
+/**
+ * @brief           Start an empty batch
+ * @param batch     Batch to be initialized
+*/
+void SSD1306_batchInit(SSD1306_Batch *batch)
+{
+    batch->len = 0;
+    batch->runStart = 0;
+    batch->overflow = 0;
+}
 
-        // Writes buffer to SSD1306
-        rv += SSD1306_writeMulti(&SSD1306_Buffer[SSD1306_WIDTH * i], SSD1306_WIDTH, SSD1306_WRITE_DATA, 1);
-    }
+/**
+ * @brief           Add a command byte to a batch
+ * @param batch     Batch to add to
+ * @param command   Command or command parameter
+*/
+void SSD1306_batchCommand(SSD1306_Batch *batch, uint8_t command)
+{
+    SSD1306_batchAppend(batch, SSD1306_WRITE_COMMAND, command);
+}
 
-    return rv;
+/**
+ * @brief           Add a GDDRAM data byte to a batch
+ * @param batch     Batch to add to
+ * @param data      Data byte
+*/
+void SSD1306_batchData(SSD1306_Batch *batch, uint8_t data)
+{
+    SSD1306_batchAppend(batch, SSD1306_WRITE_DATA, data);
 }
 
 /**
- * @brief           Fill SSD1306 buffer with on/off (BLACK (0x00)/WHITE (0xFF))
- * @param color     Color to fill screen WHITE/BLACK
+ * @brief           Send a batch as a single transaction
+ * @param batch     Batch to be sent
+ * @return          0 for success/1 for failure (empty or overflowed batch)
 */
-void SSD1306_fill(SSD1306_COLOR color)
+uint8_t SSD1306_batchSend(SSD1306_Batch *batch)
 {
-    for (uint32_t i = 0; i < sizeof(SSD1306_Buffer); i++) {
-        SSD1306_Buffer[i] = (color == BLACK) ? 0x00 : 0xFF;
+    if ((batch->len == 0) || batch->overflow) {
+        return 1;
     }
+
+    // The first control byte goes out as the memory address, the rest as payload
+    return I2C_transfer(SSD1306_I2C_ADDR, batch->buf[0], &batch->buf[1], batch->len - 1, TIMEOUT_US);
 }
 
 /**
- * @brief           Set cursor to x/y positions
- *                  This function also sets the initial x/y positions to be 
- *                  referenced when moving an image
- * @param x         X coordinate to be set
- * @param y         Y coordinate to be set
+ * @brief           Append a byte to a batch
+ *                  The batch is kept encoded: the trailing run of same-type bytes shares one control
+ *                  byte with Co = 0. When the type changes, that run is no longer last, so it is
+ *                  expanded in place to one Co = 1 control byte per byte.
+ * @param batch     Batch to add to
+ * @param control   SSD1306_WRITE_COMMAND/SSD1306_WRITE_DATA
+ * @param value     Byte to add
 */
-void SSD1306_setCursor(uint8_t x, uint8_t y)
+static void SSD1306_batchAppend(SSD1306_Batch *batch, uint8_t control, uint8_t value)
 {
-    SSD1306.xpos = x;
-    SSD1306.ypos = y;
+    // Same type as the trailing run, extend it
+    if (batch->len && (batch->buf[batch->runStart] == control)) {
+        if (batch->len >= SSD1306_BATCH_SIZE) {
+            batch->overflow = 1;
+            return;
+        }
+        batch->buf[batch->len++] = value;
+        return;
+    }
 
-    SSD1306.xpos_init = x;
-    SSD1306.ypos_init = y;
+    // Expand the trailing run to control/byte pairs
+    if (batch->len) {
+        uint16_t count = batch->len - batch->runStart - 1;
+        uint8_t co = batch->buf[batch->runStart] | SSD1306_CONTROL_CO;
+
+        if ((batch->runStart + (2u * count) + 2u) > SSD1306_BATCH_SIZE) {
+            batch->overflow = 1;
+            return;
+        }
+
+        // Work backwards so no byte is overwritten before it is moved
+        for (uint16_t i = count; i-- > 0;) {
+            batch->buf[batch->runStart + (2u * i) + 1u] = batch->buf[batch->runStart + 1u + i];
+            batch->buf[batch->runStart + (2u * i)] = co;
+        }
+        batch->len = batch->runStart + (2u * count);
+    }
+
+    if ((batch->len + 2u) > SSD1306_BATCH_SIZE) {
+        batch->overflow = 1;
+        return;
+    }
+
+    // Start a new run
+    batch->runStart = batch->len;
+    batch->buf[batch->len++] = control;
+    batch->buf[batch->len++] = value;
 }
 
 /**
- * @brief   Moves the current image to the right
- *          Used when an interrupt to move right occurs
+ * @brief           Select how SSD1306_update() transfers the buffer
+ *                  SSD1306_UPDATE_PAGE: page addressing, one data transaction per page (8 per frame)
+ *                  SSD1306_UPDATE_HORIZONTAL: horizontal addressing, the whole buffer in one transaction
+ * @param mode      Update mode
+ * @return          0 for success/1 for failure
 */
-void SSD1306_moveImageRight(void)
+uint8_t SSD1306_setUpdateMode(SSD1306_UPDATE_MODE mode)
 {
-    SSD1306.xpos = SSD1306.xpos_init + IMG_STEP_X;
-    if (SSD1306.xpos >= SSD1306_WIDTH) {
-        SSD1306.xpos = SSD1306_WIDTH - IMG_STEP_X;
+    uint8_t rv = 0;
+
+    // Wait for a queued frame update to finish
+    if (SSD1306_waitIdle() != 0) {
+        return 1;
     }
 
-    SSD1306_fill(BLACK);
-    SSD1306_writeImg(lastImg, WHITE);
-    (void)SSD1306_update();
+    // Set Memory Addressing mode (20h) and reset the window left behind by partial horizontal updates,
+    // the column end address also limits the column pointer in page mode
+    uint8_t commands[8] = {
+        0x20, (uint8_t)((mode == SSD1306_UPDATE_HORIZONTAL) ? 0x00 : 0x10),  // Horizontal/Page Addressing Mode
+        0x21, 0, SSD1306_WIDTH - 1,                                           // Set Column Address
+        0x22, 0, (SSD1306_HEIGHT / 8) - 1,                                    // Set Page Address
+    };
+
+    rv = SSD1306_writeCommands(commands, sizeof(commands));
+    if (rv != 0) {
+        return 1;
+    }
+
+    updateMode = mode;
+    return 0;
 }
 
+#ifndef SSD1306_STRIP_ONLY
 /**
- * @brief   Moves the current image to the left
- *          Used when an interrupt to move left occurs
+ * @brief   Presents the back buffer and updates the SSD1306 by writing the dirty parts of it
+ *          Only the column range of each page touched since the last update is sent:
+ *          1. Writes the address window of the range in one transaction
+ *             Page mode: page start address, low and high column address
+ *             Horizontal mode: Set Column Address (21h) and Set Page Address (22h)
+ *          2. Writes the range of the buffer to SSD1306 (Table 9-3: Address increment table)
+ *          In horizontal mode a fully dirty buffer is sent as one window and one transaction.
+ * @return  0 for success/1 for failure
 */
-void SSD1306_moveImageLeft(void)
+uint8_t SSD1306_update(void)
 {
-    SSD1306.xpos = SSD1306.xpos_init - IMG_STEP_X;
-    if ((SSD1306.xpos <= 0) || (SSD1306.xpos >= SSD1306_WIDTH)){
-        SSD1306.xpos = 0 + IMG_STEP_X;
+    uint8_t rv = 0;
+
+    // The mirror sends the buffer on its own
+    if (SSD1306_mirrorRunning()) {
+        return 0;
     }
 
-    SSD1306_fill(BLACK);
-    SSD1306_writeImg(lastImg, WHITE);
-    (void)SSD1306_update();
+    if (SSD1306_present() != 0) {
+        return 1;
+    }
+    SSD1306_buildSegments();
+
+    for (uint8_t i = 0; i < segmentCount; i++) {
+        rv += SSD1306_writeCommands(segments[i].commands, segments[i].commandLen);
+        rv += SSD1306_writeMulti(segments[i].data, segments[i].size, SSD1306_WRITE_DATA, 1);
+    }
+
+    if (rv != 0) {
+        SSD1306_updateFailed();
+    }
+
+    return rv;
 }
 
 /**
- * @brief           Draw one pixel in the screenbuffer
- * @param x         X coordinate
- * @param y         Y coordinate
- * @param color     Color to fill screen WHITE/BLACK
+ * @brief           Presents the back buffer and updates the SSD1306 without waiting for the bus
+ *                  Same segments as SSD1306_update(), but the transactions are queued on the
+ *                  I2C engine (long data is sent by the DMA) and the next segment is queued from
+ *                  the completion interrupt of the previous one. The function returns at once and
+ *                  the next frame can be drawn while this one is sent.
+ * @param callback  Called from interrupt context when the frame is sent (may be NULL)
+ * @return          0 for success/1 for failure (update already in progress)
 */
-void SSD1306_draw_pixel(uint8_t x, uint8_t y, SSD1306_COLOR color)
+uint8_t SSD1306_updateDMA(SSD1306_Callback callback)
 {
-    
-    // Check if coordinates are outside the buffer
-    if (x >= SSD1306_WIDTH || y >= SSD1306_HEIGHT) {
-        // If coordinates are outside the bounds, don't write to screen
-        return;
+    if (updateBusy) {
+        return 1;
     }
 
-    // Draw in the correct color
-    if (color == WHITE) {
-        SSD1306_Buffer[x + (y / 8) * SSD1306_WIDTH] |= 1 << (y % 8);
+    // The mirror sends the buffer on its own, there is nothing to send
+    if (SSD1306_mirrorRunning()) {
+        segmentCount = 0;
     } else {
-        SSD1306_Buffer[x + (y / 8) * SSD1306_WIDTH] &= ~(1 << (y % 8));
+        if (SSD1306_present() != 0) {
+            return 1;
+        }
+        SSD1306_buildSegments();
+    }
+
+    // Nothing to send
+    if (segmentCount == 0) {
+        if (callback) {
+            callback(0);
+        }
+        return 0;
+    }
+
+    updateBusy = 1;
+    updateStatus = 0;
+    updateSegment = 0;
+    updateCallback = callback;
+
+    if (SSD1306_queueSegment(0) != 0) {
+        updateBusy = 0;
+        return 1;
     }
+
+    return 0;
 }
+#endif // SSD1306_STRIP_ONLY
 
 /**
- * @brief           Draw 1 char to the screen buffer
- * @param ch        Character to write to the screen
- * @param Font      Font struct with font parameters
- * @param color     Color to fill screen WHITE/BLACK
- * @param wrap      Used to check if the text needs to wrap
- * @return          Return char being written
+ * @brief           Updates the SSD1306 with pages rendered on the fly
+ *                  The renderer fills one page at a time into one of two page buffers. Each page is
+ *                  queued on the I2C engine as soon as it is rendered, and the next page is rendered
+ *                  into the other buffer while it is on the bus, so the frame takes about
+ *                  max(render, transfer) instead of render + transfer. The screenbuffers are not used.
+ *                  Every page carries its own address window, so the update survives transactions
+ *                  queued in between (e.g. by an EXTI handler).
+ *                  The panel no longer shows the screenbuffer afterwards, the next SSD1306_update()
+ *                  sends it whole.
+ * @param render    Called in the calling context to render a page (0-7) into a SSD1306_WIDTH byte buffer
+ * @return          0 for success/1 for failure (also while the panel is scrolling)
 */
-char SSD1306_write_char(char ch, FontDef Font, SSD1306_COLOR color, uint8_t wrap)
+uint8_t SSD1306_updatePipelined(SSD1306_PageRenderer render)
 {
-    uint16_t pixel;
+    uint8_t rv = 0;
+    uint8_t page;
 
-    // Check remaining space on current line
-    if ((SSD1306_WIDTH <= (SSD1306.xpos + Font.FontWidth)) ||
-        (SSD1306_HEIGHT <= (SSD1306.ypos + Font.FontHeight))) {
-        if (wrap) {
-            if (SSD1306_WIDTH <= (SSD1306.xpos + Font.FontWidth)) {
-                // Return to initial position shifted by font height
-                SSD1306.xpos = SSD1306.xpos_init;
-                SSD1306.ypos = (SSD1306.ypos_init + Font.FontHeight) * SSD1306.wrap_counter;
-                SSD1306.wrap_counter++;
-            } else if (SSD1306_HEIGHT <= (SSD1306.ypos + Font.FontHeight)) {
-                return 1;
-            }
+    // Every page is written, stop the scroll first
+    if (scrollPages) {
+        return 1;
+    }
+#ifndef SSD1306_STRIP_ONLY
+    // The mirror would overwrite the pages, stop it first
+    if (SSD1306_mirrorRunning()) {
+        return 1;
+    }
+#endif
+
+    // Wait for a queued frame update to finish
+    if (SSD1306_waitIdle() != 0) {
+        return 1;
+    }
+
+    pipeDone = 0;
+    pipeStatus = 0;
+
+    render(0, pipeBuffer[0]);
+
+    for (page = 0; page < (SSD1306_HEIGHT / 8); page++) {
+        uint8_t *commands = pipeCommands[page & 1u];
+        uint8_t commandLen;
+
+        if (updateMode == SSD1306_UPDATE_HORIZONTAL) {
+            commands[0] = 0x21;                 // Set Column Address
+            commands[1] = 0;
+            commands[2] = SSD1306_WIDTH - 1;
+            commands[3] = 0x22;                 // Set Page Address
+            commands[4] = page;
+            commands[5] = page;
+            commandLen = 6;
         } else {
-            // Not enough space on current line
-            return 1;
+            commands[0] = 0xB0 + page;          // Set page start address
+            commands[1] = 0x00;                 // Set low column address
+            commands[2] = 0x10;                 // Set high column address
+            commandLen = 3;
         }
-    }
 
-    // Translate font to screenbuffer
-    for (uint16_t i = 0; i < Font.FontHeight; i++) {
-        pixel = Font.data[((ch - 32) * Font.FontHeight) + i];
-        for (uint16_t j = 0; j < Font.FontWidth; j++) {
-            if ((pixel << j) & 0x8000) {
-                SSD1306_draw_pixel((SSD1306.xpos + j), (SSD1306.ypos + i), (SSD1306_COLOR)color);
-            } else {
-                SSD1306_draw_pixel((SSD1306.xpos + j), (SSD1306.ypos + i), (SSD1306_COLOR)!color);
+        rv += I2C_queueWrite(SSD1306_I2C_ADDR, SSD1306_WRITE_COMMAND, commands, commandLen, SSD1306_pipeComplete);
+        rv += I2C_queueWrite(SSD1306_I2C_ADDR, SSD1306_WRITE_DATA, pipeBuffer[page & 1u], SSD1306_WIDTH, SSD1306_pipePageComplete);
+        if (rv != 0) {
+            // Let the pages already queued drain before giving up
+            (void)SSD1306_pipeWait(page);
+            break;
+        }
+
+        // Render the next page into the other buffer once the page that used it has been sent
+        if ((page + 1u) < (SSD1306_HEIGHT / 8)) {
+            rv += SSD1306_pipeWait(page);
+            if (rv != 0) {
+                break;
             }
+            render(page + 1u, pipeBuffer[(page + 1u) & 1u]);
         }
     }
 
-    // The current space is now taken
-    SSD1306.xpos += Font.FontWidth;
+    if (rv == 0) {
+        rv += SSD1306_pipeWait(SSD1306_HEIGHT / 8);
+    }
 
-    // Return written char for validation
-    return ch;
+#ifndef SSD1306_STRIP_ONLY
+    // The panel no longer matches the screenbuffer
+    SSD1306_updateFailed();
+#endif
+
+    return ((rv != 0) || (pipeStatus != 0)) ? 1 : 0;
 }
 
 /**
- * @brief           Write full string to screenbuffer
- * @param str       String to write to the screen
- * @param Font      Font struct with font parameters
- * @param color     Color to fill screen WHITE/BLACK
- * @param wrap      Used to check if the text needs to wrap
- * @return          Return char being written
+ * @brief           Wait until a number of pipelined pages are finished
+ *                  The timeout restarts whenever a page finishes
+ * @param pages     Number of pages
+ * @return          0 for success/1 for failure (bus stuck, everything queued is aborted)
 */
-char SSD1306_writeString(const char* str, FontDef Font, SSD1306_COLOR color, uint8_t wrap)
+static uint8_t SSD1306_pipeWait(uint8_t pages)
 {
-    // Store initial cursor position
-    SSD1306.xpos_init = SSD1306.xpos;
-    SSD1306.ypos_init = SSD1306.ypos;
-    SSD1306.wrap_counter = 1;
+    uint32_t start = Time_us();
+    uint8_t done = pipeDone;
 
-    // Write until null-byte
-    while (*str) {
-        if (!(SSD1306_write_char(*str, Font, color, wrap) != *str)) {
-            // Char could not be written
-            return *str;
+    while (pipeDone < pages) {
+        if (done != pipeDone) {
+            done = pipeDone;
+            start = Time_us();
+        }
+        if (Time_elapsedUs(start) >= TIMEOUT_US) {
+            I2C_abort();
+            return 1;
         }
-
-        // Next char
-        str++;
     }
 
-    return *str;
+    return 0;
 }
 
 /**
- * @brief           Write image to screenbuffer
- *                  Each image section is 16-bits wide
- * @param Img       Image struct with image parameters
- * @param color     Color to fill screen WHITE/BLACK
+ * @brief           Completion callback for the window commands of a pipelined page
+ * @param status    0 for success/1 for failure
 */
-void SSD1306_writeImg(ImgDef Img, SSD1306_COLOR color)
+static void SSD1306_pipeComplete(uint8_t status)
 {
-    uint32_t pixel;
+    pipeStatus |= status;
+}
 
-    // Store initial cursor position
-    SSD1306.xpos_init = SSD1306.xpos;
-    SSD1306.ypos_init = SSD1306.ypos;
-    
-    lastImg = Img;
+/**
+ * @brief           Completion callback for the data of a pipelined page, frees its page buffer
+ * @param status    0 for success/1 for failure
+*/
+static void SSD1306_pipePageComplete(uint8_t status)
+{
+    pipeStatus |= status;
+    pipeDone++;
+}
 
-    // Check remaining space on current line
-    if ((SSD1306_WIDTH <= (SSD1306.xpos + Img.imgWidth)) ||
-        (SSD1306_HEIGHT <= (SSD1306.ypos + Img.imgHeight))) {
-        // Not enough space on current line
-        return;
+/**
+ * @brief           Updates the SSD1306 by rendering the frame one page (strip) at a time
+ *                  The draw callback is replayed once per page with drawing redirected to a
+ *                  128-byte strip that starts out black. Only the rows of the primitives that fall
+ *                  in the page are rendered. Every replay starts from the cursor state at the time
+ *                  of the call. The strips are sent with SSD1306_updatePipelined(), so the next
+ *                  strip is rendered while the previous one is on the bus.
+ *                  The output equals SSD1306_fill(BLACK), draw() and SSD1306_update() with the
+ *                  screenbuffer, which is not touched.
+ * @param draw      Draws the whole frame with the usual drawing functions (NULL for a black frame)
+ * @return          0 for success/1 for failure
+*/
+uint8_t SSD1306_updateStrips(SSD1306_DrawCallback draw)
+{
+    uint8_t rv = 0;
+
+    stripDraw = draw;
+    stripCursor = SSD1306;
+
+    rv = SSD1306_updatePipelined(SSD1306_renderStrip);
+
+    stripBuffer = NULL;
+    return rv;
+}
+
+/**
+ * @brief           Page renderer of SSD1306_updateStrips(), replays the draw callback into a strip
+ * @param page      Page (0-7)
+ * @param buffer    Strip of SSD1306_WIDTH bytes
+*/
+static void SSD1306_renderStrip(uint8_t page, uint8_t *buffer)
+{
+    for (uint8_t i = 0; i < SSD1306_WIDTH; i++) {
+        buffer[i] = 0x00;
     }
-    
-    // Write each inidividual section of image
-    for (uint8_t imgSection = 0; imgSection < Img.imgSections; imgSection++) {
-        // Translate font to screenbuffer
-        for (uint32_t i = 0; i < Img.imgHeight; i++) {
-            pixel = Img.data[i + (imgSection * Img.imgHeight)];
-            for (uint32_t j = 0; j < Img.imgWidth; j++) {
-                if ((pixel << j) & 0x8000) {
-                    SSD1306_draw_pixel((SSD1306.xpos + j), (SSD1306.ypos + i), (SSD1306_COLOR)color);
-                } else {
-                    SSD1306_draw_pixel((SSD1306.xpos + j), (SSD1306.ypos + i), (SSD1306_COLOR)!color);
+
+    stripBuffer = buffer;
+    stripPage = page;
+    SSD1306 = stripCursor;
+
+    if (stripDraw) {
+        stripDraw();
+    }
+}
+
+/**
+ * @brief   Check if a queued frame update is in progress
+ * @return  1 if busy/0 if idle
+*/
+uint8_t SSD1306_isBusy(void)
+{
+    return updateBusy;
+}
+
+/**
+ * @brief   Wait for a queued frame update to finish
+ * @return  0 for success/1 for failure (bus stuck, everything queued is aborted)
+*/
+static uint8_t SSD1306_waitIdle(void)
+{
+    uint32_t start = Time_us();
+
+    while (SSD1306_isBusy()) {
+        if (Time_elapsedUs(start) >= UPDATE_TIMEOUT_US) {
+            // Fails the queued segments, their completion ends the update
+            I2C_abort();
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief                   Start a continuous hardware scroll of a range of pages (10.3: Graphic Acceleration Command)
+ *                          The panel rotates its own GDDRAM one column every interval, so a marquee or a pan
+ *                          costs a few command bytes instead of resending the pages. Columns leaving one side
+ *                          come back on the other.
+ *                          1. Deactivate scroll (2Eh), the parameters may only change while it is stopped
+ *                          2. Horizontal scroll (26h/27h), or with a vertical offset, Set Vertical Scroll
+ *                             Area (A3h) to the whole screen and vertical and horizontal scroll (29h/2Ah)
+ *                          3. Activate scroll (2Fh)
+ *                          The screenbuffer keeps the unscrolled contents. Updates hold back the dirty ranges
+ *                          of the scrolling pages (all pages with a vertical offset) until SSD1306_scrollStop(),
+ *                          the other pages are updated as usual. Send the pages with SSD1306_update() first,
+ *                          the scroll moves what the panel shows. Starting again adds to the scrolling pages.
+ * @param dir               Scroll direction
+ * @param startPage         First page (0-7)
+ * @param endPage           Last page (startPage-7)
+ * @param interval          Frames between two steps
+ * @param verticalOffset    Rows moved up per step (0-63), 0 for a horizontal scroll only
+ * @return                  0 for success/1 for failure
+*/
+uint8_t SSD1306_scrollStart(SSD1306_SCROLL_DIR dir, uint8_t startPage, uint8_t endPage, SSD1306_SCROLL_INTERVAL interval, uint8_t verticalOffset)
+{
+    uint8_t rv = 0;
+    uint8_t commands[13];
+    uint8_t len = 0;
+
+    if ((endPage >= (SSD1306_HEIGHT / 8)) || (startPage > endPage) || (verticalOffset >= SSD1306_HEIGHT)) {
+        return 1;
+    }
+#ifndef SSD1306_STRIP_ONLY
+    // The mirror rewrites the GDDRAM the scroll rotates
+    if (SSD1306_mirrorRunning()) {
+        return 1;
+    }
+#endif
+
+    // Wait for a queued frame update to finish
+    if (SSD1306_waitIdle() != 0) {
+        return 1;
+    }
+
+    commands[len++] = 0x2E;                                             // Deactivate scroll
+    if (verticalOffset == 0) {
+        commands[len++] = (dir == SSD1306_SCROLL_LEFT) ? 0x27 : 0x26;   // Left/Right Horizontal Scroll
+        commands[len++] = 0x00;                                         // Dummy byte
+        commands[len++] = startPage;                                    // Start page address
+        commands[len++] = (uint8_t)interval;                            // Time interval between steps
+        commands[len++] = endPage;                                      // End page address
+        commands[len++] = 0x00;                                         // Dummy byte
+        commands[len++] = 0xFF;                                         // Dummy byte
+    } else {
+        commands[len++] = 0xA3;                                         // Set Vertical Scroll Area
+        commands[len++] = 0;                                            // No fixed rows on top
+        commands[len++] = SSD1306_HEIGHT;                               // All rows scroll
+        commands[len++] = (dir == SSD1306_SCROLL_LEFT) ? 0x2A : 0x29;   // Vertical and Left/Right Horizontal Scroll
+        commands[len++] = 0x00;                                         // Dummy byte
+        commands[len++] = startPage;                                    // Start page address
+        commands[len++] = (uint8_t)interval;                            // Time interval between steps
+        commands[len++] = endPage;                                      // End page address
+        commands[len++] = verticalOffset;                               // Vertical scrolling offset
+    }
+    commands[len++] = 0x2F;                                             // Activate scroll
+
+    rv = SSD1306_writeCommands(commands, len);
+    if (rv != 0) {
+        // The scroll state of the panel is unknown, SSD1306_scrollStop() brings it back
+        scrollPages = 0xFFu;
+        scrollVertical = 1;
+        return 1;
+    }
+
+    if (verticalOffset != 0) {
+        scrollPages = 0xFFu;
+        scrollVertical = 1;
+    } else {
+        scrollPages |= (uint8_t)((0xFFu >> (7u - endPage)) & (0xFFu << startPage));
+    }
+
+    return 0;
+}
+
+/**
+ * @brief   Stop the hardware scroll (2Eh) and bring the panel back in line with the screenbuffer
+ *          The GDDRAM of the scrolled pages is left rotated by an unknown number of steps, so it must
+ *          be rewritten (10.3.3: Deactivate scroll). The scrolled pages are marked dirty over their whole
+ *          width and the shadow/CRCs are dropped, the next update resends them with everything that was
+ *          held back. A vertical scroll also restores the display start line.
+ * @return  0 for success/1 for failure (still scrolling)
+*/
+uint8_t SSD1306_scrollStop(void)
+{
+    uint8_t rv = 0;
+    uint8_t commands[2] = {
+        0x2E,                                   // Deactivate scroll
+        0x40,                                   // Set Display Start Line
+    };
+
+    // Wait for a queued frame update to finish
+    if (SSD1306_waitIdle() != 0) {
+        return 1;
+    }
+
+#ifndef SSD1306_STRIP_ONLY
+    commands[1] |= startLine;
+#endif
+    rv = SSD1306_writeCommands(commands, scrollVertical ? 2u : 1u);
+    if (rv != 0) {
+        return 1;
+    }
+
+#ifndef SSD1306_STRIP_ONLY
+    for (uint8_t page = 0; page < (SSD1306_HEIGHT / 8); page++) {
+        if (scrollPages & (1u << page)) {
+            SSD1306_markDirty(0, page * 8, SSD1306_WIDTH - 1, (page * 8) + 7);
+        }
+    }
+    if (scrollPages) {
+        diffValid = 0;
+    }
+#endif
+
+    scrollPages = 0;
+    scrollVertical = 0;
+
+    return 0;
+}
+
+#ifndef SSD1306_STRIP_ONLY
+
+/**
+ * @brief   Mark the whole buffer dirty so the next update resends everything
+*/
+void SSD1306_invalidate(void)
+{
+    SSD1306_markDirty(0, 0, SSD1306_WIDTH - 1, SSD1306_HEIGHT - 1);
+}
+
+/**
+ * @brief           Select how the dirty ranges are checked for changes before they are sent
+ *                  SSD1306_DIFF_NONE: send the dirty ranges as they are
+ *                  SSD1306_DIFF_SHADOW: compare word by word against a 1 KB copy of what the panel
+ *                  holds and send only the changed column runs. Runs closer than SSD1306_DIFF_GAP
+ *                  bytes are merged to save the window commands.
+ *                  SSD1306_DIFF_CRC: keep a CRC per SSD1306_CRC_BLOCK columns of each page (256 bytes)
+ *                  computed by the CRC unit and send only the blocks whose CRC changed
+ *                  Redrawing identical content then costs no bus traffic at all.
+ *                  The next update resends the whole buffer to fill the shadow/CRCs.
+ * @param mode      Change detection mode
+ * @return          0 for success/1 for failure (shadow not built in)
+*/
+uint8_t SSD1306_setDiffMode(SSD1306_DIFF_MODE mode)
+{
+#ifdef SSD1306_NO_SHADOW
+    if (mode == SSD1306_DIFF_SHADOW) {
+        return 1;
+    }
+#endif
+
+    // Wait for a queued frame update to finish
+    if (SSD1306_waitIdle() != 0) {
+        return 1;
+    }
+
+    if (mode == SSD1306_DIFF_CRC) {
+        CRC_init();
+    }
+
+    diffMode = mode;
+    diffValid = 0;
+    SSD1306_invalidate();
+
+    return 0;
+}
+
+/**
+ * @brief   Start mirroring the screenbuffer to the panel
+ *          In horizontal addressing mode the column and page pointers wrap around at the end of the
+ *          window (10.1.3: Set Memory Addressing Mode), so a single data transaction that never ends
+ *          keeps rewriting the whole GDDRAM. The back buffer is sent that way by a circular DMA
+ *          (I2C_streamStart()): whatever is drawn shows up within two frames (about 50 ms at 400 kHz)
+ *          without any update call, SSD1306_update()/SSD1306_updateDMA() do nothing meanwhile.
+ *          The bus is not blocked for good: commands and other transactions are sent between two
+ *          frames, and the stream comes back behind them with the window set up again.
+ *          The hardware scroll and the pipelined/strip updates can not be used while mirroring.
+ * @return  0 for success/1 for failure
+*/
+uint8_t SSD1306_mirrorStart(void)
+{
+    uint8_t rv = 0;
+
+    if (SSD1306_mirrorRunning()) {
+        return 0;
+    }
+    if (scrollPages) {
+        return 1;
+    }
+
+    // Wait for a queued frame update to finish, the back buffer must be complete
+    if (SSD1306_waitIdle() != 0) {
+        return 1;
+    }
+    SSD1306_memWait();
+
+    // Horizontal addressing over the whole screen, from the first byte of the buffer
+    mirrorSetup[0] = 0x20;                  // Set Memory Addressing Mode
+    mirrorSetup[1] = 0x00;                  // Horizontal Addressing Mode
+    mirrorSetup[2] = 0x21;                  // Set Column Address
+    mirrorSetup[3] = 0;
+    mirrorSetup[4] = SSD1306_WIDTH - 1;
+    mirrorSetup[5] = 0x22;                  // Set Page Address
+    mirrorSetup[6] = 0;
+    mirrorSetup[7] = (SSD1306_HEIGHT / 8) - 1;
+    mirrorSetup[8] = 0x40 | startLine;      // Set Display Start Line
+
+    rv = I2C_streamStart(SSD1306_I2C_ADDR, SSD1306_WRITE_COMMAND, mirrorSetup, sizeof(mirrorSetup),
+                         SSD1306_WRITE_DATA, backBuffer, SSD1306_BUFFER_SIZE);
+    if (rv != 0) {
+        return 1;
+    }
+
+    mirrorActive = 1;
+    return 0;
+}
+
+/**
+ * @brief   Stop mirroring at the end of the frame being sent
+ *          The addressing mode of SSD1306_setUpdateMode() is restored. Bytes drawn while the last
+ *          frame was sent may have been missed, so the next update sends the whole buffer.
+ * @return  0 for success/1 for failure
+*/
+uint8_t SSD1306_mirrorStop(void)
+{
+    uint8_t rv = 0;
+
+    if (!mirrorActive) {
+        return 0;
+    }
+
+    rv += I2C_streamStop(TIMEOUT_US);
+    mirrorActive = 0;
+
+    rv += SSD1306_setUpdateMode(updateMode);
+    SSD1306_updateFailed();
+
+    return (rv != 0) ? 1 : 0;
+}
+
+/**
+ * @brief   Check if the mirror is running
+ *          A mirror ended by a bus error falls back to normal updates, starting with the whole buffer
+ * @return  1 if mirroring/0 if not
+*/
+static uint8_t SSD1306_mirrorRunning(void)
+{
+    if (mirrorActive && !I2C_isStreaming()) {
+        mirrorActive = 0;
+        (void)SSD1306_setUpdateMode(updateMode);
+        SSD1306_updateFailed();
+    }
+
+    return mirrorActive;
+}
+
+/**
+ * @brief   Resend everything after a failed update, the panel contents are unknown
+*/
+static void SSD1306_updateFailed(void)
+{
+    diffValid = 0;
+    startLinePending = 1;
+    SSD1306_invalidate();
+}
+
+/**
+ * @brief   Swap the front and back buffer
+ *          Runs with interrupts disabled, so a frame drawn from an EXTI handler is never split
+ *          between two buffers. The dirty ranges move to the front buffer with the frame and are
+ *          copied back into the new back buffer, which then holds the presented frame again.
+ *          Drawing continues on top of it while the front buffer is sent.
+ * @return  0 for success/1 for failure (the previous update did not finish, nothing is swapped)
+*/
+static uint8_t SSD1306_present(void)
+{
+    uint8_t *buffer;
+
+    // The front buffer is read until its transfer has finished, the back buffer must be complete
+    if (SSD1306_waitIdle() != 0) {
+        return 1;
+    }
+    SSD1306_memWait();
+
+#ifdef SSD1306_MEMDMA
+    uint16_t first = SSD1306_BUFFER_SIZE / 4;
+    uint16_t last = 0;
+#endif
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    buffer = frontBuffer;
+    frontBuffer = backBuffer;
+    backBuffer = buffer;
+
+    for (uint8_t page = 0; page < (SSD1306_HEIGHT / 8); page++) {
+        uint8_t start = dirtyMin[page];
+        uint8_t end = dirtyMax[page];
+
+        // Scrolling pages keep their range until SSD1306_scrollStop(), writes would land at a moving column
+        if (scrollPages & (1u << page)) {
+            frameMin[page] = SSD1306_CLEAN_MIN;
+            frameMax[page] = SSD1306_CLEAN_MAX;
+        } else {
+            frameMin[page] = start;
+            frameMax[page] = end;
+            dirtyMin[page] = SSD1306_CLEAN_MIN;
+            dirtyMax[page] = SSD1306_CLEAN_MAX;
+        }
+
+        if (start > end) {
+            continue;
+        }
+
+#ifdef SSD1306_MEMDMA
+        // Collect one word range for a single transfer, the clean bytes in between are equal anyway
+        if (first > (((SSD1306_WIDTH * page) + start) / 4)) {
+            first = ((SSD1306_WIDTH * page) + start) / 4;
+        }
+        last = ((SSD1306_WIDTH * page) + end) / 4;
+#else
+        // Bring the back buffer up to date a word at a time, the buffers only differ inside the range
+        const uint32_t *src = (const uint32_t *)&frontBuffer[SSD1306_WIDTH * page];
+        uint32_t *dst = (uint32_t *)&backBuffer[SSD1306_WIDTH * page];
+
+        for (uint8_t w = start / 4; w <= (end / 4); w++) {
+            dst[w] = src[w];
+        }
+#endif
+    }
+
+#ifdef SSD1306_MEMDMA
+    // Bring the back buffer up to date with DMA2 while the segments are built and sent
+    if (first <= last) {
+        const uint32_t *src = (const uint32_t *)frontBuffer;
+        uint32_t *dst = (uint32_t *)backBuffer;
+
+        if (MEMDMA_copy(&dst[first], &src[first], (uint16_t)(last - first + 1)) != 0) {
+            for (uint16_t w = first; w <= last; w++) {
+                dst[w] = src[w];
+            }
+        }
+    }
+#endif
+
+    __set_PRIMASK(primask);
+
+    return 0;
+}
+
+/**
+ * @brief   Turn the dirty ranges of the front buffer into transfer segments
+*/
+static void SSD1306_buildSegments(void)
+{
+    uint8_t page;
+    uint8_t full = 1;
+
+    segmentCount = 0;
+
+    for (page = 0; page < (SSD1306_HEIGHT / 8); page++) {
+        if ((frameMin[page] != 0) || (frameMax[page] != (SSD1306_WIDTH - 1))) {
+            full = 0;
+        }
+    }
+
+    // Whole buffer in one window
+    if (full && (updateMode == SSD1306_UPDATE_HORIZONTAL) && ((diffMode == SSD1306_DIFF_NONE) || !diffValid)) {
+        SSD1306_Segment *seg = &segments[segmentCount++];
+
+        seg->commands[0] = 0x21;                        // Set Column Address
+        seg->commands[1] = 0;
+        seg->commands[2] = SSD1306_WIDTH - 1;
+        seg->commands[3] = 0x22;                        // Set Page Address
+        seg->commands[4] = 0;
+        seg->commands[5] = (SSD1306_HEIGHT / 8) - 1;
+        seg->commandLen = 6;
+        seg->data = frontBuffer;
+        seg->size = SSD1306_BUFFER_SIZE;
+    } else {
+        for (page = 0; page < (SSD1306_HEIGHT / 8); page++) {
+            uint8_t start = frameMin[page];
+            uint8_t end = frameMax[page];
+
+            if (start > end) {
+                continue;
+            }
+
+            if (diffValid && (diffMode == SSD1306_DIFF_SHADOW)) {
+                SSD1306_diffPage(page, start, end);
+            } else if (diffValid && (diffMode == SSD1306_DIFF_CRC)) {
+                SSD1306_crcPage(page, start, end);
+            } else {
+                SSD1306_addSegment(page, start, end);
+            }
+        }
+    }
+
+    // A new display start line leads the first window, so it takes effect with the page it brings in
+    if (startLinePending) {
+        if (segmentCount == 0) {
+            SSD1306_addSegment(startLine / 8, 0, 0);
+        }
+
+        SSD1306_Segment *seg = &segments[0];
+
+        for (uint8_t i = seg->commandLen; i > 0; i--) {
+            seg->commands[i] = seg->commands[i - 1];
+        }
+        seg->commands[0] = 0x40 | startLine;    // Set Display Start Line
+        seg->commandLen++;
+        startLinePending = 0;
+    }
+
+    // The panel will hold what is sent now
+    if (diffMode == SSD1306_DIFF_CRC) {
+        if (!diffValid) {
+            for (page = 0; page < (SSD1306_HEIGHT / 8); page++) {
+                for (uint8_t block = 0; block < (SSD1306_WIDTH / SSD1306_CRC_BLOCK); block++) {
+                    uint32_t offset = (SSD1306_WIDTH * page) + (SSD1306_CRC_BLOCK * block);
+
+                    blockCrc[page][block] = CRC_calc((const uint32_t *)&frontBuffer[offset], SSD1306_CRC_BLOCK / 4);
+                }
+            }
+        }
+        diffValid = 1;
+    }
+#ifndef SSD1306_NO_SHADOW
+    if (diffMode == SSD1306_DIFF_SHADOW) {
+        for (uint8_t i = 0; i < segmentCount; i++) {
+            uint16_t offset = (uint16_t)(segments[i].data - frontBuffer);
+
+            for (uint16_t j = 0; j < segments[i].size; j++) {
+                SSD1306_Shadow[offset + j] = frontBuffer[offset + j];
+            }
+        }
+        diffValid = 1;
+    }
+#endif
+}
+
+/**
+ * @brief           Add a segment for a column range of one page
+ * @param page      Page (0-7)
+ * @param start     First column
+ * @param end       Last column
+*/
+static void SSD1306_addSegment(uint8_t page, uint8_t start, uint8_t end)
+{
+    SSD1306_Segment *seg = &segments[segmentCount++];
+
+    if (updateMode == SSD1306_UPDATE_HORIZONTAL) {
+        seg->commands[0] = 0x21;                // Set Column Address
+        seg->commands[1] = start;
+        seg->commands[2] = end;
+        seg->commands[3] = 0x22;                // Set Page Address
+        seg->commands[4] = page;
+        seg->commands[5] = page;
+        seg->commandLen = 6;
+    } else {
+        seg->commands[0] = 0xB0 + page;         // Set page start address
+        seg->commands[1] = start & 0x0F;        // Set low column address
+        seg->commands[2] = 0x10 | (start >> 4); // Set high column address
+        seg->commandLen = 3;
+    }
+    seg->data = &frontBuffer[(SSD1306_WIDTH * page) + start];
+    seg->size = (uint16_t)(end - start) + 1u;
+}
+
+/**
+ * @brief           Add segments for the bytes of a dirty range that differ from the shadow
+ *                  Bytes outside the dirty range always match the shadow, so the range is
+ *                  widened to whole words and compared a word at a time.
+ * @param page      Page (0-7)
+ * @param start     First dirty column
+ * @param end       Last dirty column
+*/
+static void SSD1306_diffPage(uint8_t page, uint8_t start, uint8_t end)
+{
+#ifndef SSD1306_NO_SHADOW
+    const uint32_t *cur = (const uint32_t *)&frontBuffer[SSD1306_WIDTH * page];
+    const uint32_t *old = (const uint32_t *)&SSD1306_Shadow[SSD1306_WIDTH * page];
+    uint8_t runStart = 0;
+    uint8_t runEnd = 0;
+    uint8_t runCount = 0;
+
+    for (uint8_t w = start / 4; w <= (end / 4); w++) {
+        uint32_t diff = cur[w] ^ old[w];
+        uint8_t first;
+        uint8_t last;
+
+        if (diff == 0) {
+            continue;
+        }
+
+        // First and last changed byte of the word (little endian, column 4*w in bits 0-7)
+        first = w * 4;
+        while (!(diff & 0xFFu)) {
+            diff >>= 8;
+            first++;
+        }
+        last = first;
+        while (diff > 0xFFu) {
+            diff >>= 8;
+            last++;
+        }
+
+        // Merge into the current run if the gap is small or no more runs are allowed
+        if ((runCount > 0) && (((uint8_t)(first - runEnd - 1) <= SSD1306_DIFF_GAP) || (runCount == SSD1306_DIFF_RUNS))) {
+            runEnd = last;
+            continue;
+        }
+
+        if (runCount > 0) {
+            SSD1306_addSegment(page, runStart, runEnd);
+        }
+        runStart = first;
+        runEnd = last;
+        runCount++;
+    }
+
+    if (runCount > 0) {
+        SSD1306_addSegment(page, runStart, runEnd);
+    }
+#else
+    (void)page;
+    (void)start;
+    (void)end;
+#endif
+}
+
+/**
+ * @brief           Add segments for the blocks of a dirty range whose CRC changed
+ *                  Neighbouring changed blocks are sent as one segment, trimmed to the dirty range.
+ *                  The stored CRCs are updated to the new contents.
+ * @param page      Page (0-7)
+ * @param start     First dirty column
+ * @param end       Last dirty column
+*/
+static void SSD1306_crcPage(uint8_t page, uint8_t start, uint8_t end)
+{
+    uint8_t runStart = 0;
+    uint8_t runEnd = 0;
+    uint8_t inRun = 0;
+
+    for (uint8_t block = start / SSD1306_CRC_BLOCK; block <= (end / SSD1306_CRC_BLOCK); block++) {
+        uint8_t first = block * SSD1306_CRC_BLOCK;
+        uint8_t last = first + (SSD1306_CRC_BLOCK - 1);
+        uint32_t crc = CRC_calc((const uint32_t *)&frontBuffer[(SSD1306_WIDTH * page) + first], SSD1306_CRC_BLOCK / 4);
+
+        if (crc == blockCrc[page][block]) {
+            // Unchanged block ends the current run
+            if (inRun) {
+                SSD1306_addSegment(page, runStart, runEnd);
+                inRun = 0;
+            }
+            continue;
+        }
+        blockCrc[page][block] = crc;
+
+        if (!inRun) {
+            runStart = (first < start) ? start : first;
+            inRun = 1;
+        }
+        runEnd = (last > end) ? end : last;
+    }
+
+    if (inRun) {
+        SSD1306_addSegment(page, runStart, runEnd);
+    }
+}
+
+/**
+ * @brief           Queue the window commands and the data of one segment
+ * @param index     Segment to be sent
+ * @return          0 for success/1 for failure (queue full)
+*/
+static uint8_t SSD1306_queueSegment(uint8_t index)
+{
+    uint8_t rv = 0;
+    SSD1306_Segment *seg = &segments[index];
+
+    rv += I2C_queueWrite(SSD1306_I2C_ADDR, SSD1306_WRITE_COMMAND, seg->commands, seg->commandLen, SSD1306_commandComplete);
+    rv += I2C_queueWrite(SSD1306_I2C_ADDR, SSD1306_WRITE_DATA, seg->data, seg->size, SSD1306_segmentComplete);
+
+    return (rv != 0) ? 1 : 0;
+}
+
+/**
+ * @brief           Completion callback for the queued window commands
+ * @param status    0 for success/1 for failure
+*/
+static void SSD1306_commandComplete(uint8_t status)
+{
+    updateStatus |= status;
+}
+
+/**
+ * @brief           Completion callback for the segment data, queues the next segment
+ * @param status    0 for success/1 for failure of the finished segment
+*/
+static void SSD1306_segmentComplete(uint8_t status)
+{
+    updateStatus |= status;
+    updateSegment++;
+
+    if ((updateSegment < segmentCount) && (updateStatus == 0)) {
+        updateStatus |= SSD1306_queueSegment(updateSegment);
+        if (updateStatus == 0) {
+            return;
+        }
+    }
+
+    if (updateStatus != 0) {
+        SSD1306_updateFailed();
+    }
+
+    // Frame finished (or aborted on error)
+    SSD1306_Callback callback = updateCallback;
+    updateBusy = 0;
+    if (callback) {
+        callback(updateStatus);
+    }
+}
+#endif // SSD1306_STRIP_ONLY
+
+/**
+ * @brief           Fill SSD1306 buffer with on/off (BLACK (0x00)/WHITE (0xFF))
+ * @param color     Color to fill screen WHITE/BLACK
+*/
+void SSD1306_fill(SSD1306_COLOR color)
+{
+    uint8_t value = (color == BLACK) ? 0x00 : 0xFF;
+
+    // Strip rendering fills the strip only
+    if (stripBuffer) {
+        SSD1306_fillBytes(stripBuffer, value, SSD1306_WIDTH);
+        return;
+    }
+
+#ifndef SSD1306_STRIP_ONLY
+#ifdef SSD1306_MEMDMA
+    // Queued behind earlier transfers to the back buffer, done here if the queue is full
+    if (MEMDMA_fill((uint32_t *)backBuffer, value * 0x01010101u, SSD1306_BUFFER_SIZE / 4) != 0) {
+        SSD1306_memWait();
+        SSD1306_fillBytes(backBuffer, value, SSD1306_BUFFER_SIZE);
+    }
+#else
+    SSD1306_fillBytes(backBuffer, value, SSD1306_BUFFER_SIZE);
+#endif
+
+    SSD1306_markDirty(0, 0, SSD1306_WIDTH - 1, SSD1306_HEIGHT - 1);
+#endif
+}
+
+/**
+ * @brief           Fill a rectangle of the buffer with on/off
+ *                  Works a page at a time: the top and bottom pages are merged under a row mask,
+ *                  the pages in between are filled with whole bytes (words where aligned).
+ * @param x         Left column
+ * @param y         Top row
+ * @param w         Width in pixels
+ * @param h         Height in pixels
+ * @param color     Color to fill the rectangle WHITE/BLACK
+*/
+void SSD1306_fillRect(int16_t x, int16_t y, uint16_t w, uint16_t h, SSD1306_COLOR color)
+{
+    int16_t x1 = x + (int16_t)w;
+    int16_t y1 = y + (int16_t)h;
+    uint8_t value = (color == BLACK) ? 0x00 : 0xFF;
+
+    // Clip to the screen
+    if (x < 0) {
+        x = 0;
+    }
+    if (y < 0) {
+        y = 0;
+    }
+    if (x1 > (int16_t)SSD1306_WIDTH) {
+        x1 = SSD1306_WIDTH;
+    }
+    if (y1 > (int16_t)SSD1306_HEIGHT) {
+        y1 = SSD1306_HEIGHT;
+    }
+    if ((x >= x1) || (y >= y1)) {
+        return;
+    }
+
+    SSD1306_memWait();
+
+    for (int16_t top = y & ~7; top < y1; top += 8) {
+        uint8_t *dst = SSD1306_target((uint8_t)x, (uint8_t)top);
+        uint8_t mask = 0xFF;
+
+        // Page is outside the strip
+        if (dst == NULL) {
+            continue;
+        }
+
+        // Rows of the page inside the rectangle
+        if (y > top) {
+            mask &= (uint8_t)(0xFFu << (y - top));
+        }
+        if (y1 < (top + 8)) {
+            mask &= (uint8_t)(0xFFu >> (top + 8 - y1));
+        }
+
+        if (mask == 0xFF) {
+            SSD1306_fillBytes(dst, value, (uint16_t)(x1 - x));
+        } else {
+            for (int16_t i = 0; i < (x1 - x); i++) {
+                dst[i] = (dst[i] & (uint8_t)~mask) | (value & mask);
+            }
+        }
+    }
+
+    SSD1306_markDirty(x, y, x1 - 1, y1 - 1);
+}
+
+/**
+ * @brief           Copy a pre-rendered frame into the screenbuffer
+ *                  The frame has the layout of the buffer (page-major, one byte per column, 1024 bytes)
+ *                  and must be word aligned. With SSD1306_MEMDMA the copy is queued on DMA2 and the
+ *                  frame must stay unchanged until the next drawing call or update.
+ *                  During strip rendering only the page of the strip is copied.
+ * @param frame     Frame to copy (flash or RAM)
+ * @return          0 for success/1 for failure (frame not word aligned)
+*/
+uint8_t SSD1306_loadFrame(const uint8_t *frame)
+{
+    const uint32_t *src = (const uint32_t *)frame;
+    uint32_t *dst;
+
+    if ((uintptr_t)frame & 3u) {
+        return 1;
+    }
+
+    // Strip rendering copies the page of the strip only
+    if (stripBuffer) {
+        src += (SSD1306_WIDTH / 4) * stripPage;
+        dst = (uint32_t *)stripBuffer;
+        for (uint8_t w = 0; w < (SSD1306_WIDTH / 4); w++) {
+            dst[w] = src[w];
+        }
+        return 0;
+    }
+
+#ifndef SSD1306_STRIP_ONLY
+    dst = (uint32_t *)backBuffer;
+
+#ifdef SSD1306_MEMDMA
+    if (MEMDMA_copy(dst, src, SSD1306_BUFFER_SIZE / 4) == 0) {
+        SSD1306_markDirty(0, 0, SSD1306_WIDTH - 1, SSD1306_HEIGHT - 1);
+        return 0;
+    }
+    SSD1306_memWait();
+#endif
+
+    for (uint16_t w = 0; w < (SSD1306_BUFFER_SIZE / 4); w++) {
+        dst[w] = src[w];
+    }
+
+    SSD1306_markDirty(0, 0, SSD1306_WIDTH - 1, SSD1306_HEIGHT - 1);
+#endif
+
+    return 0;
+}
+
+/**
+ * @brief   Wait until the DMA2 transfers queued on the screenbuffer have finished
+ *          Does nothing unless built with SSD1306_MEMDMA
+*/
+static void SSD1306_memWait(void)
+{
+#ifdef SSD1306_MEMDMA
+    (void)MEMDMA_wait(TIMEOUT_US);
+#endif
+}
+
+/**
+ * @brief           Fill bytes with a value, a word at a time in the aligned middle part
+ * @param dst       First byte
+ * @param value     Fill value
+ * @param count     Number of bytes
+*/
+static void SSD1306_fillBytes(uint8_t *dst, uint8_t value, uint16_t count)
+{
+    uint32_t word = value * 0x01010101u;
+
+    // Head up to the first word boundary
+    while ((count > 0) && ((uintptr_t)dst & 3u)) {
+        *dst++ = value;
+        count--;
+    }
+
+    // Four words per iteration
+    uint32_t *words = (uint32_t *)dst;
+    while (count >= 16) {
+        words[0] = word;
+        words[1] = word;
+        words[2] = word;
+        words[3] = word;
+        words += 4;
+        count -= 16;
+    }
+    while (count >= 4) {
+        *words++ = word;
+        count -= 4;
+    }
+
+    // Tail
+    dst = (uint8_t *)words;
+    while (count > 0) {
+        *dst++ = value;
+        count--;
+    }
+}
+
+/**
+ * @brief           Set cursor to x/y positions
+ *                  This function also sets the initial x/y positions to be 
+ *                  referenced when moving an image
+ * @param x         X coordinate to be set
+ * @param y         Y coordinate to be set
+*/
+void SSD1306_setCursor(uint8_t x, uint8_t y)
+{
+    SSD1306.xpos = x;
+    SSD1306.ypos = y;
+
+    SSD1306.xpos_init = x;
+    SSD1306.ypos_init = y;
+}
+
+/**
+ * @brief           Set how images and characters are combined with the buffer
+ *                  Applies to SSD1306_writeImg(), SSD1306_writeString() and SSD1306_write_char().
+ *                  SSD1306_DRAW_XOR and SSD1306_DRAW_MASK let a sprite be erased and redrawn in
+ *                  place without clearing the screen.
+ * @param mode      Draw mode (SSD1306_DRAW_COPY after reset)
+*/
+void SSD1306_setDrawMode(SSD1306_DRAW_MODE mode)
+{
+    drawMode = mode;
+}
+
+/**
+ * @brief           Draw one pixel in the screenbuffer
+ * @param x         X coordinate
+ * @param y         Y coordinate
+ * @param color     Color to fill screen WHITE/BLACK
+*/
+void SSD1306_draw_pixel(uint8_t x, uint8_t y, SSD1306_COLOR color)
+{
+    
+    // Check if coordinates are outside the buffer
+    if (x >= SSD1306_WIDTH || y >= SSD1306_HEIGHT) {
+        // If coordinates are outside the bounds, don't write to screen
+        return;
+    }
+
+    SSD1306_memWait();
+    SSD1306_setPixel(x, y, color);
+    SSD1306_markDirty(x, y, x, y);
+}
+
+/**
+ * @brief           Mark a rectangle of the buffer dirty
+ *                  Coordinates are inclusive and clipped to the screen
+ * @param x0        Left column
+ * @param y0        Top row
+ * @param x1        Right column
+ * @param y1        Bottom row
+*/
+static void SSD1306_markDirty(int16_t x0, int16_t y0, int16_t x1, int16_t y1)
+{
+#ifndef SSD1306_STRIP_ONLY
+    // Strips are not tracked, the screenbuffer is not drawn to
+    if (stripBuffer) {
+        return;
+    }
+
+    // Clip to the screen
+    if (x0 < 0) {
+        x0 = 0;
+    }
+    if (y0 < 0) {
+        y0 = 0;
+    }
+    if (x1 >= (int16_t)SSD1306_WIDTH) {
+        x1 = SSD1306_WIDTH - 1;
+    }
+    if (y1 >= (int16_t)SSD1306_HEIGHT) {
+        y1 = SSD1306_HEIGHT - 1;
+    }
+    if ((x0 > x1) || (y0 > y1)) {
+        return;
+    }
+
+    // Widen the column range of every page the rows fall in
+    for (uint8_t page = (uint8_t)(y0 / 8); page <= (uint8_t)(y1 / 8); page++) {
+        if (x0 < dirtyMin[page]) {
+            dirtyMin[page] = (uint8_t)x0;
+        }
+        if (x1 > dirtyMax[page]) {
+            dirtyMax[page] = (uint8_t)x1;
+        }
+    }
+#else
+    (void)x0;
+    (void)y0;
+    (void)x1;
+    (void)y1;
+#endif
+}
+
+/**
+ * @brief           Set one pixel in the screenbuffer without dirty tracking
+ *                  Callers mark their whole area dirty once
+ * @param x         X coordinate
+ * @param y         Y coordinate
+ * @param color     Color to fill screen WHITE/BLACK
+*/
+static void SSD1306_setPixel(uint8_t x, uint8_t y, SSD1306_COLOR color)
+{
+    uint8_t *target;
+
+    // If coordinates are outside the bounds, don't write to screen
+    if (x >= SSD1306_WIDTH || y >= SSD1306_HEIGHT) {
+        return;
+    }
+
+    target = SSD1306_target(x, y);
+    if (target == NULL) {
+        return;
+    }
+
+#ifdef SSD1306_BITBAND
+    SSD1306_bitbandWrite(target, y % 8, (color == WHITE) ? 1u : 0u);
+#else
+    // Draw in the correct color
+    if (color == WHITE) {
+        *target |= 1 << (y % 8);
+    } else {
+        *target &= ~(1 << (y % 8));
+    }
+#endif
+}
+
+#ifdef SSD1306_BITBAND
+/**
+ * @brief           Get the bit-band alias word of a bit of the SRAM region
+ *                  Every bit owns one word: alias = 0x22000000 + offset * 32 + bit * 4
+ * @param address   Byte in the region (0x20000000-0x200FFFFF)
+ * @param bit       Bit of the byte (0-7)
+ * @return          Address of the alias word
+*/
+static uint32_t SSD1306_bitbandAlias(uint32_t address, uint8_t bit)
+{
+    return BITBAND_ALIAS_BASE + ((address - BITBAND_SRAM_BASE) << 5) + ((uint32_t)bit << 2);
+}
+
+/**
+ * @brief           Write one bit of an SRAM byte through its bit-band alias word
+ * @param byte      Byte in SRAM (screenbuffer or strip)
+ * @param bit       Bit of the byte (0-7)
+ * @param value     0 to clear/1 to set
+*/
+static void SSD1306_bitbandWrite(uint8_t *byte, uint8_t bit, uint32_t value)
+{
+#ifndef SSD1306_BITBAND_EMULATE
+    *(volatile uint32_t *)(uintptr_t)SSD1306_bitbandAlias((uint32_t)(uintptr_t)byte, bit) = value;
+#else
+    uint32_t offset = (uint32_t)((uintptr_t)byte & (BITBAND_REGION_SIZE - 1u));
+    uint32_t alias = SSD1306_bitbandAlias(BITBAND_SRAM_BASE + offset, bit);
+
+    // Do what the bus matrix does with the alias write
+    offset = (alias - BITBAND_ALIAS_BASE) >> 5;
+    uint8_t *target = (uint8_t *)(((uintptr_t)byte & ~(uintptr_t)(BITBAND_REGION_SIZE - 1u)) | offset);
+    uint8_t mask = (uint8_t)(1u << ((alias >> 2) & 7u));
+
+    if (value & 1u) {
+        *target |= mask;
+    } else {
+        *target &= (uint8_t)~mask;
+    }
+#endif
+}
+#endif // SSD1306_BITBAND
+
+/**
+ * @brief           Get the byte holding a pixel in the current render target
+ * @param x         X coordinate (on screen)
+ * @param y         Y coordinate (on screen)
+ * @return          Byte of the back buffer or strip/NULL if the row is outside the strip
+*/
+static uint8_t *SSD1306_target(uint8_t x, uint8_t y)
+{
+    if (stripBuffer) {
+        return ((y / 8) == stripPage) ? &stripBuffer[x] : NULL;
+    }
+
+#ifndef SSD1306_STRIP_ONLY
+    return &backBuffer[x + (y / 8) * SSD1306_WIDTH];
+#else
+    return NULL;
+#endif
+}
+
+/**
+ * @brief           Limit the rows of a primitive to the ones the render target holds
+ * @param y         Top row of the primitive
+ * @param h         Height of the primitive
+ * @param first     First row to render (relative to y)
+ * @param end       Row after the last row to render (relative to y), not above first
+*/
+static void SSD1306_targetRows(int16_t y, uint16_t h, uint16_t *first, uint16_t *end)
+{
+    int16_t top = 0;
+    int16_t bottom = SSD1306_HEIGHT;
+
+    if (stripBuffer) {
+        top = stripPage * 8;
+        bottom = top + 8;
+    }
+
+    *first = (top > y) ? (uint16_t)(top - y) : 0;
+    *end = ((y + (int16_t)h) > bottom) ? (uint16_t)(bottom - y) : h;
+    if ((bottom <= y) || (*end < *first)) {
+        *end = *first;
+    }
+}
+
+/**
+ * @brief           Blit 16-bit rows (bit 15 is the leftmost pixel) into the render target
+ *                  Up to 8 rows are gathered into one byte per column, which is shifted into the one
+ *                  or two pages its y offset touches and merged under a mask. Every target byte is
+ *                  read and written once per 8 rows instead of once per pixel.
+ *                  The rows are combined with the buffer according to the draw mode.
+ * @param rows      Pixel rows
+ * @param maskRows  Opaque pixels in the same layout for SSD1306_DRAW_MASK (may be NULL)
+ * @param x         Left column
+ * @param y         Top row
+ * @param w         Width in pixels (max 16)
+ * @param h         Height in pixels (number of rows)
+ * @param color     Color to fill screen WHITE/BLACK
+*/
+static void SSD1306_blitRows(const uint16_t *rows, const uint16_t *maskRows, uint16_t x, uint16_t y, uint8_t w, uint16_t h, SSD1306_COLOR color)
+{
+    uint32_t words[4];
+    uint32_t maskWords[4] = {0xFFFFFFFFu, 0xFFFFFFFFu, 0xFFFFFFFFu, 0xFFFFFFFFu};
+    const uint8_t *columns = (const uint8_t *)words;
+    const uint8_t *opaque = (const uint8_t *)maskWords;
+    uint16_t rowFirst;
+    uint16_t rowEnd;
+
+    // Only the rows the render target holds
+    SSD1306_targetRows(y, h, &rowFirst, &rowEnd);
+
+    for (uint16_t row = rowFirst; row < rowEnd; row += 8) {
+        uint8_t count = ((rowEnd - row) < 8) ? (uint8_t)(rowEnd - row) : 8;
+        uint8_t mask = (uint8_t)((1u << count) - 1u);
+
+        // Turn the rows into column bytes, bit 0 is the top row
+        SSD1306_transposeRows(&rows[row], count, words);
+        if ((drawMode == SSD1306_DRAW_MASK) && (maskRows != NULL)) {
+            SSD1306_transposeRows(&maskRows[row], count, maskWords);
+        }
+
+        for (uint8_t j = 0; (j < w) && ((x + j) < SSD1306_WIDTH); j++) {
+            uint8_t clear;
+            uint8_t bits = SSD1306_blend(columns[j], opaque[j], mask, color, &clear);
+
+            SSD1306_writeColumn(x + j, y + row, bits, clear);
+        }
+    }
+}
+
+/**
+ * @brief           Convert 16-bit rows (bit 15 is the leftmost pixel) to page-major data in bulk
+ *                  Each group of 8 rows becomes w column bytes with bit 0 as the top row, the format
+ *                  of FontDef.pages. Use it to convert glyphs/icons that arrive at runtime once and
+ *                  draw them with the byte-copy path afterwards.
+ * @param rows      Pixel rows
+ * @param w         Width in pixels (max 16)
+ * @param h         Height in pixels (number of rows)
+ * @param pages     Output, ((h + 7) / 8) * w bytes
+*/
+void SSD1306_rowsToPages(const uint16_t *rows, uint8_t w, uint16_t h, uint8_t *pages)
+{
+    uint32_t words[4];
+    const uint8_t *columns = (const uint8_t *)words;
+
+    for (uint16_t row = 0; row < h; row += 8) {
+        uint8_t count = ((h - row) < 8) ? (uint8_t)(h - row) : 8;
+
+        SSD1306_transposeRows(&rows[row], count, words);
+        for (uint8_t j = 0; j < w; j++) {
+            *pages++ = columns[j];
+        }
+    }
+}
+
+/**
+ * @brief           Transpose up to 8 rows of 16 pixels into 16 column bytes
+ *                  The high and low bytes of the rows form two 8x8 bit matrices. Missing rows are 0.
+ * @param rows      Pixel rows (bit 15 is the leftmost pixel)
+ * @param count     Number of rows (1-8)
+ * @param columns   Output, 16 column bytes (bit 0 is the top row) in 4 words
+*/
+static void SSD1306_transposeRows(const uint16_t *rows, uint8_t count, uint32_t *columns)
+{
+    // Rows 7-4 go to word 0 and rows 3-0 to word 1, row 0 in the lowest byte
+    uint32_t left[2] = {0, 0};
+    uint32_t right[2] = {0, 0};
+
+    for (uint8_t i = 0; i < count; i++) {
+        uint8_t shift = (i & 3u) * 8u;
+
+        left[i < 4] |= (uint32_t)(rows[i] >> 8) << shift;
+        right[i < 4] |= (uint32_t)(rows[i] & 0xFFu) << shift;
+    }
+
+    SSD1306_transpose8(left[0], left[1], &columns[0]);
+    SSD1306_transpose8(right[0], right[1], &columns[2]);
+}
+
+/**
+ * @brief           Transpose an 8x8 bit matrix held in two words (Hacker's Delight 7-3)
+ *                  Swaps 1x1, 2x2 and then 4x4 blocks with shifts and masks instead of
+ *                  moving 64 single bits. On the M4 the shifts come for free with the XOR/AND
+ *                  (barrel shifter) and REV puts the column bytes in memory order.
+ * @param x         Rows 7-4 (row 7 in the top byte, bit 7 is the leftmost pixel)
+ * @param y         Rows 3-0
+ * @param columns   Output, 8 column bytes (leftmost first, bit 0 is row 0) in 2 words
+*/
+static void SSD1306_transpose8(uint32_t x, uint32_t y, uint32_t *columns)
+{
+    uint32_t t;
+
+    t = (x ^ (x >> 7)) & 0x00AA00AAu;
+    x = x ^ t ^ (t << 7);
+    t = (y ^ (y >> 7)) & 0x00AA00AAu;
+    y = y ^ t ^ (t << 7);
+
+    t = (x ^ (x >> 14)) & 0x0000CCCCu;
+    x = x ^ t ^ (t << 14);
+    t = (y ^ (y >> 14)) & 0x0000CCCCu;
+    y = y ^ t ^ (t << 14);
+
+    t = (x & 0xF0F0F0F0u) | ((y >> 4) & 0x0F0F0F0Fu);
+    y = ((x << 4) & 0xF0F0F0F0u) | (y & 0x0F0F0F0Fu);
+    x = t;
+
+    // Leftmost column is in the top byte of x
+    columns[0] = __REV(x);
+    columns[1] = __REV(y);
+}
+
+/**
+ * @brief           Blit page-major data (one byte per column and page, bit 0 is the top row) into
+ *                  the render target
+ *                  Pages that land on a page boundary are copied byte by byte, others are shifted
+ *                  into the two pages they touch.
+ *                  The bytes are combined with the buffer according to the draw mode, the whole
+ *                  glyph is opaque in SSD1306_DRAW_MASK.
+ * @param pages     Page bytes, w bytes per page
+ * @param x         Left column
+ * @param y         Top row
+ * @param w         Width in pixels
+ * @param h         Height in pixels
+ * @param color     Color to fill screen WHITE/BLACK
+*/
+static void SSD1306_blitPages(const uint8_t *pages, uint16_t x, uint16_t y, uint8_t w, uint16_t h, SSD1306_COLOR color)
+{
+    uint8_t invert = (color == WHITE) ? 0x00 : 0xFF;
+    uint8_t width = ((x + w) > SSD1306_WIDTH) ? (uint8_t)(SSD1306_WIDTH - x) : w;
+
+    if (x >= SSD1306_WIDTH) {
+        return;
+    }
+
+    for (uint16_t row = 0; row < h; row += 8) {
+        const uint8_t *src = &pages[(row / 8) * w];
+        uint8_t mask = ((h - row) < 8) ? (uint8_t)((1u << (h - row)) - 1u) : 0xFF;
+        uint16_t top = y + row;
+
+        // Whole page on a page boundary: plain byte copy
+        if (((top % 8) == 0) && (mask == 0xFF)) {
+            uint8_t *dst = (top < SSD1306_HEIGHT) ? SSD1306_target(x, top) : NULL;
+
+            if (dst == NULL) {
+                continue;
+            }
+
+            if ((drawMode == SSD1306_DRAW_COPY) || (drawMode == SSD1306_DRAW_MASK)) {
+                for (uint8_t j = 0; j < width; j++) {
+                    dst[j] = src[j] ^ invert;
+                }
+            } else {
+                for (uint8_t j = 0; j < width; j++) {
+                    uint8_t clear;
+                    uint8_t bits = SSD1306_blend(src[j], 0xFF, 0xFF, color, &clear);
+
+                    dst[j] = (dst[j] & (uint8_t)~clear) ^ bits;
+                }
+            }
+            continue;
+        }
+
+        for (uint8_t j = 0; j < width; j++) {
+            uint8_t clear;
+            uint8_t bits = SSD1306_blend(src[j], 0xFF, mask, color, &clear);
+
+            SSD1306_writeColumn(x + j, top, bits, clear);
+        }
+    }
+}
+
+/**
+ * @brief           Combine a column byte of an image/glyph with the draw mode
+ *                  The result is applied to the buffer as (byte & ~clear) ^ bits.
+ * @param ink       Set pixels of the image, bit 0 is the top row
+ * @param opaque    Pixels of the image mask (0xFF without a mask)
+ * @param rows      Rows of the byte that belong to the image
+ * @param color     Color of the set pixels WHITE/BLACK
+ * @param clear     Output, pixels to be replaced
+ * @return          Pixels to be set (toggled in SSD1306_DRAW_XOR)
+*/
+static uint8_t SSD1306_blend(uint8_t ink, uint8_t opaque, uint8_t rows, SSD1306_COLOR color, uint8_t *clear)
+{
+    uint8_t bits = (color == WHITE) ? ink : (uint8_t)~ink;
+
+    switch (drawMode) {
+    case SSD1306_DRAW_OR:
+        // Set pixels in color, the rest shows through
+        *clear = ink & rows;
+        return (color == WHITE) ? *clear : 0x00;
+
+    case SSD1306_DRAW_AND_NOT:
+        // Set pixels in the other color, the rest shows through
+        *clear = ink & rows;
+        return (color == WHITE) ? 0x00 : *clear;
+
+    case SSD1306_DRAW_XOR:
+        // Set pixels are inverted, nothing is replaced
+        *clear = 0x00;
+        return ink & rows;
+
+    case SSD1306_DRAW_MASK:
+        // Both colors inside the mask, the rest shows through
+        *clear = opaque & rows;
+        return bits & *clear;
+
+    default:
+        // Both colors everywhere
+        *clear = rows;
+        return bits & rows;
+    }
+}
+
+/**
+ * @brief           Write up to 8 vertical pixels starting at any row
+ *                  The pixels in mask are replaced with bits, bits outside the mask are toggled
+ * @param x         Column
+ * @param y         Row of bit 0
+ * @param bits      Pixels, bit 0 is the top row
+ * @param mask      Bits to be replaced
+*/
+static void SSD1306_writeColumn(uint16_t x, uint16_t y, uint8_t bits, uint8_t mask)
+{
+    uint8_t shift = y % 8;
+    uint8_t *target;
+
+    // Page of the top row
+    if (y < SSD1306_HEIGHT) {
+        target = SSD1306_target(x, y);
+        if (target != NULL) {
+            *target = (*target & (uint8_t)~(mask << shift)) ^ (uint8_t)(bits << shift);
+        }
+    }
+
+    // Rows that spill into the next page
+    y = y - shift + 8;
+    if ((shift != 0) && (y < SSD1306_HEIGHT)) {
+        target = SSD1306_target(x, y);
+        if (target != NULL) {
+            *target = (*target & (uint8_t)~(mask >> (8 - shift))) ^ (uint8_t)(bits >> (8 - shift));
+        }
+    }
+}
+
+/**
+ * @brief           Draw 1 char to the screen buffer
+ * @param ch        Character to write to the screen
+ * @param Font      Font struct with font parameters
+ * @param color     Color to fill screen WHITE/BLACK
+ * @param wrap      Used to check if the text needs to wrap
+ * @return          Return char being written
+*/
+char SSD1306_write_char(char ch, FontDef Font, SSD1306_COLOR color, uint8_t wrap)
+{
+    SSD1306_memWait();
+
+    // Check remaining space on current line
+    if ((SSD1306_WIDTH <= (SSD1306.xpos + Font.FontWidth)) ||
+        (SSD1306_HEIGHT <= (SSD1306.ypos + Font.FontHeight))) {
+        if (wrap) {
+            if (SSD1306_WIDTH <= (SSD1306.xpos + Font.FontWidth)) {
+                // Return to initial position shifted by font height
+                SSD1306.xpos = SSD1306.xpos_init;
+                SSD1306.ypos = (SSD1306.ypos_init + Font.FontHeight) * SSD1306.wrap_counter;
+                SSD1306.wrap_counter++;
+            } else if (SSD1306_HEIGHT <= (SSD1306.ypos + Font.FontHeight)) {
+                return 1;
+            }
+        } else {
+            // Not enough space on current line
+            return 1;
+        }
+    }
+
+    // Translate font to screenbuffer
+    if (Font.pages != NULL) {
+        uint16_t glyphSize = Font.FontWidth * ((Font.FontHeight + 7u) / 8u);
+
+        SSD1306_blitPages(&Font.pages[(ch - 32) * glyphSize], SSD1306.xpos, SSD1306.ypos, Font.FontWidth, Font.FontHeight, color);
+    } else {
+        SSD1306_blitRows(&Font.data[(ch - 32) * Font.FontHeight], NULL, SSD1306.xpos, SSD1306.ypos, Font.FontWidth, Font.FontHeight, color);
+    }
+    SSD1306_markDirty(SSD1306.xpos, SSD1306.ypos, SSD1306.xpos + Font.FontWidth - 1, SSD1306.ypos + Font.FontHeight - 1);
+
+    // The current space is now taken
+    SSD1306.xpos += Font.FontWidth;
+
+    // Return written char for validation
+    return ch;
+}
+
+/**
+ * @brief           Write full string to screenbuffer
+ * @param str       String to write to the screen
+ * @param Font      Font struct with font parameters
+ * @param color     Color to fill screen WHITE/BLACK
+ * @param wrap      Used to check if the text needs to wrap
+ * @return          Return char being written
+*/
+char SSD1306_writeString(const char* str, FontDef Font, SSD1306_COLOR color, uint8_t wrap)
+{
+    // Store initial cursor position
+    SSD1306.xpos_init = SSD1306.xpos;
+    SSD1306.ypos_init = SSD1306.ypos;
+    SSD1306.wrap_counter = 1;
+
+    // Write until null-byte
+    while (*str) {
+        if (SSD1306_write_char(*str, Font, color, wrap) != *str) {
+            // Char could not be written
+            return *str;
+        }
+
+        // Next char
+        str++;
+    }
+
+    return *str;
+}
+
+/**
+ * @brief           Write image to screenbuffer
+ *                  Each image section is 16-bits wide
+ * @param Img       Image struct with image parameters
+ * @param color     Color to fill screen WHITE/BLACK
+*/
+void SSD1306_writeImg(ImgDef Img, SSD1306_COLOR color)
+{
+    SSD1306_memWait();
+
+    // Store initial cursor position
+    SSD1306.xpos_init = SSD1306.xpos;
+    SSD1306.ypos_init = SSD1306.ypos;
+    
+    // Check remaining space on current line
+    if ((SSD1306_WIDTH <= (SSD1306.xpos + Img.imgWidth)) ||
+        (SSD1306_HEIGHT <= (SSD1306.ypos + Img.imgHeight))) {
+        // Not enough space on current line
+        return;
+    }
+    
+    // Write each inidividual section of image
+    for (uint8_t imgSection = 0; imgSection < Img.imgSections; imgSection++) {
+        // Translate section to screenbuffer
+        const uint16_t *mask = (Img.mask != NULL) ? &Img.mask[imgSection * Img.imgHeight] : NULL;
+
+        SSD1306_blitRows(&Img.data[imgSection * Img.imgHeight], mask, SSD1306.xpos, SSD1306.ypos, Img.imgWidth, Img.imgHeight, color);
+        SSD1306_markDirty(SSD1306.xpos, SSD1306.ypos, SSD1306.xpos + Img.imgWidth - 1, SSD1306.ypos + Img.imgHeight - 1);
+        
+        // The current space is now taken
+        SSD1306.xpos += Img.imgWidth;
+    }
+}
+
+#ifndef SSD1306_STRIP_ONLY
+/**
+ * @brief           Turn the screen into a text console
+ *                  The 8 pages of the GDDRAM are used as a ring of text lines of ceil(FontHeight / 8)
+ *                  pages. A newline on the last line clears the pages of the top line and moves the
+ *                  display start line (40h~7Fh) past them, so the top line scrolls off and comes back as
+ *                  the empty bottom line. A scroll costs the cleared pages and one command byte instead
+ *                  of rendering and sending every line again.
+ *                  The screen is cleared. While the console is in use the other drawing functions draw
+ *                  at ring positions, SSD1306_consoleEnd() puts the pages back in screen order.
+ * @param Font      Console font, needs page-major glyphs (FontDef.pages)
+ * @param color     Text color, the background is the other color
+ * @return          0 for success/1 for failure (no page-major glyphs)
+*/
+uint8_t SSD1306_consoleInit(const FontDef *Font, SSD1306_COLOR color)
+{
+    if ((Font->pages == NULL) || (Font->FontWidth > SSD1306_WIDTH) || (Font->FontHeight > SSD1306_HEIGHT)) {
+        return 1;
+    }
+
+    consoleGlyphs = Font->pages;
+    consoleWidth = Font->FontWidth;
+    consolePages = (Font->FontHeight + 7u) / 8u;
+    consoleLines = (SSD1306_HEIGHT / 8) / consolePages;
+    consoleTop = 0;
+    consoleLine = 0;
+    consoleCol = 0;
+    consoleColor = color;
+
+    SSD1306_fill((color == WHITE) ? BLACK : WHITE);
+
+    startLine = 0;
+    startLinePending = 1;
+
+    return 0;
+}
+
+/**
+ * @brief           Write a string to the console
+ *                  '\n' starts a new line, '\r' returns to the start of the line. Text that does not fit
+ *                  on the line continues on the next one. Characters without a glyph are skipped.
+ *                  Only the pages of the lines written to are marked dirty.
+ * @param str       String to be written
+ * @return          0 for success/1 for failure (console not in use)
+*/
+uint8_t SSD1306_consoleWrite(const char *str)
+{
+    if (consoleGlyphs == NULL) {
+        return 1;
+    }
+
+    SSD1306_memWait();
+
+    uint16_t glyphSize = consoleWidth * consolePages;
+    uint8_t background = (consoleColor == WHITE) ? 0x00 : 0xFF;
+
+    for (; *str; str++) {
+        char ch = *str;
+
+        if (ch == '\n') {
+            SSD1306_consoleNewline();
+            continue;
+        }
+        if (ch == '\r') {
+            consoleCol = 0;
+            continue;
+        }
+        if ((ch < ' ') || (ch > '~')) {
+            continue;
+        }
+
+        if ((consoleCol + consoleWidth) > SSD1306_WIDTH) {
+            SSD1306_consoleNewline();
+        }
+
+        // Copy the glyph page by page, the pages of a line may wrap around the ring
+        const uint8_t *glyph = &consoleGlyphs[(ch - 32) * glyphSize];
+        uint8_t page = (uint8_t)((consoleTop + (consoleLine * consolePages)) % (SSD1306_HEIGHT / 8));
+
+        for (uint8_t i = 0; i < consolePages; i++) {
+            uint8_t *dst = &backBuffer[(SSD1306_WIDTH * page) + consoleCol];
+
+            for (uint8_t j = 0; j < consoleWidth; j++) {
+                dst[j] = glyph[j] ^ background;
+            }
+            SSD1306_markDirty(consoleCol, page * 8, consoleCol + consoleWidth - 1, (page * 8) + 7);
+
+            glyph += consoleWidth;
+            page = (page + 1u) % (SSD1306_HEIGHT / 8);
+        }
+
+        consoleCol += consoleWidth;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief   Leave the console and put the pages back in screen order
+ *          The buffer is rotated so the console text stays where it is with start line 0. The whole
+ *          screen is sent again by the next update.
+*/
+void SSD1306_consoleEnd(void)
+{
+    uint8_t page[SSD1306_WIDTH];
+
+    if (consoleGlyphs == NULL) {
+        return;
+    }
+
+    SSD1306_memWait();
+
+    // Rotate the ring one page at a time until consoleTop is page 0
+    for (uint8_t n = 0; n < consoleTop; n++) {
+        for (uint16_t i = 0; i < SSD1306_WIDTH; i++) {
+            page[i] = backBuffer[i];
+        }
+        for (uint16_t i = 0; i < (SSD1306_BUFFER_SIZE - SSD1306_WIDTH); i++) {
+            backBuffer[i] = backBuffer[i + SSD1306_WIDTH];
+        }
+        for (uint16_t i = 0; i < SSD1306_WIDTH; i++) {
+            backBuffer[(SSD1306_BUFFER_SIZE - SSD1306_WIDTH) + i] = page[i];
+        }
+    }
+
+    consoleGlyphs = NULL;
+    consoleTop = 0;
+    startLine = 0;
+    startLinePending = 1;
+    SSD1306_invalidate();
+}
+
+/**
+ * @brief   Move the console cursor to the start of the next line, scrolling when on the last line
+*/
+static void SSD1306_consoleNewline(void)
+{
+    consoleCol = 0;
+
+    if ((consoleLine + 1u) < consoleLines) {
+        consoleLine++;
+        return;
+    }
+
+    // The top line becomes the bottom line, the spare pages below the last line (if any) follow it
+    SSD1306_consoleClearPages(consoleTop, consolePages);
+    consoleTop = (uint8_t)((consoleTop + consolePages) % (SSD1306_HEIGHT / 8));
+
+    startLine = consoleTop * 8;
+    startLinePending = 1;
+}
+
+/**
+ * @brief           Clear ring pages to the console background
+ * @param page      First page (0-7)
+ * @param count     Number of pages, may wrap around the ring
+*/
+static void SSD1306_consoleClearPages(uint8_t page, uint8_t count)
+{
+    uint8_t background = (consoleColor == WHITE) ? 0x00 : 0xFF;
+
+    for (uint8_t i = 0; i < count; i++) {
+        SSD1306_fillBytes(&backBuffer[SSD1306_WIDTH * page], background, SSD1306_WIDTH);
+        SSD1306_markDirty(0, page * 8, SSD1306_WIDTH - 1, (page * 8) + 7);
+        page = (page + 1u) % (SSD1306_HEIGHT / 8);
+    }
+}
+#endif // SSD1306_STRIP_ONLY
+
+/**
+ * @brief               Set up a sprite
+ *                      The sprite is shown at the first frame. Its old and new areas are redrawn
+ *                      by the next SSD1306_spriteCompose().
+ * @param id            Sprite (0 to SSD1306_MAX_SPRITES - 1)
+ * @param frames        Animation frames (NULL to remove the sprite)
+ * @param frameCount    Number of frames
+ * @param x             Left column
+ * @param y             Top row
+ * @param z             Sprites with a higher z are drawn on top, equal z in order of id
+ * @return              0 for success/1 for failure
+*/
+uint8_t SSD1306_spriteSet(uint8_t id, const ImgDef *const *frames, uint8_t frameCount, uint8_t x, uint8_t y, uint8_t z)
+{
+    if ((id >= SSD1306_MAX_SPRITES) || ((frames != NULL) && (frameCount == 0))) {
+        return 1;
+    }
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    SSD1306_damageSprite(id);
+    sprites[id].frames = frames;
+    sprites[id].frameCount = frameCount;
+    sprites[id].frame = 0;
+    sprites[id].x = x;
+    sprites[id].y = y;
+    sprites[id].z = z;
+    sprites[id].visible = 1;
+    SSD1306_damageSprite(id);
+
+    __set_PRIMASK(primask);
+
+    return 0;
+}
+
+/**
+ * @brief           Move a sprite by an offset, it stays inside the screen
+ *                  Only the old and new areas of the sprite are redrawn by SSD1306_spriteCompose().
+ *                  Safe to call from an interrupt handler.
+ * @param id        Sprite
+ * @param dx        Columns to the right (negative to the left)
+ * @param dy        Rows down (negative up)
+ * @return          0 for success/1 for failure (no such sprite)
+*/
+uint8_t SSD1306_spriteMoveBy(uint8_t id, int16_t dx, int16_t dy)
+{
+    if ((id >= SSD1306_MAX_SPRITES) || (sprites[id].frames == NULL)) {
+        return 1;
+    }
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    SSD1306_Sprite *sprite = &sprites[id];
+    const ImgDef *img = sprite->frames[sprite->frame];
+    int16_t x = (int16_t)sprite->x + dx;
+    int16_t y = (int16_t)sprite->y + dy;
+    int16_t right = (int16_t)SSD1306_WIDTH - (int16_t)(img->imgWidth * img->imgSections);
+    int16_t bottom = (int16_t)SSD1306_HEIGHT - (int16_t)img->imgHeight;
+
+    if (x > right) {
+        x = right;
+    }
+    if (y > bottom) {
+        y = bottom;
+    }
+    if (x < 0) {
+        x = 0;
+    }
+    if (y < 0) {
+        y = 0;
+    }
+
+    SSD1306_damageSprite(id);
+    sprite->x = (uint8_t)x;
+    sprite->y = (uint8_t)y;
+    SSD1306_damageSprite(id);
+
+    __set_PRIMASK(primask);
+
+    return 0;
+}
+
+/**
+ * @brief           Show or hide a sprite
+ * @param id        Sprite
+ * @param visible   1 to show/0 to hide
+ * @return          0 for success/1 for failure (no such sprite)
+*/
+uint8_t SSD1306_spriteShow(uint8_t id, uint8_t visible)
+{
+    if ((id >= SSD1306_MAX_SPRITES) || (sprites[id].frames == NULL)) {
+        return 1;
+    }
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    SSD1306_damageSprite(id);
+    sprites[id].visible = visible ? 1 : 0;
+    SSD1306_damageSprite(id);
+
+    __set_PRIMASK(primask);
+
+    return 0;
+}
+
+/**
+ * @brief           Select the animation frame of a sprite
+ * @param id        Sprite
+ * @param frame     Frame (0 to frameCount - 1)
+ * @return          0 for success/1 for failure (no such sprite or frame)
+*/
+uint8_t SSD1306_spriteFrame(uint8_t id, uint8_t frame)
+{
+    if ((id >= SSD1306_MAX_SPRITES) || (sprites[id].frames == NULL) || (frame >= sprites[id].frameCount)) {
+        return 1;
+    }
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    SSD1306_damageSprite(id);
+    sprites[id].frame = frame;
+    SSD1306_damageSprite(id);
+
+    __set_PRIMASK(primask);
+
+    return 0;
+}
+
+/**
+ * @brief           Advance a sprite to its next animation frame, wrapping after the last one
+ * @param id        Sprite
+ * @return          0 for success/1 for failure (no such sprite)
+*/
+uint8_t SSD1306_spriteNextFrame(uint8_t id)
+{
+    if ((id >= SSD1306_MAX_SPRITES) || (sprites[id].frames == NULL)) {
+        return 1;
+    }
+
+    return SSD1306_spriteFrame(id, (uint8_t)((sprites[id].frame + 1u) % sprites[id].frameCount));
+}
+
+/**
+ * @brief           Draw every visible sprite into the render target, lowest z first
+ *                  Used to draw the sprites during strip rendering, or on top of a frame drawn
+ *                  from scratch. Sprites with a mask are drawn with SSD1306_DRAW_MASK, others
+ *                  transparent (SSD1306_DRAW_OR), in WHITE.
+*/
+void SSD1306_spriteDraw(void)
+{
+    uint8_t order[SSD1306_MAX_SPRITES];
+    SSD1306_DRAW_MODE mode = drawMode;
+
+    SSD1306_memWait();
+    SSD1306_sortSprites(sprites, order);
+
+    for (uint8_t i = 0; i < SSD1306_MAX_SPRITES; i++) {
+        const SSD1306_Sprite *sprite = &sprites[order[i]];
+
+        if ((sprite->frames != NULL) && sprite->visible) {
+            const ImgDef *img = sprite->frames[sprite->frame];
+
+            SSD1306_drawSprite(sprite);
+            SSD1306_markDirty(sprite->x, sprite->y, sprite->x + (img->imgWidth * img->imgSections) - 1, sprite->y + img->imgHeight - 1);
+        }
+    }
+
+    drawMode = mode;
+}
+
+#ifndef SSD1306_STRIP_ONLY
+/**
+ * @brief           Set the frame shown under the sprites by SSD1306_spriteCompose()
+ *                  The whole screen is redrawn by the next SSD1306_spriteCompose().
+ * @param frame     Frame in the layout of the screenbuffer (1024 bytes), NULL for black
+*/
+void SSD1306_spriteBackground(const uint8_t *frame)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    spriteBackground = frame;
+    for (uint8_t page = 0; page < (SSD1306_HEIGHT / 8); page++) {
+        damageMin[page] = 0;
+        damageMax[page] = SSD1306_WIDTH - 1;
+    }
+
+    __set_PRIMASK(primask);
+}
+
+/**
+ * @brief   Redraw the screenbuffer where sprites have changed
+ *          Every page with damage is rendered as a strip: the damaged columns are taken from the
+ *          background, every sprite that overlaps them is drawn in z-order, and only those columns
+ *          are copied into the buffer and marked dirty. The rest of the buffer, including
+ *          anything drawn there with the other drawing functions, is left alone.
+ *          The sprite table is sampled once with interrupts disabled, changes made while the
+ *          regions are redrawn (e.g. from an EXTI handler) are picked up by the next call.
+ *          Call SSD1306_update()/SSD1306_updateDMA() afterwards to send the result.
+ * @return  0 for success/1 for failure (called during strip rendering)
+*/
+uint8_t SSD1306_spriteCompose(void)
+{
+    SSD1306_Sprite table[SSD1306_MAX_SPRITES];
+    uint8_t order[SSD1306_MAX_SPRITES];
+    uint8_t start[SSD1306_HEIGHT / 8];
+    uint8_t end[SSD1306_HEIGHT / 8];
+    uint32_t strip[SSD1306_WIDTH / 4];
+    SSD1306_DRAW_MODE mode = drawMode;
+
+    if (stripBuffer) {
+        return 1;
+    }
+
+    SSD1306_memWait();
+
+    // Take the sprites and their damage together
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    for (uint8_t i = 0; i < SSD1306_MAX_SPRITES; i++) {
+        table[i] = sprites[i];
+    }
+    for (uint8_t page = 0; page < (SSD1306_HEIGHT / 8); page++) {
+        start[page] = damageMin[page];
+        end[page] = damageMax[page];
+        damageMin[page] = SSD1306_CLEAN_MIN;
+        damageMax[page] = SSD1306_CLEAN_MAX;
+    }
+
+    __set_PRIMASK(primask);
+
+    SSD1306_sortSprites(table, order);
+
+    for (uint8_t page = 0; page < (SSD1306_HEIGHT / 8); page++) {
+        uint8_t *buffer = (uint8_t *)strip;
+        uint8_t *dst = &backBuffer[SSD1306_WIDTH * page];
+        uint8_t first = start[page];
+        uint8_t last = end[page];
+
+        if (first > last) {
+            continue;
+        }
+
+        // Background of the damaged columns
+        for (uint8_t i = first; i <= last; i++) {
+            buffer[i] = (spriteBackground != NULL) ? spriteBackground[(SSD1306_WIDTH * page) + i] : 0x00;
+        }
+
+        // Sprites that overlap the damaged columns of the page
+        stripBuffer = buffer;
+        stripPage = page;
+        for (uint8_t i = 0; i < SSD1306_MAX_SPRITES; i++) {
+            const SSD1306_Sprite *sprite = &table[order[i]];
+
+            if ((sprite->frames == NULL) || !sprite->visible) {
+                continue;
+            }
+
+            const ImgDef *img = sprite->frames[sprite->frame];
+            uint16_t right = sprite->x + (img->imgWidth * img->imgSections) - 1;
+            uint16_t bottom = sprite->y + img->imgHeight - 1;
+
+            if ((sprite->x > last) || (right < first) || (sprite->y > ((page * 8) + 7)) || (bottom < (page * 8))) {
+                continue;
+            }
+
+            SSD1306_drawSprite(sprite);
+        }
+        stripBuffer = NULL;
+
+        for (uint8_t i = first; i <= last; i++) {
+            dst[i] = buffer[i];
+        }
+        SSD1306_markDirty(first, page * 8, last, (page * 8) + 7);
+    }
+
+    drawMode = mode;
+
+    return 0;
+}
+#endif // SSD1306_STRIP_ONLY
+
+/**
+ * @brief       Add the area of a sprite to the damage of SSD1306_spriteCompose()
+ *              Called with interrupts disabled
+ * @param id    Sprite
+*/
+static void SSD1306_damageSprite(uint8_t id)
+{
+#ifndef SSD1306_STRIP_ONLY
+    const SSD1306_Sprite *sprite = &sprites[id];
+
+    if ((sprite->frames == NULL) || !sprite->visible) {
+        return;
+    }
+
+    const ImgDef *img = sprite->frames[sprite->frame];
+    uint16_t x0 = sprite->x;
+    uint16_t y0 = sprite->y;
+    uint16_t x1 = x0 + (img->imgWidth * img->imgSections) - 1;
+    uint16_t y1 = y0 + img->imgHeight - 1;
+
+    if ((x0 >= SSD1306_WIDTH) || (y0 >= SSD1306_HEIGHT)) {
+        return;
+    }
+    if (x1 >= SSD1306_WIDTH) {
+        x1 = SSD1306_WIDTH - 1;
+    }
+    if (y1 >= SSD1306_HEIGHT) {
+        y1 = SSD1306_HEIGHT - 1;
+    }
+
+    for (uint8_t page = (uint8_t)(y0 / 8); page <= (uint8_t)(y1 / 8); page++) {
+        if (x0 < damageMin[page]) {
+            damageMin[page] = (uint8_t)x0;
+        }
+        if (x1 > damageMax[page]) {
+            damageMax[page] = (uint8_t)x1;
+        }
+    }
+#else
+    (void)id;
+#endif
+}
+
+/**
+ * @brief           Sort the sprite ids by z (insertion sort, equal z keep the order of id)
+ * @param table     Sprites
+ * @param order     Output, SSD1306_MAX_SPRITES ids from the bottom to the top sprite
+*/
+static void SSD1306_sortSprites(const SSD1306_Sprite *table, uint8_t *order)
+{
+    for (uint8_t i = 0; i < SSD1306_MAX_SPRITES; i++) {
+        uint8_t j = i;
+
+        while ((j > 0) && (table[order[j - 1]].z > table[i].z)) {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = i;
+    }
+}
+
+/**
+ * @brief           Draw the current frame of a sprite into the render target
+ *                  Sets the draw mode, the caller restores it
+ * @param sprite    Sprite
+*/
+static void SSD1306_drawSprite(const SSD1306_Sprite *sprite)
+{
+    const ImgDef *img = sprite->frames[sprite->frame];
+
+    drawMode = (img->mask != NULL) ? SSD1306_DRAW_MASK : SSD1306_DRAW_OR;
+
+    for (uint8_t section = 0; section < img->imgSections; section++) {
+        uint16_t x = sprite->x + (section * img->imgWidth);
+        const uint16_t *mask = (img->mask != NULL) ? &img->mask[section * img->imgHeight] : NULL;
+
+        if (x >= SSD1306_WIDTH) {
+            break;
+        }
+
+        SSD1306_blitRows(&img->data[section * img->imgHeight], mask, x, sprite->y, img->imgWidth, img->imgHeight, WHITE);
+    }
+}
+
+/**
+ * @brief           Check two images for overlapping pixels
+ *                  The overlap of the bounding boxes is checked first. Inside it every row of both
+ *                  images is lined up 32 columns at a time with shifts and ANDed, returning on the
+ *                  first overlap. Images with a mask collide with their mask, others with their
+ *                  set pixels.
+ * @param a         First image
+ * @param ax        Left column of a
+ * @param ay        Top row of a
+ * @param b         Second image
+ * @param bx        Left column of b
+ * @param by        Top row of b
+ * @return          1 if the images overlap/0 if not
+*/
+uint8_t SSD1306_imgCollide(const ImgDef *a, int16_t ax, int16_t ay, const ImgDef *b, int16_t bx, int16_t by)
+{
+    int16_t x0 = (ax > bx) ? ax : bx;
+    int16_t y0 = (ay > by) ? ay : by;
+    int16_t x1 = ax + (int16_t)(a->imgWidth * a->imgSections);
+    int16_t y1 = ay + (int16_t)a->imgHeight;
+
+    if ((bx + (int16_t)(b->imgWidth * b->imgSections)) < x1) {
+        x1 = bx + (int16_t)(b->imgWidth * b->imgSections);
+    }
+    if ((by + (int16_t)b->imgHeight) < y1) {
+        y1 = by + (int16_t)b->imgHeight;
+    }
+
+    // Bounding boxes do not overlap
+    if ((x0 >= x1) || (y0 >= y1)) {
+        return 0;
+    }
+
+    for (int16_t y = y0; y < y1; y++) {
+        for (int16_t x = x0; x < x1; x += 32) {
+            uint32_t keep = ((x1 - x) < 32) ? ~(0xFFFFFFFFu >> (x1 - x)) : 0xFFFFFFFFu;
+
+            if (SSD1306_imgWindow(a, (uint16_t)(y - ay), x - ax) & SSD1306_imgWindow(b, (uint16_t)(y - by), x - bx) & keep) {
+                return 1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief       Check two sprites for overlapping pixels (see SSD1306_imgCollide())
+ * @param a     First sprite
+ * @param b     Second sprite
+ * @return      1 if both are visible and overlap/0 if not
+*/
+uint8_t SSD1306_spriteCollide(uint8_t a, uint8_t b)
+{
+    SSD1306_Sprite first;
+    SSD1306_Sprite second;
+
+    if ((a >= SSD1306_MAX_SPRITES) || (b >= SSD1306_MAX_SPRITES)) {
+        return 0;
+    }
+
+    // Both positions from the same moment
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    first = sprites[a];
+    second = sprites[b];
+    __set_PRIMASK(primask);
+
+    if ((first.frames == NULL) || (second.frames == NULL) || !first.visible || !second.visible) {
+        return 0;
+    }
+
+    return SSD1306_imgCollide(first.frames[first.frame], first.x, first.y, second.frames[second.frame], second.x, second.y);
+}
+
+/**
+ * @brief           Check a sprite against the set pixels of a frame, e.g. the background
+ *                  Groups of 8 sprite rows are transposed into page bytes, shifted into the one
+ *                  or two pages they touch and ANDed with the frame bytes, returning on the first
+ *                  overlap. Only the part of the sprite on the screen is checked.
+ * @param id        Sprite
+ * @param frame     Frame in the layout of the screenbuffer (1024 bytes)
+ * @return          1 if the visible sprite overlaps set pixels/0 if not
+*/
+uint8_t SSD1306_spriteHitsFrame(uint8_t id, const uint8_t *frame)
+{
+    uint32_t words[4];
+    const uint8_t *columns = (const uint8_t *)words;
+    SSD1306_Sprite sprite;
+
+    if ((id >= SSD1306_MAX_SPRITES) || (frame == NULL)) {
+        return 0;
+    }
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    sprite = sprites[id];
+    __set_PRIMASK(primask);
+
+    if ((sprite.frames == NULL) || !sprite.visible) {
+        return 0;
+    }
+
+    const ImgDef *img = sprite.frames[sprite.frame];
+    const uint16_t *plane = (img->mask != NULL) ? img->mask : img->data;
+
+    for (uint16_t row = 0; (row < img->imgHeight) && ((sprite.y + row) < SSD1306_HEIGHT); row += 8) {
+        uint8_t count = ((img->imgHeight - row) < 8) ? (uint8_t)(img->imgHeight - row) : 8;
+        uint16_t top = sprite.y + row;
+        uint8_t shift = top % 8;
+        const uint8_t *upper = &frame[(top / 8) * SSD1306_WIDTH];
+        const uint8_t *lower = ((top / 8) < ((SSD1306_HEIGHT / 8) - 1)) ? (upper + SSD1306_WIDTH) : NULL;
+
+        for (uint8_t section = 0; section < img->imgSections; section++) {
+            uint16_t x = sprite.x + (section * img->imgWidth);
+
+            if (x >= SSD1306_WIDTH) {
+                break;
+            }
+
+            SSD1306_transposeRows(&plane[(section * img->imgHeight) + row], count, words);
+
+            for (uint8_t j = 0; (j < img->imgWidth) && ((x + j) < SSD1306_WIDTH); j++) {
+                uint8_t bits = columns[j];
+
+                if ((upper[x + j] & (uint8_t)(bits << shift)) ||
+                    ((shift != 0) && (lower != NULL) && (lower[x + j] & (uint8_t)(bits >> (8 - shift))))) {
+                    return 1;
                 }
             }
         }
-        
-        // The current space is now taken
-        SSD1306.xpos += Img.imgWidth;
     }
+
+    return 0;
+}
+
+/**
+ * @brief           Get 32 columns of an image row, bit 31 is the leftmost
+ *                  The sections of the image are shifted into place, columns outside the image are 0
+ * @param img       Image (its mask if it has one)
+ * @param row       Row of the image
+ * @param col       First column, relative to the left edge of the image (may be negative)
+ * @return          Pixels of the row
+*/
+static uint32_t SSD1306_imgWindow(const ImgDef *img, uint16_t row, int16_t col)
+{
+    const uint16_t *plane = (img->mask != NULL) ? img->mask : img->data;
+    int16_t width = img->imgWidth;
+    uint16_t keep = (uint16_t)(0xFFFFu << (16 - width));
+    uint32_t window = 0;
+    int16_t first = (col > 0) ? (col / width) : 0;
+
+    for (int16_t section = first; (section < img->imgSections) && ((section * width) < (col + 32)); section++) {
+        int16_t offset = (section * width) - col;
+        uint32_t bits = (uint32_t)(plane[(section * img->imgHeight) + row] & keep) << 16;
+
+        window |= (offset >= 0) ? (bits >> offset) : (bits << -offset);
+    }
+
+    return window;
 }
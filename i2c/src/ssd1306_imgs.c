@@ -7,6 +7,7 @@
  * as long as all sections have the same height and the image (with all sections) fits in the screen.
 */
 #include "ssd1306_imgs.h"
+#include <stddef.h>
 
 static uint16_t Ryu32x36[] = {
 0x0000,0x0000,0x000F,0x000F,0x3C30,0x3C30,0x0CC0,0x0CC0,0x033C,0x033C,0x0CC3,0x0CC3,0x3CCF,0x3CCF,0x0003,0x0003,0x00C0,0x00C0,0x030F,0x030F,0x03FF,0x03FF,0x0000,0x0000,0x000F,0x000F,0x0000,0x0000,0x003C,0x003C,0x003C,0x003C,0x00FC,0x00FC,0x0000,0x0000,
@@ -23,6 +24,6 @@ static uint16_t DogUp22x20[] = {
 0x0000,0x0000,0x0000,0x0000,0x0000,0xC000,0xC000,0xC000,0xC000,0xC000,0xC000,0xC000,0xC000,0x3000,0x3000,0x3000,0x3000,0x3000,0x3000,0x0000,
 };
 
-ImgDef Ryu_32x36 = {16, 36, Ryu32x36, 2};
-ImgDef DogDown_22x20 = {16, 20, DogDown22x20, 2};
-ImgDef DogUp_22x20 = {16, 20, DogUp22x20, 2};
+ImgDef Ryu_32x36 = {16, 36, Ryu32x36, 2, NULL};
+ImgDef DogDown_22x20 = {16, 20, DogDown22x20, 2, NULL};
+ImgDef DogUp_22x20 = {16, 20, DogUp22x20, 2, NULL};
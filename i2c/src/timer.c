@@ -1,6 +1,11 @@
 /**
  * This module contains code pertaining to the timer driver without the use of the HAL library.
  * Timer 2 is enabled for the GPIO and the System Clock is configured
+ *
+ * TIM2 is a 32-bit timer and runs free at 1 MHz over its whole range, so Time_us() is a monotonic
+ * microsecond clock that wraps every ~71 minutes. The update interrupt counts the wraps and
+ * Time_us64() combines them into a 64-bit clock. Nothing writes CNT after TIM2init(), so delays and
+ * timeouts only compare readings and can run while anything else is timestamping.
  * 
  * More details can be found:
  * - https://github.com/weewStack/STM32F1-Tutorial/blob/master/020-STM32F1_DELAY_FUNCTION_SYSTICK_TIMER/main.c
@@ -15,9 +20,20 @@
 #define PLL_N       180u        // Main PLL multiplication factor for VCO
 #define PLL_P       0           // Main PLL division factor for main system clock (PLLP = 2)
 
+// External oscillator on the Discovery board
+#define HSE_FREQ    8000000u    // HSE crystal frequency in Hz
+#define HSI_FREQ    16000000u   // Internal oscillator frequency in Hz
+
 // Timeout value
 #define TIMER_TIMEOUT    100000u
 
+// Microsecond clock (TIM2)
+#define TIME_TIM_HZ         1000000u    // Counter clock
+#define TIME_IRQ_PRIORITY   3u          // Readers account for a pending wrap, so it can wait behind anything
+
+// Wraps of the 32-bit counter
+static volatile uint32_t timeHigh;
+
 /**
  * @brief       Initialize system clock
  * @return      0 for success/1 for failure
@@ -79,24 +95,89 @@ uint8_t SysClockConfig(void)
 }
 
 /**
- * @brief       Initialize Timer 2
+ * @brief       Get the core clock (HCLK) from the current RCC configuration
+ *              The registers are read back instead of trusting the PLL_x defines, so the
+ *              result is correct whatever SysClockConfig() ended up programming
+ * @return      HCLK frequency in Hz
+*/
+uint32_t SysClockGetHCLK(void)
+{
+    uint32_t sysclk;
+    uint32_t pllm, plln, pllp, pllin;
+
+    switch (RCC->CFGR & RCC_CFGR_SWS) {
+    case RCC_CFGR_SWS_HSE:
+        sysclk = HSE_FREQ;
+        break;
+
+    case RCC_CFGR_SWS_PLL:
+        // SYSCLK = ((PLL input / PLLM) * PLLN) / PLLP
+        pllm = (RCC->PLLCFGR & RCC_PLLCFGR_PLLM) >> RCC_PLLCFGR_PLLM_Pos;
+        plln = (RCC->PLLCFGR & RCC_PLLCFGR_PLLN) >> RCC_PLLCFGR_PLLN_Pos;
+        pllp = ((((RCC->PLLCFGR & RCC_PLLCFGR_PLLP) >> RCC_PLLCFGR_PLLP_Pos) + 1u) * 2u);
+        pllin = (RCC->PLLCFGR & RCC_PLLCFGR_PLLSRC_HSE) ? HSE_FREQ : HSI_FREQ;
+        if (pllm == 0) {
+            return 0;
+        }
+        sysclk = (uint32_t)(((uint64_t)pllin * plln) / pllm / pllp);
+        break;
+
+    default:
+        sysclk = HSI_FREQ;
+        break;
+    }
+
+    return sysclk >> AHBPrescTable[(RCC->CFGR & RCC_CFGR_HPRE) >> RCC_CFGR_HPRE_Pos];
+}
+
+/**
+ * @brief       Get the APB1 peripheral clock (PCLK1) from the current RCC configuration
+ * @return      PCLK1 frequency in Hz
+*/
+uint32_t SysClockGetPCLK1(void)
+{
+    return SysClockGetHCLK() >> APBPrescTable[(RCC->CFGR & RCC_CFGR_PPRE1) >> RCC_CFGR_PPRE1_Pos];
+}
+
+/**
+ * @brief       Initialize Timer 2 as the free-running microsecond clock
  * @return      0 for success/1 for failure
 */
 uint8_t TIM2init(void)
 {
     uint32_t counter = 0;
+    uint32_t timclk = SysClockGetPCLK1();
+
+    // APB1 timers run at twice PCLK1 when the APB1 prescaler divides (RM0368 6.2: Clocks)
+    if (RCC->CFGR & RCC_CFGR_PPRE1_2) {
+        timclk *= 2u;
+    }
+    if (timclk < TIME_TIM_HZ) {
+        return 1;
+    }
 
     // 1. Enable Timer clock
     RCC->APB1ENR |= RCC_APB1ENR_TIM2EN;
 
     // 2. Set the prescalar and the ARR
     //    Prescalar formula: F_ck_psc / (PSC[15:0] + 1)
-    TIM2->PSC = 90 - 1;     // 90MHz / 90 = 1 MHz ~ 1uS delay
-    TIM2->ARR = 0xFFFF;     // MAX ARR Value
+    TIM2->CR1 = 0;
+    TIM2->PSC = (timclk / TIME_TIM_HZ) - 1u;   // 1 MHz ~ 1uS per count
+    TIM2->ARR = 0xFFFFFFFFu;                    // Full 32-bit range
 
-    // 3. Enable the Timer, and wait for the update interrupt flag to set
-    TIM2->CR1 |= (1u << 0);
-    while (!(TIM2->SR & (1u << 0))) {
+    // 3. Load the prescaler now (UG) without counting it as a wrap
+    TIM2->EGR = TIM_EGR_UG;
+    TIM2->SR = 0;
+    timeHigh = 0;
+
+    // 4. Count the wraps for Time_us64()
+    TIM2->DIER = TIM_DIER_UIE;
+    NVIC_SetPriority(TIM2_IRQn, TIME_IRQ_PRIORITY);
+    NVIC_EnableIRQ(TIM2_IRQn);
+
+    // 5. Enable the Timer, and wait for it to count
+    TIM2->CR1 |= TIM_CR1_CEN;
+    while (TIM2->CNT == 0) {
         if (counter >= TIMER_TIMEOUT) {
             return 1;
         }
@@ -106,27 +187,99 @@ uint8_t TIM2init(void)
     return 0;
 }
 
+/**
+ * @brief       Read the microsecond clock
+ *              Subtract two readings (unsigned) to get the time in between, up to ~71 minutes
+ * @return      Microseconds since TIM2init(), modulo 2^32
+*/
+uint32_t Time_us(void)
+{
+    return TIM2->CNT;
+}
+
+/**
+ * @brief       Read the microsecond clock extended to 64 bits
+ *              Safe with interrupts disabled or from an interrupt that preempts the wrap count
+ * @return      Microseconds since TIM2init()
+*/
+uint64_t Time_us64(void)
+{
+    uint32_t high, low;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    high = timeHigh;
+    low = TIM2->CNT;
+
+    // A wrap that has not been counted yet: the low half was read after it
+    if ((TIM2->SR & TIM_SR_UIF) && (low < 0x80000000u)) {
+        high++;
+    }
+
+    __set_PRIMASK(primask);
+
+    return ((uint64_t)high << 32) | low;
+}
+
+/**
+ * @brief           Time since an earlier Time_us() reading
+ * @param since     Earlier reading
+ * @return          Microseconds elapsed (correct across a wrap)
+*/
+uint32_t Time_elapsedUs(uint32_t since)
+{
+    return TIM2->CNT - since;
+}
+
+/**
+ * @brief           Wait until the microsecond clock reaches a point in time
+ *                  Add a period to the previous deadline for a loop that does not drift.
+ *                  A deadline already passed (by less than ~35 minutes) returns at once.
+ * @param deadline  Time_us() value to wait for
+*/
+void Delay_untilUs(uint32_t deadline)
+{
+    while ((int32_t)(deadline - TIM2->CNT) > 0);
+}
+
 /**
  * @brief       Delay for x amount of microseconds
  * @param us    Amount of time, in uS, to delay
 */
-void Delay_us(uint16_t us)
+void Delay_us(uint32_t us)
 {
-    // 1. Reset the counter
-    TIM2->CNT = 0;
+    uint32_t start = TIM2->CNT;
 
-    // 2. Wait for the counter to reach the entered value. As each count
-    //    will take 1us, the total waiting time will be the required us delay
-    while (TIM2->CNT < us);
+    // Wait for the clock to advance by the entered value. As each count
+    // will take 1us, the total waiting time will be the required us delay
+    while ((TIM2->CNT - start) < us);
 }
 
 /**
  * @brief       Delay for x amount of miliseconds
  * @param ms    Amount of time, in mS, to delay
 */
-void Delay_ms(uint16_t ms)
+void Delay_ms(uint32_t ms)
+{
+    uint64_t deadline = Time_us64() + ((uint64_t)ms * 1000u);
+
+    while (Time_us64() < deadline);
+}
+
+/**
+ * @brief   Interrupt for TIM2 (wrap of the microsecond clock)
+*/
+void TIM2_IRQHandler(void)
 {
-    for (uint16_t i = 0; i < ms; i++) {
-        Delay_us(1000);     // Delay of 1 ms
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    // Count the wrap and clear the flag together, Time_us64() uses the flag while it is pending
+    if (TIM2->SR & TIM_SR_UIF) {
+        TIM2->SR = ~TIM_SR_UIF;
+        timeHigh++;
     }
+
+    __set_PRIMASK(primask);
 }
@@ -0,0 +1,1072 @@
+/**
+ * Peripheral model behind the fake device header, see fake_mcu.h.
+ * Register accesses are dispatched on the address of the FakeReg. Only the behaviour the drivers
+ * depend on is modelled, following RM0368 (I2C 18.3.3: Master mode, DMA 9.3: DMA functional
+ * description, TIM 13.3: TIM2 to TIM5 functional description, CRC 4.3).
+*/
+
+#include "fake_mcu.h"
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+#define FAKE_STEP_NS            500u        // Longest step of the models between interrupt checks
+#define FAKE_LIMIT_NS           20000000000ull  // Default time limit of a test (20 s)
+#define FAKE_WATCHDOG_S         120u        // Host time limit of a test (waits that touch no register)
+#define FAKE_STACK_SIZE         (16u << 20)
+#define FAKE_IRQS               64u
+#define FAKE_IRQ_STORM          100000u     // Back to back entries of one interrupt without time passing
+
+// I2C SR1 flags
+#define SR1_SB                  (1u << 0)
+#define SR1_ADDR                (1u << 1)
+#define SR1_BTF                 (1u << 2)
+#define SR1_TXE                 (1u << 7)
+#define SR1_AF                  (1u << 10)
+#define SR1_ERRORS              0x5F00u
+
+// I2C CR1/CR2 bits
+#define CR1_START               (1u << 8)
+#define CR1_STOP                (1u << 9)
+#define CR1_SWRST               (1u << 15)
+#define CR2_ITERREN             (1u << 8)
+#define CR2_ITEVTEN             (1u << 9)
+#define CR2_ITBUFEN             (1u << 10)
+#define CR2_DMAEN               (1u << 11)
+
+// Registers
+I2C_TypeDef fake_I2C1;
+DMA_TypeDef fake_DMA1, fake_DMA2;
+DMA_Stream_TypeDef fake_DMA1_Stream6, fake_DMA2_Stream0;
+RCC_TypeDef fake_RCC;
+GPIO_TypeDef fake_GPIOA, fake_GPIOB, fake_GPIOC;
+TIM_TypeDef fake_TIM2, fake_TIM3;
+EXTI_TypeDef fake_EXTI;
+SYSCFG_TypeDef fake_SYSCFG;
+CRC_TypeDef fake_CRC;
+PWR_TypeDef fake_PWR;
+FLASH_TypeDef fake_FLASH;
+
+const uint8_t AHBPrescTable[16] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 2, 3, 4, 6, 7, 8, 9};
+const uint8_t APBPrescTable[8] = {0, 0, 0, 0, 1, 2, 3, 4};
+
+FakeState fake;
+
+// Interrupt handlers of the drivers
+void I2C1_EV_IRQHandler(void) __attribute__((weak));
+void I2C1_ER_IRQHandler(void) __attribute__((weak));
+void DMA1_Stream6_IRQHandler(void) __attribute__((weak));
+void DMA2_Stream0_IRQHandler(void) __attribute__((weak));
+void TIM2_IRQHandler(void) __attribute__((weak));
+void TIM3_IRQHandler(void) __attribute__((weak));
+void EXTI4_IRQHandler(void) __attribute__((weak));
+void EXTI9_5_IRQHandler(void) __attribute__((weak));
+
+// I2C master transmitter
+typedef enum {
+    BUS_IDLE = 0,       // No transaction
+    BUS_STARTING,       // Generating a (repeated) START
+    BUS_SB,             // START sent, waiting for the address in DR
+    BUS_ADDRESS,        // Shifting the address byte
+    BUS_ADDR,           // Address acknowledged, waiting for ADDR to be cleared
+    BUS_NACK,           // Address or data not acknowledged, waiting for a STOP or a repeated START
+    BUS_DATA,           // Transmitting data
+    BUS_STOPPING,       // Generating a STOP
+} BusPhase;
+
+static struct {
+    BusPhase phase;
+    uint64_t waitNs;    // Time left of the START/byte/STOP being generated
+    uint32_t flags;     // SB, ADDR, BTF and the error flags
+    uint8_t dr;         // Data register
+    uint8_t drFull;     // Written and not yet moved to the shift register
+    uint8_t shifting;   // A data byte is on the wire
+    uint8_t shiftByte;
+} bus;
+
+// SSD1306 link layer
+static struct {
+    uint8_t expectControl;  // Next byte is a control byte
+    uint8_t single;         // Control byte had Co set, one byte follows
+    uint8_t data;           // D/C# of the bytes that follow
+    uint8_t cmd[8];         // Command being collected
+    uint8_t cmdLen;
+    uint8_t pageColStart;   // Column start of page addressing (00h~1Fh)
+    uint64_t scrollNs;      // Time since the last scroll step
+} panelLink;
+
+// DMA stream state latched when the stream is enabled
+typedef struct {
+    uint32_t reload;    // NDTR programmed
+    uint32_t base;      // M0AR programmed
+    uint64_t waitNs;    // Memory-to-memory: time left of the transfer
+} StreamState;
+
+static StreamState dma1s6, dma2s0;
+
+// Timer state
+typedef struct {
+    uint64_t accNs;     // Time since the last count
+} TimState;
+
+static TimState tim2, tim3;
+
+static uint32_t crcValue;
+
+// NVIC and core
+static uint8_t irqEnabled[FAKE_IRQS];
+static uint8_t irqPriority[FAKE_IRQS];
+static uint32_t primask;
+static uint32_t activePriority;
+static uint32_t stormCount;
+static uint64_t stormNs;
+
+// Test runner
+static ucontext_t mainContext, testContext;
+static const char *testName;
+static FakeTestFn testFn;
+static int testFailed;
+
+static void advance(uint64_t ns);
+static void abortTest(const char *why);
+
+/**
+ * @brief   Time of one SCL period from CR2 FREQ and CCR (RM0368 18.6.8: I2C_CCR)
+*/
+static uint64_t busBitNs(void)
+{
+    uint32_t freq = fake_I2C1.CR2.value & 0x3Fu;
+    uint32_t ccr = fake_I2C1.CCR.value;
+    uint32_t cycles;
+
+    if ((freq == 0) || ((ccr & 0xFFFu) == 0)) {
+        return 2500u;
+    }
+    if (ccr & (1u << 15)) {
+        cycles = (ccr & 0xFFFu) * ((ccr & (1u << 14)) ? 25u : 3u);
+    } else {
+        cycles = (ccr & 0xFFFu) * 2u;
+    }
+    return ((uint64_t)cycles * 1000u) / freq;
+}
+
+static uint32_t busSr1(void)
+{
+    uint32_t sr1 = bus.flags;
+
+    if ((bus.phase == BUS_DATA) && !bus.drFull) {
+        sr1 |= SR1_TXE;
+    }
+    return sr1;
+}
+
+/**
+ * @brief   Panel command with all of its arguments collected
+*/
+static void panelCommand(const uint8_t *c)
+{
+    FakePanel *p = &fake.panel;
+
+    if (c[0] <= 0x0Fu) {
+        panelLink.pageColStart = (panelLink.pageColStart & 0xF0u) | c[0];
+        p->col = panelLink.pageColStart;
+    } else if (c[0] <= 0x1Fu) {
+        panelLink.pageColStart = (uint8_t)((panelLink.pageColStart & 0x0Fu) | ((c[0] & 0x07u) << 4));
+        p->col = panelLink.pageColStart;
+    } else if (c[0] == 0x20u) {
+        p->addressing = c[1] & 3u;
+    } else if (c[0] == 0x21u) {
+        p->colStart = c[1] & 0x7Fu;
+        p->colEnd = c[2] & 0x7Fu;
+        p->col = p->colStart;
+    } else if (c[0] == 0x22u) {
+        p->pageStart = c[1] & 7u;
+        p->pageEnd = c[2] & 7u;
+        p->page = p->pageStart;
+    } else if ((c[0] == 0x26u) || (c[0] == 0x27u) || (c[0] == 0x29u) || (c[0] == 0x2Au)) {
+        memcpy(p->scrollSetup, c, sizeof(p->scrollSetup));
+    } else if (c[0] == 0x2Eu) {
+        p->scrolling = 0;
+    } else if (c[0] == 0x2Fu) {
+        p->scrolling = 1;
+        panelLink.scrollNs = 0;
+    } else if ((c[0] >= 0x40u) && (c[0] <= 0x7Fu)) {
+        p->startLine = c[0] & 0x3Fu;
+    } else if ((c[0] >= 0xB0u) && (c[0] <= 0xB7u)) {
+        p->page = c[0] & 7u;
+    }
+}
+
+/**
+ * @brief   Number of argument bytes of a command (SSD1306 datasheet 9: Command Table)
+*/
+static uint8_t panelArgs(uint8_t c)
+{
+    switch (c) {
+    case 0x20: case 0x81: case 0x8D: case 0xA8: case 0xD3: case 0xD5: case 0xD9: case 0xDA: case 0xDB:
+        return 1;
+    case 0x21: case 0x22: case 0xA3:
+        return 2;
+    case 0x29: case 0x2A:
+        return 5;
+    case 0x26: case 0x27:
+        return 6;
+    default:
+        return 0;
+    }
+}
+
+static void panelData(uint8_t b)
+{
+    FakePanel *p = &fake.panel;
+
+    p->gram[p->page & 7u][p->col & 0x7Fu] = b;
+    p->dataBytes++;
+
+    switch (p->addressing) {
+    case 0:
+        if (p->col >= p->colEnd) {
+            p->col = p->colStart;
+            p->page = (p->page >= p->pageEnd) ? p->pageStart : (uint8_t)(p->page + 1u);
+        } else {
+            p->col++;
+        }
+        break;
+
+    case 1:
+        if (p->page >= p->pageEnd) {
+            p->page = p->pageStart;
+            p->col = (p->col >= p->colEnd) ? p->colStart : (uint8_t)(p->col + 1u);
+        } else {
+            p->page++;
+        }
+        break;
+
+    default:
+        p->col = (p->col >= 127u) ? panelLink.pageColStart : (uint8_t)(p->col + 1u);
+        break;
+    }
+}
+
+/**
+ * @brief   Byte acknowledged by the panel after its address
+*/
+static void panelByte(uint8_t b)
+{
+    if (panelLink.expectControl) {
+        panelLink.single = (b & 0x80u) ? 1 : 0;
+        panelLink.data = (b & 0x40u) ? 1 : 0;
+        panelLink.expectControl = 0;
+        return;
+    }
+
+    if (panelLink.data) {
+        panelData(b);
+    } else {
+        fake.panel.commandBytes++;
+        panelLink.cmd[panelLink.cmdLen++] = b;
+        if (panelLink.cmdLen > panelArgs(panelLink.cmd[0])) {
+            panelCommand(panelLink.cmd);
+            panelLink.cmdLen = 0;
+        }
+    }
+    if (panelLink.single) {
+        panelLink.expectControl = 1;
+    }
+}
+
+/**
+ * @brief   Move a byte from DR to the shift register
+*/
+static void busLoad(void)
+{
+    bus.shiftByte = bus.dr;
+    bus.drFull = 0;
+    bus.shifting = 1;
+    bus.waitNs = busBitNs() * 9u;
+    bus.flags &= ~SR1_BTF;
+}
+
+static void busDataWrite(uint8_t v)
+{
+    switch (bus.phase) {
+    case BUS_SB:
+        bus.flags &= ~SR1_SB;
+        bus.shiftByte = v;
+        bus.phase = BUS_ADDRESS;
+        bus.waitNs = busBitNs() * 9u;
+        fake.txns.back().address = v;
+        break;
+
+    case BUS_ADDR:
+        // A (void) read of SR2 cannot be observed on the host, a write to DR clears ADDR as well
+        bus.flags &= ~SR1_ADDR;
+        bus.phase = BUS_DATA;
+        // fall through
+
+    case BUS_DATA:
+        if (bus.drFull) {
+            fake.dropped++;
+        }
+        bus.dr = v;
+        bus.drFull = 1;
+        bus.flags &= ~SR1_BTF;
+        break;
+
+    default:
+        fake.dropped++;
+        break;
+    }
+}
+
+/**
+ * @brief   DMA1 Stream 6 serves a TXE request
+*/
+static uint8_t dma1Request(void)
+{
+    DMA_Stream_TypeDef *s = &fake_DMA1_Stream6;
+
+    if (!(s->CR.value & DMA_SxCR_EN) || !(fake_I2C1.CR2.value & CR2_DMAEN) || !(busSr1() & SR1_TXE)) {
+        return 0;
+    }
+
+    const uint8_t *src = (const uint8_t *)(uintptr_t)dma1s6.base;
+    uint32_t index = (s->CR.value & DMA_SxCR_MINC) ? (dma1s6.reload - s->NDTR.value) : 0;
+
+    busDataWrite(src[index]);
+    fake.dmaBytes++;
+
+    s->NDTR.value--;
+    if (s->NDTR.value == (dma1s6.reload / 2u)) {
+        fake_DMA1.HISR.value |= DMA_HISR_HTIF6;
+    }
+    if (s->NDTR.value == 0) {
+        fake_DMA1.HISR.value |= DMA_HISR_TCIF6;
+        if (s->CR.value & DMA_SxCR_CIRC) {
+            s->NDTR.value = dma1s6.reload;
+        } else {
+            s->CR.value &= ~DMA_SxCR_EN;
+        }
+    }
+    return 1;
+}
+
+/**
+ * @brief   Changes that happen without time passing
+ * @return  1 if something changed
+*/
+static uint8_t busImmediate(void)
+{
+    uint32_t cr1 = fake_I2C1.CR1.value;
+
+    if (fake.busStuck || !(cr1 & 1u)) {
+        return 0;
+    }
+
+    if (dma1Request()) {
+        return 1;
+    }
+
+    switch (bus.phase) {
+    case BUS_IDLE:
+        if (cr1 & CR1_STOP) {
+            fake_I2C1.CR1.value &= ~CR1_STOP;
+            return 1;
+        }
+        if (cr1 & CR1_START) {
+            bus.phase = BUS_STARTING;
+            bus.waitNs = busBitNs();
+            return 1;
+        }
+        break;
+
+    case BUS_SB:
+    case BUS_ADDR:
+    case BUS_NACK:
+    case BUS_DATA:
+        if (bus.shifting) {
+            break;
+        }
+        if (cr1 & CR1_STOP) {
+            if (bus.drFull) {
+                fake.dropped++;
+                bus.drFull = 0;
+            }
+            // BTF is cleared once the STOP is on the bus
+            bus.flags &= ~(SR1_SB | SR1_ADDR);
+            bus.phase = BUS_STOPPING;
+            bus.waitNs = busBitNs();
+            fake.txns.back().stopped = 1;
+            return 1;
+        }
+        if (((bus.phase == BUS_DATA) || (bus.phase == BUS_NACK)) && (cr1 & CR1_START) && !bus.drFull) {
+            // Repeated START (also after a NACK), BTF is cleared once it is on the bus
+            bus.phase = BUS_STARTING;
+            bus.waitNs = busBitNs();
+            return 1;
+        }
+        if ((bus.phase == BUS_DATA) && bus.drFull) {
+            busLoad();
+            return 1;
+        }
+        break;
+
+    default:
+        break;
+    }
+    return 0;
+}
+
+/**
+ * @brief   End of the START/byte/STOP being generated
+*/
+static void busTimed(void)
+{
+    switch (bus.phase) {
+    case BUS_STARTING:
+        fake_I2C1.CR1.value &= ~CR1_START;
+        bus.flags = (bus.flags & ~SR1_BTF) | SR1_SB;
+        bus.phase = BUS_SB;
+        fake.txns.push_back(FakeTxn());
+        fake.txns.back().stopped = 0;
+        break;
+
+    case BUS_ADDRESS:
+        if ((bus.shiftByte & 0xFEu) == FAKE_SSD1306_ADDRESS) {
+            bus.flags |= SR1_ADDR;
+            bus.phase = BUS_ADDR;
+            panelLink.expectControl = 1;
+            panelLink.cmdLen = 0;
+        } else {
+            bus.flags |= SR1_AF;
+            bus.phase = BUS_NACK;
+        }
+        break;
+
+    case BUS_DATA:
+        bus.shifting = 0;
+        if ((fake.nackAfter != 0) && (fake.txns.back().bytes.size() >= fake.nackAfter)) {
+            // Not acknowledged: the transmission stops and a byte waiting in DR is not sent
+            bus.flags |= SR1_AF;
+            bus.phase = BUS_NACK;
+            bus.drFull = 0;
+            break;
+        }
+        fake.txns.back().bytes.push_back(bus.shiftByte);
+        panelByte(bus.shiftByte);
+        if (!bus.drFull) {
+            bus.flags |= SR1_BTF;
+        }
+        break;
+
+    case BUS_STOPPING:
+        fake_I2C1.CR1.value &= ~CR1_STOP;
+        bus.flags &= ~SR1_BTF;
+        bus.phase = BUS_IDLE;
+        break;
+
+    default:
+        break;
+    }
+}
+
+static uint8_t busTiming(void)
+{
+    return (bus.phase == BUS_STARTING) || (bus.phase == BUS_ADDRESS) || (bus.phase == BUS_STOPPING) ||
+           ((bus.phase == BUS_DATA) && bus.shifting);
+}
+
+static void busStep(uint64_t ns)
+{
+    for (;;) {
+        while (busImmediate());
+
+        if ((ns == 0) || fake.busStuck || !busTiming()) {
+            return;
+        }
+
+        uint64_t d = (bus.waitNs < ns) ? bus.waitNs : ns;
+        bus.waitNs -= d;
+        ns -= d;
+        if (bus.waitNs == 0) {
+            busTimed();
+        }
+    }
+}
+
+/**
+ * @brief   DMA2 Stream 0 memory-to-memory transfer, done in one go at the end of its time
+*/
+static void dma2Step(uint64_t ns)
+{
+    DMA_Stream_TypeDef *s = &fake_DMA2_Stream0;
+
+    if (!(s->CR.value & DMA_SxCR_EN)) {
+        return;
+    }
+    if (dma2s0.waitNs > ns) {
+        dma2s0.waitNs -= ns;
+        return;
+    }
+
+    // A transfer error disables the stream, as the hardware does
+    if (fake.memDmaError) {
+        fake.memDmaError = 0;
+        s->CR.value &= ~DMA_SxCR_EN;
+        fake_DMA2.LISR.value |= DMA_LISR_TEIF0;
+        return;
+    }
+
+    uint32_t *dst = (uint32_t *)(uintptr_t)dma2s0.base;
+    const uint32_t *src = (const uint32_t *)(uintptr_t)s->PAR.value;
+
+    for (uint32_t i = 0; i < dma2s0.reload; i++) {
+        dst[i] = (s->CR.value & DMA_SxCR_PINC) ? src[i] : src[0];
+    }
+    s->NDTR.value = 0;
+    s->CR.value &= ~DMA_SxCR_EN;
+    fake_DMA2.LISR.value |= DMA_LISR_TCIF0;
+    fake.memDmaTransfers++;
+}
+
+/**
+ * @brief   Timer clock: twice PCLK1 when APB1 is divided (RM0368 6.2: Clocks)
+*/
+static uint32_t timClock(void)
+{
+    uint32_t ppre1 = (fake_RCC.CFGR.value & RCC_CFGR_PPRE1) >> RCC_CFGR_PPRE1_Pos;
+    uint32_t pclk1 = FAKE_HCLK >> APBPrescTable[ppre1];
+
+    return (ppre1 & 4u) ? (pclk1 * 2u) : pclk1;
+}
+
+static void timStep(TIM_TypeDef *t, TimState *st, uint64_t ns)
+{
+    if (!(t->CR1.value & TIM_CR1_CEN)) {
+        return;
+    }
+
+    uint64_t periodNs = ((uint64_t)(t->PSC.value + 1u) * 1000000000ull) / timClock();
+
+    st->accNs += ns;
+    while (st->accNs >= periodNs) {
+        st->accNs -= periodNs;
+        if (t->CNT.value >= t->ARR.value) {
+            t->CNT.value = 0;
+            t->SR.value |= TIM_SR_UIF;
+        } else {
+            t->CNT.value++;
+        }
+    }
+}
+
+static uint8_t irqPending(uint32_t irq)
+{
+    uint32_t cr2 = fake_I2C1.CR2.value;
+    uint32_t sr1 = busSr1();
+    uint32_t cr;
+
+    switch (irq) {
+    case I2C1_EV_IRQn:
+        return (cr2 & CR2_ITEVTEN) &&
+               ((sr1 & (SR1_SB | SR1_ADDR | SR1_BTF)) || ((cr2 & CR2_ITBUFEN) && (sr1 & SR1_TXE)));
+    case I2C1_ER_IRQn:
+        return (cr2 & CR2_ITERREN) && (sr1 & SR1_ERRORS);
+    case DMA1_Stream6_IRQn:
+        cr = fake_DMA1_Stream6.CR.value;
+        return ((cr & DMA_SxCR_TCIE) && (fake_DMA1.HISR.value & DMA_HISR_TCIF6)) ||
+               ((cr & DMA_SxCR_HTIE) && (fake_DMA1.HISR.value & DMA_HISR_HTIF6)) ||
+               ((cr & DMA_SxCR_TEIE) && (fake_DMA1.HISR.value & DMA_HISR_TEIF6));
+    case DMA2_Stream0_IRQn:
+        cr = fake_DMA2_Stream0.CR.value;
+        return ((cr & DMA_SxCR_TCIE) && (fake_DMA2.LISR.value & DMA_LISR_TCIF0)) ||
+               ((cr & DMA_SxCR_TEIE) && (fake_DMA2.LISR.value & DMA_LISR_TEIF0));
+    case TIM2_IRQn:
+        return (fake_TIM2.DIER.value & TIM_DIER_UIE) && (fake_TIM2.SR.value & TIM_SR_UIF);
+    case TIM3_IRQn:
+        return (fake_TIM3.DIER.value & TIM_DIER_UIE) && (fake_TIM3.SR.value & TIM_SR_UIF);
+    case EXTI4_IRQn:
+        return (fake_EXTI.PR.value & fake_EXTI.IMR.value & (1u << 4)) ? 1 : 0;
+    case EXTI9_5_IRQn:
+        return (fake_EXTI.PR.value & fake_EXTI.IMR.value & (0x1Fu << 5)) ? 1 : 0;
+    default:
+        return 0;
+    }
+}
+
+static void irqCall(uint32_t irq)
+{
+    switch (irq) {
+    case I2C1_EV_IRQn:      if (I2C1_EV_IRQHandler) I2C1_EV_IRQHandler(); break;
+    case I2C1_ER_IRQn:      if (I2C1_ER_IRQHandler) I2C1_ER_IRQHandler(); break;
+    case DMA1_Stream6_IRQn: if (DMA1_Stream6_IRQHandler) DMA1_Stream6_IRQHandler(); break;
+    case DMA2_Stream0_IRQn: if (DMA2_Stream0_IRQHandler) DMA2_Stream0_IRQHandler(); break;
+    case TIM2_IRQn:         if (TIM2_IRQHandler) TIM2_IRQHandler(); break;
+    case TIM3_IRQn:         if (TIM3_IRQHandler) TIM3_IRQHandler(); break;
+    case EXTI4_IRQn:        if (EXTI4_IRQHandler) EXTI4_IRQHandler(); break;
+    case EXTI9_5_IRQn:      if (EXTI9_5_IRQHandler) EXTI9_5_IRQHandler(); break;
+    default: break;
+    }
+}
+
+/**
+ * @brief   Take the pending interrupts that may preempt what is running
+*/
+static void irqService(void)
+{
+    static const uint32_t irqs[] = {I2C1_EV_IRQn, I2C1_ER_IRQn, DMA1_Stream6_IRQn, DMA2_Stream0_IRQn,
+                                    TIM2_IRQn, TIM3_IRQn, EXTI4_IRQn, EXTI9_5_IRQn};
+
+    while (!primask && (fake.nowNs >= fake.irqHoldNs)) {
+        uint32_t best = FAKE_IRQS;
+        uint32_t bestPriority = activePriority;
+
+        for (uint32_t i = 0; i < sizeof(irqs) / sizeof(irqs[0]); i++) {
+            uint32_t irq = irqs[i];
+            if (irqEnabled[irq] && (irqPriority[irq] < bestPriority) && irqPending(irq)) {
+                best = irq;
+                bestPriority = irqPriority[irq];
+            }
+        }
+        if (best == FAKE_IRQS) {
+            return;
+        }
+
+        if (stormNs != fake.nowNs) {
+            stormNs = fake.nowNs;
+            stormCount = 0;
+        }
+        if (++stormCount > FAKE_IRQ_STORM) {
+            abortTest("interrupt storm: a handler returns without clearing its source");
+        }
+
+        uint32_t saved = activePriority;
+        activePriority = irqPriority[best];
+        uint64_t t0 = fake.nowNs;
+        fake.irqCount[best]++;
+        irqCall(best);
+        if ((fake.nowNs - t0) > fake.irqMaxNs[best]) {
+            fake.irqMaxNs[best] = fake.nowNs - t0;
+        }
+        activePriority = saved;
+    }
+}
+
+/**
+ * @brief   Continuous scroll (10.3: Graphic Acceleration Command)
+ *          Every interval the GDDRAM of the scrolled pages turns one column, columns leaving one side
+ *          come back on the other. A vertical scroll also moves the display start line up by its
+ *          offset (the driver always sets the vertical scroll area to the whole screen).
+*/
+static void panelStep(uint64_t ns)
+{
+    // Frames per step, by the interval code of the setup command
+    static const uint16_t frames[8] = {5, 64, 128, 256, 3, 4, 25, 2};
+    FakePanel *p = &fake.panel;
+    const uint8_t *s = p->scrollSetup;
+
+    if (!p->scrolling) {
+        return;
+    }
+
+    uint64_t stepNs = (uint64_t)frames[s[3] & 7u] * FAKE_PANEL_FRAME_NS;
+    uint8_t left = (s[0] == 0x27u) || (s[0] == 0x2Au);
+    uint8_t vertical = (s[0] == 0x29u) || (s[0] == 0x2Au);
+
+    panelLink.scrollNs += ns;
+    while (panelLink.scrollNs >= stepNs) {
+        panelLink.scrollNs -= stepNs;
+
+        for (uint8_t page = s[2] & 7u; page <= (s[4] & 7u); page++) {
+            uint8_t *row = p->gram[page];
+            uint8_t keep;
+
+            if (left) {
+                keep = row[0];
+                memmove(row, row + 1, 127);
+                row[127] = keep;
+            } else {
+                keep = row[127];
+                memmove(row + 1, row, 127);
+                row[0] = keep;
+            }
+        }
+        if (vertical) {
+            p->startLine = (uint8_t)((p->startLine + s[5]) & 63u);
+        }
+        p->scrollSteps++;
+    }
+}
+
+static void advance(uint64_t ns)
+{
+    while (ns) {
+        uint64_t d = (ns < FAKE_STEP_NS) ? ns : FAKE_STEP_NS;
+
+        fake.nowNs += d;
+        ns -= d;
+        busStep(d);
+        dma2Step(d);
+        panelStep(d);
+        timStep(&fake_TIM2, &tim2, d);
+        timStep(&fake_TIM3, &tim3, d);
+
+        if (fake.nowNs > fake.limitNs) {
+            abortTest("time limit exceeded (unbounded wait?)");
+        }
+        irqService();
+    }
+}
+
+static uint32_t regRead(const FakeReg *r)
+{
+    advance(FAKE_ACCESS_NS);
+
+    if (r == &fake_I2C1.SR1) {
+        return busSr1();
+    }
+    if (r == &fake_I2C1.SR2) {
+        uint32_t sr2 = 0;
+        if ((bus.phase != BUS_IDLE) || fake.busStuck) {
+            sr2 |= (1u << 0) | (1u << 1);       // MSL | BUSY
+        }
+        if ((bus.phase == BUS_ADDR) || (bus.phase == BUS_DATA)) {
+            sr2 |= (1u << 2);                   // TRA
+        }
+        if (bus.phase == BUS_ADDR) {
+            bus.flags &= ~SR1_ADDR;
+            bus.phase = BUS_DATA;
+        }
+        return sr2;
+    }
+    if (r == &fake_I2C1.DR) {
+        // Reading DR clears BTF (RM0368 18.6.6: I2C_SR1)
+        bus.flags &= ~SR1_BTF;
+        return bus.dr;
+    }
+    if ((r == &fake_DMA1.HIFCR) || (r == &fake_DMA1.LIFCR) || (r == &fake_DMA2.HIFCR) || (r == &fake_DMA2.LIFCR)) {
+        return 0;
+    }
+    if (r == &fake_RCC.CR) {
+        uint32_t v = r->value;
+        return v | ((v & RCC_CR_HSEON) << 1) | ((v & RCC_CR_PLLON) << 1);
+    }
+    if (r == &fake_RCC.CFGR) {
+        return (r->value & ~RCC_CFGR_SWS) | ((r->value & 3u) << 2);
+    }
+    if (r == &fake_CRC.DR) {
+        return crcValue;
+    }
+    return r->value;
+}
+
+static void streamWriteCR(DMA_Stream_TypeDef *s, StreamState *st, uint32_t v, uint8_t mem)
+{
+    uint32_t old = s->CR.value;
+
+    // Everything but EN is read-only while the stream is enabled
+    if (old & DMA_SxCR_EN) {
+        v = (old & ~DMA_SxCR_EN) | (v & DMA_SxCR_EN);
+    }
+    s->CR.value = v;
+
+    if (!(old & DMA_SxCR_EN) && (v & DMA_SxCR_EN)) {
+        st->reload = s->NDTR.value;
+        st->base = s->M0AR.value;
+        st->waitNs = mem ? ((uint64_t)st->reload * 25u) : 0;
+    }
+}
+
+static void regWrite(FakeReg *r, uint32_t v)
+{
+    if (r == &fake_I2C1.DR) {
+        busDataWrite((uint8_t)v);
+    } else if (r == &fake_I2C1.SR1) {
+        // Error flags are rc_w0
+        bus.flags &= (v | ~SR1_ERRORS);
+    } else if (r == &fake_I2C1.CR1) {
+        if (v & CR1_SWRST) {
+            memset(&bus, 0, sizeof(bus));
+        }
+        r->value = v;
+    } else if ((r == &fake_DMA1_Stream6.CR) || (r == &fake_DMA2_Stream0.CR)) {
+        uint8_t mem = (r == &fake_DMA2_Stream0.CR);
+        streamWriteCR(mem ? &fake_DMA2_Stream0 : &fake_DMA1_Stream6, mem ? &dma2s0 : &dma1s6, v, mem);
+    } else if ((r == &fake_DMA1_Stream6.NDTR) || (r == &fake_DMA1_Stream6.M0AR) || (r == &fake_DMA1_Stream6.PAR)) {
+        if (!(fake_DMA1_Stream6.CR.value & DMA_SxCR_EN)) {
+            r->value = v;
+        }
+    } else if ((r == &fake_DMA2_Stream0.NDTR) || (r == &fake_DMA2_Stream0.M0AR) || (r == &fake_DMA2_Stream0.PAR)) {
+        if (!(fake_DMA2_Stream0.CR.value & DMA_SxCR_EN)) {
+            r->value = v;
+        }
+    } else if (r == &fake_DMA1.HIFCR) {
+        fake_DMA1.HISR.value &= ~v;
+    } else if (r == &fake_DMA1.LIFCR) {
+        fake_DMA1.LISR.value &= ~v;
+    } else if (r == &fake_DMA2.HIFCR) {
+        fake_DMA2.HISR.value &= ~v;
+    } else if (r == &fake_DMA2.LIFCR) {
+        fake_DMA2.LISR.value &= ~v;
+    } else if ((r == &fake_TIM2.SR) || (r == &fake_TIM3.SR)) {
+        r->value &= v;
+    } else if ((r == &fake_TIM2.EGR) || (r == &fake_TIM3.EGR)) {
+        TIM_TypeDef *t = (r == &fake_TIM2.EGR) ? &fake_TIM2 : &fake_TIM3;
+        if (v & TIM_EGR_UG) {
+            t->CNT.value = 0;
+            t->SR.value |= TIM_SR_UIF;
+            ((t == &fake_TIM2) ? &tim2 : &tim3)->accNs = 0;
+        }
+    } else if (r == &fake_EXTI.PR) {
+        fake_EXTI.PR.value &= ~v;
+    } else if (r == &fake_CRC.CR) {
+        if (v & CRC_CR_RESET) {
+            crcValue = 0xFFFFFFFFu;
+        }
+    } else if (r == &fake_CRC.DR) {
+        crcValue ^= v;
+        for (uint8_t bit = 0; bit < 32; bit++) {
+            crcValue = (crcValue & 0x80000000u) ? ((crcValue << 1) ^ 0x04C11DB7u) : (crcValue << 1);
+        }
+    } else {
+        r->value = v;
+    }
+
+    advance(FAKE_ACCESS_NS);
+}
+
+FakeReg::operator uint32_t() const
+{
+    return regRead(this);
+}
+
+FakeReg &FakeReg::operator=(uint32_t v)
+{
+    regWrite(this, v);
+    return *this;
+}
+
+void NVIC_EnableIRQ(IRQn_Type irq)
+{
+    irqEnabled[irq] = 1;
+    irqService();
+}
+
+void NVIC_DisableIRQ(IRQn_Type irq)
+{
+    irqEnabled[irq] = 0;
+}
+
+void NVIC_SetPriority(IRQn_Type irq, uint32_t priority)
+{
+    irqPriority[irq] = (uint8_t)priority;
+}
+
+void NVIC_ClearPendingIRQ(IRQn_Type irq)
+{
+    (void)irq;
+}
+
+void __disable_irq(void)
+{
+    primask = 1;
+}
+
+void __enable_irq(void)
+{
+    primask = 0;
+    irqService();
+}
+
+uint32_t __get_PRIMASK(void)
+{
+    return primask;
+}
+
+void __set_PRIMASK(uint32_t value)
+{
+    primask = value & 1u;
+    irqService();
+}
+
+/**
+ * @brief   Power-on state, with the clock tree SysClockConfig() sets up (HCLK 180 MHz, PCLK1 45 MHz)
+*/
+void fakeReset(void)
+{
+    memset((void *)&fake_I2C1, 0, sizeof(fake_I2C1));
+    memset((void *)&fake_DMA1, 0, sizeof(fake_DMA1));
+    memset((void *)&fake_DMA2, 0, sizeof(fake_DMA2));
+    memset((void *)&fake_DMA1_Stream6, 0, sizeof(fake_DMA1_Stream6));
+    memset((void *)&fake_DMA2_Stream0, 0, sizeof(fake_DMA2_Stream0));
+    memset((void *)&fake_RCC, 0, sizeof(fake_RCC));
+    memset((void *)&fake_GPIOA, 0, sizeof(fake_GPIOA));
+    memset((void *)&fake_GPIOB, 0, sizeof(fake_GPIOB));
+    memset((void *)&fake_GPIOC, 0, sizeof(fake_GPIOC));
+    memset((void *)&fake_TIM2, 0, sizeof(fake_TIM2));
+    memset((void *)&fake_TIM3, 0, sizeof(fake_TIM3));
+    memset((void *)&fake_EXTI, 0, sizeof(fake_EXTI));
+    memset((void *)&fake_SYSCFG, 0, sizeof(fake_SYSCFG));
+    memset((void *)&fake_CRC, 0, sizeof(fake_CRC));
+    memset((void *)&fake_PWR, 0, sizeof(fake_PWR));
+    memset((void *)&fake_FLASH, 0, sizeof(fake_FLASH));
+
+    fake_RCC.CR.value = RCC_CR_HSEON | RCC_CR_PLLON;
+    fake_RCC.PLLCFGR.value = 4u | (180u << 6) | RCC_PLLCFGR_PLLSRC_HSE;
+    fake_RCC.CFGR.value = RCC_CFGR_SW_PLL | RCC_CFGR_HPRE_DIV1 | RCC_CFGR_PPRE1_DIV4 | RCC_CFGR_PPRE2_DIV2;
+    fake_TIM2.ARR.value = 0xFFFFFFFFu;
+    fake_TIM3.ARR.value = 0xFFFFu;
+
+    memset(&bus, 0, sizeof(bus));
+    memset(&panelLink, 0, sizeof(panelLink));
+    memset(&dma1s6, 0, sizeof(dma1s6));
+    memset(&dma2s0, 0, sizeof(dma2s0));
+    memset(&tim2, 0, sizeof(tim2));
+    memset(&tim3, 0, sizeof(tim3));
+    crcValue = 0xFFFFFFFFu;
+
+    memset(irqEnabled, 0, sizeof(irqEnabled));
+    memset(irqPriority, 0, sizeof(irqPriority));
+    primask = 0;
+    activePriority = 256u;
+    stormCount = 0;
+    stormNs = 0;
+
+    fake.nowNs = 0;
+    fake.limitNs = FAKE_LIMIT_NS;
+    fake.busStuck = 0;
+    fake.nackAfter = 0;
+    fake.irqHoldNs = 0;
+    fake.dropped = 0;
+    fake.dmaBytes = 0;
+    fake.memDmaTransfers = 0;
+    fake.memDmaError = 0;
+    memset(fake.irqCount, 0, sizeof(fake.irqCount));
+    memset(fake.irqMaxNs, 0, sizeof(fake.irqMaxNs));
+    fake.txns.clear();
+    memset(&fake.panel, 0, sizeof(fake.panel));
+    fake.panel.addressing = 2;
+    fake.panel.colEnd = 127;
+    fake.panel.pageEnd = 7;
+}
+
+/**
+ * @brief       Let time pass as if the CPU were busy, taking interrupts
+ * @param us    Time in us
+*/
+void fakeSpend(uint32_t us)
+{
+    advance((uint64_t)us * 1000u);
+}
+
+/**
+ * @brief       Visible pixel of the panel (GDDRAM seen through the display start line)
+*/
+uint8_t fakePixel(uint8_t x, uint8_t y)
+{
+    uint8_t row = (uint8_t)((y + fake.panel.startLine) & 63u);
+
+    return (fake.panel.gram[row >> 3][x & 0x7Fu] >> (row & 7u)) & 1u;
+}
+
+/**
+ * @brief           Bytes on the wire (address byte included) since a point in the transaction log
+*/
+size_t fakeWireBytes(size_t fromTxn)
+{
+    size_t n = 0;
+
+    for (size_t i = fromTxn; i < fake.txns.size(); i++) {
+        n += 1u + fake.txns[i].bytes.size();
+    }
+    return n;
+}
+
+void fakeFail(const char *file, int line, const char *what)
+{
+    printf("    %s:%d: %s\n", file, line, what);
+    testFailed = 1;
+}
+
+static void abortTest(const char *why)
+{
+    printf("    %s at %.3f ms\n", why, (double)fake.nowNs / 1e6);
+    testFailed = 1;
+    setcontext(&mainContext);
+}
+
+typedef struct {
+    const char *name;
+    FakeTestFn fn;
+} FakeTestEntry;
+
+static std::vector<FakeTestEntry> &testList(void)
+{
+    static std::vector<FakeTestEntry> list;
+    return list;
+}
+
+FakeTest::FakeTest(const char *name, FakeTestFn fn)
+{
+    testList().push_back({name, fn});
+}
+
+static void testEntry(void)
+{
+    testFn();
+}
+
+static void onWatchdog(int sig)
+{
+    (void)sig;
+    static const char msg[] = "    watchdog: test did not finish (wait on a flag without a timeout?)\n";
+    (void)write(1, msg, sizeof(msg) - 1u);
+    _exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    int failures = 0;
+
+    // DMA addresses are 32 bits, so the test stack must be in the low 4 GB (the binary is linked no-pie)
+    void *stack = mmap(NULL, FAKE_STACK_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_32BIT, -1, 0);
+    if (stack == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+
+    setvbuf(stdout, NULL, _IONBF, 0);
+    signal(SIGALRM, onWatchdog);
+
+    for (size_t i = 0; i < testList().size(); i++) {
+        const FakeTestEntry *t = &testList()[i];
+
+        if ((argc > 1) && (strcmp(argv[1], t->name) != 0)) {
+            continue;
+        }
+
+        testName = t->name;
+        testFn = t->fn;
+        testFailed = 0;
+        fakeReset();
+
+        getcontext(&testContext);
+        testContext.uc_stack.ss_sp = stack;
+        testContext.uc_stack.ss_size = FAKE_STACK_SIZE;
+        testContext.uc_link = &mainContext;
+        makecontext(&testContext, testEntry, 0);
+
+        alarm(FAKE_WATCHDOG_S);
+        swapcontext(&mainContext, &testContext);
+        alarm(0);
+
+        printf("%s %s\n", testFailed ? "FAIL" : "ok  ", testName);
+        failures += testFailed;
+    }
+
+    return (failures != 0) ? 1 : 0;
+}
@@ -0,0 +1,81 @@
+/**
+ * Peripheral model behind the fake device header, used by the unit tests in test/.
+ *
+ * Time only moves when the code touches a register (every access costs FAKE_ACCESS_NS) or when a
+ * test spends it with fakeSpend(), so a run is deterministic. While time moves, the models step:
+ * - I2C1 shifts the address/data bytes at the bus speed programmed in CCR (master transmitter)
+ *   into an SSD1306 model that keeps its GDDRAM, addressing state and display start line, and
+ *   turns the GDDRAM of the scrolled pages while a continuous scroll is active
+ * - DMA1 Stream 6 feeds I2C1->DR on TXE while DMAEN is set, DMA2 Stream 0 copies memory
+ * - TIM2/TIM3 count from the APB1 timer clock, CRC computes
+ * Interrupts are taken between register accesses when they are enabled in the NVIC, PRIMASK is
+ * clear and their priority is higher than the one running, like on the Cortex-M4.
+*/
+
+#ifndef FAKE_MCU_H
+#define FAKE_MCU_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include "stm32f4xx.h"
+
+#define FAKE_ACCESS_NS          50u         // Time taken by a register access
+#define FAKE_SSD1306_ADDRESS    0x78u       // Slave address the panel acknowledges
+#define FAKE_HCLK               180000000u  // Core clock after fakeReset()
+#define FAKE_PANEL_FRAME_NS     10000000u   // Panel frame period, the time base of the scroll
+
+// One bus transaction as seen by the panel
+typedef struct {
+    uint8_t address;                // Slave address byte
+    std::vector<uint8_t> bytes;     // Bytes acknowledged after the address
+    uint8_t stopped;                // Ended by a STOP (0 for a repeated START or still open)
+} FakeTxn;
+
+// SSD1306 model
+typedef struct {
+    uint8_t gram[8][128];           // GDDRAM, page-major like the screenbuffer
+    uint8_t startLine;              // Display start line (40h~7Fh)
+    uint8_t addressing;             // 0 horizontal, 1 vertical, 2 page (20h)
+    uint8_t colStart, colEnd;       // Column window (21h)
+    uint8_t pageStart, pageEnd;     // Page window (22h)
+    uint8_t col, page;              // GDDRAM pointer
+    uint8_t scrolling;              // Scroll activated (2Fh) and not deactivated (2Eh)
+    uint8_t scrollSetup[7];         // Last scroll setup command and its arguments
+    uint32_t scrollSteps;           // Scroll steps taken since fakeReset()
+    uint32_t dataBytes;             // GDDRAM bytes written
+    uint32_t commandBytes;          // Command bytes received
+} FakePanel;
+
+// Model state the tests inspect or change
+typedef struct {
+    uint64_t nowNs;                 // Time since fakeReset()
+    uint64_t limitNs;               // A test taking longer than this is aborted (unbounded wait)
+    uint8_t busStuck;               // SCL held low by the slave: nothing moves on the bus
+    uint32_t nackAfter;             // The panel NACKs the data byte after this many of a transaction (0: never)
+    uint64_t irqHoldNs;             // No interrupt is taken before this time (a long critical section elsewhere)
+    uint32_t dropped;               // Bytes written to DR that never went out (overrun, outside a transaction)
+    uint32_t dmaBytes;              // Bytes moved to I2C1->DR by DMA1 Stream 6
+    uint32_t memDmaTransfers;       // DMA2 Stream 0 transfers completed
+    uint8_t memDmaError;            // The next DMA2 Stream 0 transfer ends with a transfer error, nothing copied
+    uint32_t irqCount[64];          // Interrupts taken, by IRQ number
+    uint64_t irqMaxNs[64];          // Longest time spent in a handler (preemptions included), by IRQ number
+    std::vector<FakeTxn> txns;      // Bus transactions since fakeReset()
+    FakePanel panel;
+} FakeState;
+
+extern FakeState fake;
+
+// Runs the registered tests, each on a stack in the low 4 GB so DMA addresses fit in 32 bits
+typedef void (*FakeTestFn)(void);
+struct FakeTest {
+    FakeTest(const char *name, FakeTestFn fn);
+};
+
+void fakeReset(void);
+void fakeSpend(uint32_t us);
+void fakeFail(const char *file, int line, const char *what);
+uint8_t fakePixel(uint8_t x, uint8_t y);
+size_t fakeWireBytes(size_t fromTxn);
+
+#endif // FAKE_MCU_H
@@ -0,0 +1,252 @@
+/**
+ * Host stand-in for the CMSIS device header, used by the unit tests in test/.
+ * Only the registers, bits and core functions used by the drivers are declared, with the values of
+ * the STM32F401/F411 device headers. Compiled as C++ every register is a FakeReg, so each access
+ * goes through fake_mcu.cpp, which models the peripherals behind it. Compiled as C (make check) the
+ * registers are plain volatile words, which is enough to syntax check the sources.
+*/
+
+#ifndef FAKE_STM32F4XX_H
+#define FAKE_STM32F4XX_H
+
+#include <stdint.h>
+
+#define __IO                    volatile
+#define __STATIC_INLINE         static inline
+#define __ALIGNED(x)            __attribute__((aligned(x)))
+
+#ifdef __cplusplus
+// Register routed through the peripheral model
+struct FakeReg {
+    uint32_t value;
+
+    operator uint32_t() const;
+    FakeReg &operator=(uint32_t v);
+    FakeReg &operator=(const FakeReg &r) { return *this = (uint32_t)r; }
+    FakeReg &operator|=(uint32_t v) { return *this = ((uint32_t)*this | v); }
+    FakeReg &operator&=(uint32_t v) { return *this = ((uint32_t)*this & v); }
+    FakeReg &operator^=(uint32_t v) { return *this = ((uint32_t)*this ^ v); }
+};
+#define FAKE_REG                FakeReg
+#else
+#define FAKE_REG                volatile uint32_t
+#endif
+
+// Peripheral register blocks (field order as in the reference manual)
+typedef struct {
+    FAKE_REG CR1, CR2, OAR1, OAR2, DR, SR1, SR2, CCR, TRISE, FLTR;
+} I2C_TypeDef;
+
+typedef struct {
+    FAKE_REG CR, NDTR, PAR, M0AR, M1AR, FCR;
+} DMA_Stream_TypeDef;
+
+typedef struct {
+    FAKE_REG LISR, HISR, LIFCR, HIFCR;
+} DMA_TypeDef;
+
+typedef struct {
+    FAKE_REG CR, PLLCFGR, CFGR, CIR, AHB1RSTR, AHB2RSTR, RESERVED0[2], APB1RSTR, APB2RSTR, RESERVED1[2],
+             AHB1ENR, AHB2ENR, RESERVED2[2], APB1ENR, APB2ENR;
+} RCC_TypeDef;
+
+typedef struct {
+    FAKE_REG MODER, OTYPER, OSPEEDR, PUPDR, IDR, ODR, BSRR, LCKR, AFR[2];
+} GPIO_TypeDef;
+
+typedef struct {
+    FAKE_REG CR1, CR2, SMCR, DIER, SR, EGR, CCMR1, CCMR2, CCER, CNT, PSC, ARR;
+} TIM_TypeDef;
+
+typedef struct {
+    FAKE_REG IMR, EMR, RTSR, FTSR, SWIER, PR;
+} EXTI_TypeDef;
+
+typedef struct {
+    FAKE_REG MEMRMP, PMC, EXTICR[4];
+} SYSCFG_TypeDef;
+
+typedef struct {
+    FAKE_REG DR, IDR, CR;
+} CRC_TypeDef;
+
+typedef struct {
+    FAKE_REG CR, CSR;
+} PWR_TypeDef;
+
+typedef struct {
+    FAKE_REG ACR;
+} FLASH_TypeDef;
+
+extern I2C_TypeDef fake_I2C1;
+extern DMA_TypeDef fake_DMA1, fake_DMA2;
+extern DMA_Stream_TypeDef fake_DMA1_Stream6, fake_DMA2_Stream0;
+extern RCC_TypeDef fake_RCC;
+extern GPIO_TypeDef fake_GPIOA, fake_GPIOB, fake_GPIOC;
+extern TIM_TypeDef fake_TIM2, fake_TIM3;
+extern EXTI_TypeDef fake_EXTI;
+extern SYSCFG_TypeDef fake_SYSCFG;
+extern CRC_TypeDef fake_CRC;
+extern PWR_TypeDef fake_PWR;
+extern FLASH_TypeDef fake_FLASH;
+
+#define I2C1                    (&fake_I2C1)
+#define DMA1                    (&fake_DMA1)
+#define DMA2                    (&fake_DMA2)
+#define DMA1_Stream6            (&fake_DMA1_Stream6)
+#define DMA2_Stream0            (&fake_DMA2_Stream0)
+#define RCC                     (&fake_RCC)
+#define GPIOA                   (&fake_GPIOA)
+#define GPIOB                   (&fake_GPIOB)
+#define GPIOC                   (&fake_GPIOC)
+#define TIM2                    (&fake_TIM2)
+#define TIM3                    (&fake_TIM3)
+#define EXTI                    (&fake_EXTI)
+#define SYSCFG                  (&fake_SYSCFG)
+#define CRC                     (&fake_CRC)
+#define PWR                     (&fake_PWR)
+#define FLASH                   (&fake_FLASH)
+
+// Interrupt numbers
+typedef enum {
+    EXTI4_IRQn = 10,
+    DMA1_Stream6_IRQn = 17,
+    EXTI9_5_IRQn = 23,
+    TIM2_IRQn = 28,
+    TIM3_IRQn = 29,
+    I2C1_EV_IRQn = 31,
+    I2C1_ER_IRQn = 32,
+    DMA2_Stream0_IRQn = 56,
+} IRQn_Type;
+
+// Core functions, NVIC and PRIMASK are part of the model
+void NVIC_EnableIRQ(IRQn_Type irq);
+void NVIC_DisableIRQ(IRQn_Type irq);
+void NVIC_SetPriority(IRQn_Type irq, uint32_t priority);
+void NVIC_ClearPendingIRQ(IRQn_Type irq);
+void __disable_irq(void);
+void __enable_irq(void);
+uint32_t __get_PRIMASK(void);
+void __set_PRIMASK(uint32_t primask);
+
+static inline uint32_t __REV(uint32_t value)
+{
+    return __builtin_bswap32(value);
+}
+
+extern const uint8_t AHBPrescTable[16];
+extern const uint8_t APBPrescTable[8];
+
+// CRC
+#define CRC_CR_RESET                (1u << 0)
+
+// DMA
+#define DMA_SxCR_EN                 (1u << 0)
+#define DMA_SxCR_TEIE               (1u << 2)
+#define DMA_SxCR_HTIE               (1u << 3)
+#define DMA_SxCR_TCIE               (1u << 4)
+#define DMA_SxCR_DIR_0              (1u << 6)
+#define DMA_SxCR_DIR_1              (1u << 7)
+#define DMA_SxCR_CIRC               (1u << 8)
+#define DMA_SxCR_PINC               (1u << 9)
+#define DMA_SxCR_MINC               (1u << 10)
+#define DMA_SxCR_PSIZE_Pos          11
+#define DMA_SxCR_PSIZE_1            (1u << 12)
+#define DMA_SxCR_MSIZE_Pos          13
+#define DMA_SxCR_MSIZE_1            (1u << 14)
+#define DMA_SxCR_PL_0               (1u << 16)
+#define DMA_SxCR_PL_1               (1u << 17)
+#define DMA_SxCR_CHSEL_Pos          25
+#define DMA_SxFCR_FTH               (3u << 0)
+#define DMA_SxFCR_DMDIS             (1u << 2)
+#define DMA_LISR_TEIF0              (1u << 3)
+#define DMA_LISR_TCIF0              (1u << 5)
+#define DMA_LIFCR_CFEIF0            (1u << 0)
+#define DMA_LIFCR_CDMEIF0           (1u << 2)
+#define DMA_LIFCR_CTEIF0            (1u << 3)
+#define DMA_LIFCR_CHTIF0            (1u << 4)
+#define DMA_LIFCR_CTCIF0            (1u << 5)
+#define DMA_HISR_TEIF6              (1u << 19)
+#define DMA_HISR_HTIF6              (1u << 20)
+#define DMA_HISR_TCIF6              (1u << 21)
+#define DMA_HIFCR_CFEIF6            (1u << 16)
+#define DMA_HIFCR_CDMEIF6           (1u << 18)
+#define DMA_HIFCR_CTEIF6            (1u << 19)
+#define DMA_HIFCR_CHTIF6            (1u << 20)
+#define DMA_HIFCR_CTCIF6            (1u << 21)
+
+// EXTI/SYSCFG
+#define EXTI_IMR_MR4_Msk            (1u << 4)
+#define EXTI_IMR_MR8_Msk            (1u << 8)
+#define SYSCFG_EXTICR2_EXTI4_Msk    (0xFu << 0)
+#define SYSCFG_EXTICR3_EXTI8_Msk    (0xFu << 0)
+
+// FLASH/PWR
+#define FLASH_ACR_LATENCY_5WS       (5u << 0)
+#define FLASH_ACR_PRFTEN            (1u << 8)
+#define FLASH_ACR_ICEN              (1u << 9)
+#define FLASH_ACR_DCEN              (1u << 10)
+#define PWR_CR_VOS                  (3u << 14)
+
+// GPIO
+#define GPIO_MODER_MODER4_Pos       8
+#define GPIO_MODER_MODER4           (3u << 8)
+#define GPIO_MODER_MODER7_0         (1u << 14)
+#define GPIO_MODER_MODER7           (3u << 14)
+#define GPIO_MODER_MODER8_Pos       16
+#define GPIO_MODER_MODER8_1         (2u << 16)
+#define GPIO_MODER_MODER8           (3u << 16)
+#define GPIO_MODER_MODER9_1         (2u << 18)
+#define GPIO_OTYPER_OT8             (1u << 8)
+#define GPIO_OTYPER_OT9             (1u << 9)
+#define GPIO_OSPEEDR_OSPEED8        (3u << 16)
+#define GPIO_OSPEEDR_OSPEED9        (3u << 18)
+#define GPIO_PUPDR_PUPD8_0          (1u << 16)
+#define GPIO_PUPDR_PUPD9_0          (1u << 18)
+#define GPIO_AFRH_AFSEL8_2          (0x4u << 0)
+#define GPIO_AFRH_AFSEL9_2          (0x4u << 4)
+
+// RCC
+#define RCC_CR_HSEON                (1u << 16)
+#define RCC_CR_HSERDY               (1u << 17)
+#define RCC_CR_PLLON                (1u << 24)
+#define RCC_CR_PLLRDY               (1u << 25)
+#define RCC_PLLCFGR_PLLM_Pos        0
+#define RCC_PLLCFGR_PLLM            (0x3Fu << 0)
+#define RCC_PLLCFGR_PLLN_Pos        6
+#define RCC_PLLCFGR_PLLN            (0x1FFu << 6)
+#define RCC_PLLCFGR_PLLP_Pos        16
+#define RCC_PLLCFGR_PLLP            (3u << 16)
+#define RCC_PLLCFGR_PLLSRC_HSE      (1u << 22)
+#define RCC_CFGR_SW_PLL             (2u << 0)
+#define RCC_CFGR_SWS                (3u << 2)
+#define RCC_CFGR_SWS_HSE            (1u << 2)
+#define RCC_CFGR_SWS_PLL            (2u << 2)
+#define RCC_CFGR_HPRE_Pos           4
+#define RCC_CFGR_HPRE               (0xFu << 4)
+#define RCC_CFGR_HPRE_DIV1          (0u << 4)
+#define RCC_CFGR_PPRE1_Pos          10
+#define RCC_CFGR_PPRE1              (7u << 10)
+#define RCC_CFGR_PPRE1_2            (4u << 10)
+#define RCC_CFGR_PPRE1_DIV2         (4u << 10)
+#define RCC_CFGR_PPRE1_DIV4         (5u << 10)
+#define RCC_CFGR_PPRE2_DIV2         (4u << 13)
+#define RCC_AHB1ENR_GPIOAEN         (1u << 0)
+#define RCC_AHB1ENR_GPIOBEN         (1u << 1)
+#define RCC_AHB1ENR_GPIOCEN         (1u << 2)
+#define RCC_AHB1ENR_CRCEN           (1u << 12)
+#define RCC_AHB1ENR_DMA1EN          (1u << 21)
+#define RCC_AHB1ENR_DMA2EN          (1u << 22)
+#define RCC_APB1ENR_TIM2EN          (1u << 0)
+#define RCC_APB1ENR_TIM3EN          (1u << 1)
+#define RCC_APB1ENR_I2C1EN          (1u << 21)
+#define RCC_APB1ENR_PWREN           (1u << 28)
+#define RCC_APB2ENR_SYSCFGEN        (1u << 14)
+
+// TIM
+#define TIM_CR1_CEN                 (1u << 0)
+#define TIM_DIER_UIE                (1u << 0)
+#define TIM_SR_UIF                  (1u << 0)
+#define TIM_EGR_UG                  (1u << 0)
+
+#endif // FAKE_STM32F4XX_H
@@ -0,0 +1,82 @@
+/**
+ * Common header of the host unit tests.
+ * A test program includes the SSD1306 driver source so it can reach the static state (buffers,
+ * dirty ranges); the other modules are linked as they are. See fake/fake_mcu.h for the model of
+ * the peripherals.
+*/
+
+#ifndef TEST_H
+#define TEST_H
+
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include "fake_mcu.h"
+#include "../src/ssd1306_driver.c"
+#include "../inc/mem_dma.h"
+
+// Register a test function, run with the peripherals reset
+#define TEST(name) \
+    static void name(void); \
+    static FakeTest name##Entry(#name, name); \
+    static void name(void)
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            fakeFail(__FILE__, __LINE__, #cond); \
+        } \
+    } while (0)
+
+#define CHECK_EQ(a, b) \
+    do { \
+        long long va = (long long)(a); \
+        long long vb = (long long)(b); \
+        if (va != vb) { \
+            char msg[160]; \
+            snprintf(msg, sizeof(msg), "%s == %s (%lld != %lld)", #a, #b, va, vb); \
+            fakeFail(__FILE__, __LINE__, msg); \
+        } \
+    } while (0)
+
+/**
+ * @brief           Bring up the clock, the bus and the panel like initialize() in main.c
+ * @param speed     Bus speed
+*/
+static inline void testBoot(I2C_SPEED speed)
+{
+    CHECK_EQ(TIM2init(), 0);
+    CHECK_EQ(I2C_init(speed), 0);
+    I2C_initDMA();
+    CRC_init();
+    MEMDMA_init();
+    CHECK_EQ(SSD1306_init(), 0);
+}
+
+/**
+ * @brief   Host time in ns, for the benchmarks
+*/
+static inline uint64_t testHostNs(void)
+{
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * @brief   Check that the panel GDDRAM holds the front buffer (the frame last sent)
+*/
+#ifndef SSD1306_STRIP_ONLY
+static inline int testPanelMismatches(void)
+{
+    int bad = 0;
+
+    for (int page = 0; page < 8; page++) {
+        for (int col = 0; col < 128; col++) {
+            bad += (fake.panel.gram[page][col] != frontBuffer[(page * SSD1306_WIDTH) + col]);
+        }
+    }
+    return bad;
+}
+#endif
+
+#endif // TEST_H
@@ -0,0 +1,104 @@
+/**
+ * Animation sequences (anim.c) with frames shorter than the tick, built with a 100 Hz tick
+ * (test_anim_DEFS in the Makefile): every frame is shown for at least one tick, and the jitter is
+ * measured against the durations in whole ticks.
+*/
+
+#include "test.h"
+#include "../inc/anim.h"
+#include "../inc/ssd1306_imgs.h"
+
+#define SPRITE  0u
+
+static const ImgDef *const frames[] = {&DogDown_22x20, &DogUp_22x20};
+
+/**
+ * @brief           Sample the sprite frame every ms and collect the runs of the same frame
+ * @param ms        Time to sample
+ * @param runs      Length in ms of each run of frame 1
+*/
+static void sampleRuns(uint32_t ms, std::vector<uint32_t> *runs)
+{
+    uint32_t run = 0;
+
+    for (uint32_t i = 0; i < ms; i++) {
+        fakeSpend(1000);
+        if (sprites[SPRITE].frame == 1) {
+            run++;
+        } else if (run) {
+            runs->push_back(run);
+            run = 0;
+        }
+    }
+}
+
+TEST(shortFramesLastOneTick)
+{
+    // 1 ms and 5 ms are below the 10 ms tick, 30 ms is 3 ticks
+    static const ANIM_Frame sequence[] = {
+        {0, 1},
+        {1, 5},
+        {0, 30},
+    };
+    std::vector<uint32_t> runs;
+
+    testBoot(I2C_SPEED_FAST);
+    CHECK_EQ(ANIM_TICK_HZ, 100);
+    CHECK_EQ(ANIM_init(), 0);
+    CHECK_EQ(SSD1306_spriteSet(SPRITE, frames, 2, 0, 0, 0), 0);
+    CHECK_EQ(ANIM_start(SPRITE, sequence, 3, 1), 0);
+
+    // One loop is 5 ticks (50 ms), frame 1 is shown for one tick of it
+    sampleRuns(500, &runs);
+    CHECK(runs.size() >= 9u);
+    for (size_t i = 0; i < runs.size(); i++) {
+        CHECK((runs[i] >= 9u) && (runs[i] <= 11u));
+    }
+    CHECK(ANIM_isRunning(SPRITE));
+}
+
+TEST(shortLastFrameStops)
+{
+    static const ANIM_Frame sequence[] = {
+        {1, 2},
+        {0, 3},
+    };
+
+    testBoot(I2C_SPEED_FAST);
+    CHECK_EQ(ANIM_init(), 0);
+    CHECK_EQ(SSD1306_spriteSet(SPRITE, frames, 2, 0, 0, 0), 0);
+    CHECK_EQ(ANIM_start(SPRITE, sequence, 2, 0), 0);
+    CHECK_EQ(sprites[SPRITE].frame, 1);
+
+    // Two ticks at most, the last frame stays
+    fakeSpend(25000);
+    CHECK(!ANIM_isRunning(SPRITE));
+    CHECK_EQ(sprites[SPRITE].frame, 0);
+}
+
+TEST(jitterOfWholeTicks)
+{
+    // 15 ms is one tick at 100 Hz, 25 ms two: the frames are on for 10 and 20 ms
+    static const ANIM_Frame sequence[] = {
+        {1, 15},
+        {0, 25},
+    };
+    ANIM_Jitter jitter;
+
+    testBoot(I2C_SPEED_FAST);
+    CHECK_EQ(ANIM_init(), 0);
+    CHECK_EQ(SSD1306_spriteSet(SPRITE, frames, 2, 0, 0, 0), 0);
+    CHECK_EQ(ANIM_start(SPRITE, sequence, 2, 1), 0);
+
+    // Presented within a ms of every change: a deviation of 5 ms would be the nominal durations
+    for (int i = 0; i < 600; i++) {
+        fakeSpend(1000);
+        ANIM_presented();
+    }
+    CHECK_EQ(ANIM_getJitter(SPRITE, &jitter), 0);
+    CHECK(jitter.frames >= 30u);
+    CHECK_EQ(jitter.skipped, 0);
+    CHECK(jitter.minUs >= -1000);
+    CHECK(jitter.maxUs <= 1000);
+    CHECK(jitter.meanAbsUs < 1000u);
+}
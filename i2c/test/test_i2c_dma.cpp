@@ -0,0 +1,152 @@
+/**
+ * The DMA transmit path puts the same bytes on the bus as the polled one: a payload sent with
+ * I2C_writeMulti(), I2C_writeMultiDMA() and I2C_transfer(), and a frame sent with SSD1306_update()
+ * and SSD1306_updateDMA().
+*/
+
+#include "test.h"
+
+static __ALIGNED(4) uint8_t payload[SSD1306_BUFFER_SIZE];
+static __ALIGNED(4) uint8_t frame[SSD1306_BUFFER_SIZE];
+
+/**
+ * @brief           Transactions of a range of txns, flattened: address, bytes, stop marker
+ * @param chained   Give the markers of the same transactions queued back to back: a repeated START
+ *                  after every one but the last
+*/
+static std::vector<uint8_t> wireLog(size_t from, size_t to, uint8_t chained)
+{
+    std::vector<uint8_t> log;
+
+    for (size_t i = from; i < to; i++) {
+        uint8_t stopped = chained ? (i == (to - 1u)) : fake.txns[i].stopped;
+
+        log.push_back(fake.txns[i].address);
+        log.insert(log.end(), fake.txns[i].bytes.begin(), fake.txns[i].bytes.end());
+        log.push_back(stopped ? 0xA5 : 0x5A);
+    }
+    return log;
+}
+
+static std::vector<uint8_t> wireLog(size_t from)
+{
+    return wireLog(from, fake.txns.size(), 0);
+}
+
+static void waitIdle(void)
+{
+    for (int i = 0; (i < 10000) && (I2C_isBusy() || SSD1306_isBusy()); i++) {
+        fakeSpend(100);
+    }
+    CHECK(!I2C_isBusy());
+    CHECK(!SSD1306_isBusy());
+    fakeSpend(100);
+}
+
+static void fillRandom(uint8_t *buffer, size_t size, uint32_t seed)
+{
+    for (size_t i = 0; i < size; i++) {
+        seed = (seed * 1103515245u) + 12345u;
+        buffer[i] = (uint8_t)(seed >> 16);
+    }
+}
+
+TEST(payloadPathsMatch)
+{
+    static const uint16_t sizes[] = {1, 2, 15, 16, 17, 128, 129, 1024};
+
+    testBoot(I2C_SPEED_FAST);
+    fillRandom(payload, sizeof(payload), 1);
+
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        uint16_t size = sizes[i];
+
+        // Polled
+        size_t from = fake.txns.size();
+        I2C_start();
+        CHECK_EQ(I2C_writeSlaveAddress(FAKE_SSD1306_ADDRESS, 1000), 0);
+        CHECK_EQ(I2C_write(SSD1306_WRITE_DATA, 1000), 0);
+        CHECK_EQ(I2C_writeMulti(payload, size, 1000), 0);
+        I2C_stop();
+        waitIdle();
+        std::vector<uint8_t> polled = wireLog(from);
+        CHECK_EQ(polled.size(), size + 3u);
+
+        // Polled START/address/control, payload by the DMA
+        from = fake.txns.size();
+        uint32_t dmaBytes = fake.dmaBytes;
+        I2C_start();
+        CHECK_EQ(I2C_writeSlaveAddress(FAKE_SSD1306_ADDRESS, 1000), 0);
+        CHECK_EQ(I2C_write(SSD1306_WRITE_DATA, 1000), 0);
+        CHECK_EQ(I2C_writeMultiDMA(payload, size, 0), 0);
+        waitIdle();
+        CHECK_EQ(fake.dmaBytes - dmaBytes, size);
+        CHECK(wireLog(from) == polled);
+
+        // Transaction engine (DMA from I2C_DMA_MIN_SIZE bytes on)
+        from = fake.txns.size();
+        dmaBytes = fake.dmaBytes;
+        CHECK_EQ(I2C_transfer(FAKE_SSD1306_ADDRESS, SSD1306_WRITE_DATA, payload, size, 100000), 0);
+        waitIdle();
+        CHECK_EQ(fake.dmaBytes - dmaBytes, (size >= 16) ? size : 0);
+        CHECK(wireLog(from) == polled);
+    }
+
+    CHECK_EQ(fake.dropped, 0);
+}
+
+static void frameUpdatesMatch(SSD1306_UPDATE_MODE mode)
+{
+    testBoot(I2C_SPEED_FAST);
+    CHECK_EQ(SSD1306_setUpdateMode(mode), 0);
+
+    for (uint32_t seed = 1; seed <= 3; seed++) {
+        fillRandom(frame, sizeof(frame), seed);
+
+        // Whole frame, then a partial one
+        for (int partial = 0; partial < 2; partial++) {
+            if (partial) {
+                SSD1306_fillRect(20, 10, 50, 30, WHITE);
+                SSD1306_draw_pixel(127, 63, BLACK);
+            } else {
+                CHECK_EQ(SSD1306_loadFrame(frame), 0);
+            }
+
+            // Keep the dirty ranges for the second run
+            uint8_t min[SSD1306_HEIGHT / 8];
+            uint8_t max[SSD1306_HEIGHT / 8];
+            memcpy(min, dirtyMin, sizeof(min));
+            memcpy(max, dirtyMax, sizeof(max));
+
+            size_t from = fake.txns.size();
+            CHECK_EQ(SSD1306_update(), 0);
+            waitIdle();
+            std::vector<uint8_t> blocking = wireLog(from);
+            CHECK(!blocking.empty());
+            CHECK_EQ(testPanelMismatches(), 0);
+
+            // Same frame and ranges again without waiting for the bus: the same transactions, queued
+            // back to back so they follow each other with a repeated START
+            blocking = wireLog(from, fake.txns.size(), 1);
+            memcpy(dirtyMin, min, sizeof(min));
+            memcpy(dirtyMax, max, sizeof(max));
+            from = fake.txns.size();
+            CHECK_EQ(SSD1306_updateDMA(0), 0);
+            waitIdle();
+            CHECK(wireLog(from) == blocking);
+            CHECK_EQ(testPanelMismatches(), 0);
+        }
+    }
+
+    CHECK_EQ(fake.dropped, 0);
+}
+
+TEST(frameUpdatesMatchPage)
+{
+    frameUpdatesMatch(SSD1306_UPDATE_PAGE);
+}
+
+TEST(frameUpdatesMatchHorizontal)
+{
+    frameUpdatesMatch(SSD1306_UPDATE_HORIZONTAL);
+}
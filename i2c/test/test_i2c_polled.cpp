@@ -0,0 +1,220 @@
+/**
+ * Polled transfers (I2C_start() to I2C_stop()) next to the transaction engine: they refuse the bus
+ * while the engine or a DMA transfer owns it, hold back queued transactions until I2C_stop(), and
+ * every wait gives up after its timeout.
+*/
+
+#include "test.h"
+
+static uint8_t payload[64];
+
+/**
+ * @brief   Let the engine finish whatever is queued
+*/
+static void waitIdle(void)
+{
+    for (int i = 0; (i < 1000) && I2C_isBusy(); i++) {
+        fakeSpend(100);
+    }
+    CHECK(!I2C_isBusy());
+    fakeSpend(100);
+}
+
+static void fillPayload(void)
+{
+    for (size_t i = 0; i < sizeof(payload); i++) {
+        payload[i] = (uint8_t)(i * 7u + 1u);
+    }
+}
+
+TEST(polledTransfer)
+{
+    testBoot(I2C_SPEED_FAST);
+    fillPayload();
+    size_t before = fake.txns.size();
+
+    I2C_start();
+    CHECK_EQ(I2C_writeSlaveAddress(FAKE_SSD1306_ADDRESS, 1000), 0);
+    CHECK_EQ(I2C_write(0x40, 1000), 0);
+    CHECK_EQ(I2C_writeMulti(payload, 16, 1000), 0);
+    I2C_stop();
+    fakeSpend(100);
+
+    CHECK_EQ(fake.txns.size(), before + 1);
+    const FakeTxn &t = fake.txns.back();
+    CHECK_EQ(t.address, FAKE_SSD1306_ADDRESS);
+    CHECK_EQ(t.bytes.size(), 17);
+    CHECK_EQ(t.bytes[0], 0x40);
+    for (int i = 0; i < 16; i++) {
+        CHECK_EQ(t.bytes[1 + i], payload[i]);
+    }
+    CHECK(t.stopped);
+    CHECK_EQ(fake.dropped, 0);
+}
+
+TEST(refusedWhileQueued)
+{
+    testBoot(I2C_SPEED_FAST);
+    fillPayload();
+    size_t before = fake.txns.size();
+
+    // Long enough to go to the DMA, short enough to be still running below
+    CHECK_EQ(I2C_queueWrite(FAKE_SSD1306_ADDRESS, 0x40, payload, sizeof(payload), 0), 0);
+    CHECK(I2C_isBusy());
+
+    I2C_start();
+    CHECK_EQ(I2C_writeSlaveAddress(FAKE_SSD1306_ADDRESS, 1000), 1);
+    CHECK_EQ(I2C_write(0x40, 1000), 1);
+    CHECK_EQ(I2C_writeMulti(payload, 4, 1000), 1);
+    CHECK_EQ(I2C_writeMultiDMA(payload, 32, 0), 1);
+    I2C_stop();
+
+    // The queued transaction went out whole, nothing of the refused one reached the bus
+    waitIdle();
+    CHECK_EQ(fake.txns.size(), before + 1);
+    CHECK_EQ(fake.txns.back().bytes.size(), 1 + sizeof(payload));
+    CHECK(fake.txns.back().stopped);
+    CHECK_EQ(fake.dropped, 0);
+}
+
+TEST(refusedWhileDirectDMA)
+{
+    static volatile uint8_t done;
+    testBoot(I2C_SPEED_FAST);
+    fillPayload();
+    done = 0;
+
+    I2C_start();
+    CHECK_EQ(I2C_writeSlaveAddress(FAKE_SSD1306_ADDRESS, 1000), 0);
+    CHECK_EQ(I2C_write(0x40, 1000), 0);
+    CHECK_EQ(I2C_writeMultiDMA(payload, 32, [](uint8_t status) { done = 1 + status; }), 0);
+
+    // A second polled transfer is refused and its I2C_stop() leaves the DMA alone
+    I2C_start();
+    CHECK_EQ(I2C_writeSlaveAddress(FAKE_SSD1306_ADDRESS, 1000), 1);
+    I2C_stop();
+
+    waitIdle();
+    CHECK_EQ(done, 1);
+    CHECK_EQ(fake.txns.back().bytes.size(), 33);
+    CHECK(fake.txns.back().stopped);
+
+    // The DMA interrupt handed the bus back
+    I2C_start();
+    CHECK_EQ(I2C_writeSlaveAddress(FAKE_SSD1306_ADDRESS, 1000), 0);
+    I2C_stop();
+    CHECK_EQ(fake.dropped, 0);
+}
+
+TEST(directDMANackFails)
+{
+    static volatile uint8_t done;
+    testBoot(I2C_SPEED_FAST);
+    fillPayload();
+    done = 0;
+
+    // The panel refuses every byte after the 10th: the error interrupt ends the transfer with a failure
+    fake.nackAfter = 10;
+    uint64_t t0 = fake.nowNs;
+    I2C_start();
+    CHECK_EQ(I2C_writeSlaveAddress(FAKE_SSD1306_ADDRESS, 1000), 0);
+    CHECK_EQ(I2C_write(0x40, 1000), 0);
+    CHECK_EQ(I2C_writeMultiDMA(payload, 32, [](uint8_t status) { done = 1 + status; }), 0);
+    for (int i = 0; (i < 100) && !done; i++) {
+        fakeSpend(10);
+    }
+    CHECK_EQ(done, 2);
+    CHECK((fake.nowNs - t0) < 500000u);
+    CHECK(!I2C_isBusy());
+    fakeSpend(100);
+    fake.nackAfter = 0;
+
+    CHECK(fake.txns.back().stopped);
+    CHECK_EQ(fake.txns.back().bytes.size(), 10);
+
+    // The bus is usable again, by both the polled and the queued paths
+    size_t before = fake.txns.size();
+    I2C_start();
+    CHECK_EQ(I2C_writeSlaveAddress(FAKE_SSD1306_ADDRESS, 1000), 0);
+    CHECK_EQ(I2C_write(0x00, 1000), 0);
+    I2C_stop();
+    CHECK_EQ(I2C_queueWrite(FAKE_SSD1306_ADDRESS, 0x40, payload, sizeof(payload), 0), 0);
+    waitIdle();
+    CHECK_EQ(fake.txns.size(), before + 2);
+    CHECK_EQ(fake.txns.back().bytes.size(), 1 + sizeof(payload));
+}
+
+TEST(queueWaitsForStop)
+{
+    testBoot(I2C_SPEED_FAST);
+    fillPayload();
+    size_t before = fake.txns.size();
+
+    I2C_start();
+    CHECK_EQ(I2C_writeSlaveAddress(FAKE_SSD1306_ADDRESS, 1000), 0);
+    CHECK_EQ(I2C_queueWrite(FAKE_SSD1306_ADDRESS, 0x40, payload, 4, 0), 0);
+    fakeSpend(500);
+    CHECK_EQ(I2C_writeMulti(payload, 8, 1000), 0);
+    I2C_stop();
+    waitIdle();
+
+    CHECK_EQ(fake.txns.size(), before + 2);
+    CHECK_EQ(fake.txns[before].bytes.size(), 8);
+    CHECK_EQ(fake.txns[before + 1].bytes.size(), 5);
+    CHECK(fake.txns[before].stopped);
+    CHECK(fake.txns[before + 1].stopped);
+}
+
+TEST(nackFailsFast)
+{
+    testBoot(I2C_SPEED_FAST);
+
+    uint64_t t0 = fake.nowNs;
+    I2C_start();
+    CHECK_EQ(I2C_writeSlaveAddress(0x7A, 100000), 1);
+    CHECK_EQ(I2C_write(0x00, 100000), 1);
+    I2C_stop();
+    CHECK((fake.nowNs - t0) < 200000u);
+
+    // The bus is usable again
+    I2C_start();
+    CHECK_EQ(I2C_writeSlaveAddress(FAKE_SSD1306_ADDRESS, 1000), 0);
+    CHECK_EQ(I2C_write(0x00, 1000), 0);
+    I2C_stop();
+}
+
+TEST(stuckBusTimesOut)
+{
+    testBoot(I2C_SPEED_FAST);
+    fillPayload();
+
+    // SCL held low before the START: SB never sets
+    fake.busStuck = 1;
+    uint64_t t0 = fake.nowNs;
+    I2C_start();
+    CHECK_EQ(I2C_writeSlaveAddress(FAKE_SSD1306_ADDRESS, 1000), 1);
+    CHECK_EQ(I2C_writeMulti(payload, 8, 1000), 1);
+    CHECK((fake.nowNs - t0) < 2000000u);
+    fake.busStuck = 0;
+    I2C_stop();
+    fakeSpend(100);
+
+    // Stuck in the middle of the data: TXE never sets again
+    I2C_start();
+    CHECK_EQ(I2C_writeSlaveAddress(FAKE_SSD1306_ADDRESS, 1000), 0);
+    CHECK_EQ(I2C_write(0x40, 1000), 0);
+    fake.busStuck = 1;
+    t0 = fake.nowNs;
+    CHECK_EQ(I2C_writeMulti(payload, sizeof(payload), 1000), 1);
+    CHECK_EQ(I2C_write(0x00, 1000), 1);
+    CHECK((fake.nowNs - t0) < 2000000u);
+    fake.busStuck = 0;
+    I2C_stop();
+    fakeSpend(100);
+
+    // Back to normal
+    I2C_start();
+    CHECK_EQ(I2C_writeSlaveAddress(FAKE_SSD1306_ADDRESS, 1000), 0);
+    CHECK_EQ(I2C_write(0x00, 1000), 0);
+    I2C_stop();
+}
@@ -0,0 +1,185 @@
+/**
+ * Circular DMA streams (I2C_streamStart()) end at a pass boundary even when the DMA interrupt is
+ * taken late, after the reloaded DMA has already sent bytes of the next pass.
+*/
+
+#include "test.h"
+
+#define PASS_SIZE   64u
+
+static uint8_t payload[PASS_SIZE];
+static uint8_t setup[2] = {0x20, 0x00};
+
+/**
+ * @brief   Start the stream
+ * @return  Index of its setup transaction in fake.txns
+*/
+static size_t startStream(void)
+{
+    testBoot(I2C_SPEED_FAST);
+    size_t from = fake.txns.size();
+
+    for (uint32_t i = 0; i < PASS_SIZE; i++) {
+        payload[i] = (uint8_t)(i + 1u);
+    }
+    CHECK_EQ(I2C_streamStart(FAKE_SSD1306_ADDRESS, SSD1306_WRITE_COMMAND, setup, sizeof(setup),
+                             SSD1306_WRITE_DATA, payload, PASS_SIZE), 0);
+    return from;
+}
+
+/**
+ * @brief   Spend time until the DMA has a few bytes of the current pass left
+*/
+static void waitPassEnd(uint32_t left)
+{
+    while (I2C_streamPasses() == 0) {
+        fakeSpend(10);
+    }
+    while (fake_DMA1_Stream6.NDTR.value > left) {
+        fakeSpend(1);
+    }
+}
+
+/**
+ * @brief           The transaction is a stream made of whole passes
+ * @param stopped   Ended by a STOP (0 when a queued transaction follows with a repeated START)
+*/
+static void checkWholePasses(const FakeTxn &t, uint8_t stopped)
+{
+    CHECK_EQ(t.stopped, stopped);
+    CHECK(t.bytes.size() > PASS_SIZE);
+    CHECK_EQ(t.bytes[0], SSD1306_WRITE_DATA);
+    CHECK_EQ((t.bytes.size() - 1u) % PASS_SIZE, 0);
+    for (size_t i = 1; i < t.bytes.size(); i++) {
+        if (t.bytes[i] != payload[(i - 1u) % PASS_SIZE]) {
+            CHECK_EQ(t.bytes[i], payload[(i - 1u) % PASS_SIZE]);
+            break;
+        }
+    }
+}
+
+TEST(stopOnTime)
+{
+    size_t from = startStream();
+
+    while (I2C_streamPasses() < 3) {
+        fakeSpend(100);
+    }
+    CHECK_EQ(I2C_streamStop(100000), 0);
+    CHECK(!I2C_isStreaming());
+    fakeSpend(100);
+
+    // Setup, then the stream
+    CHECK_EQ(fake.txns.size(), from + 2u);
+    checkWholePasses(fake.txns.back(), 1);
+    CHECK_EQ((fake.txns.back().bytes.size() - 1u) / PASS_SIZE, I2C_streamPasses());
+    CHECK(!I2C_isBusy());
+    CHECK_EQ(fake.dropped, 0);
+}
+
+TEST(stopWithLateInterrupt)
+{
+    // Held for less than a byte, a few bytes, and most of a pass (a byte is 22.5 us at 400 kHz)
+    static const uint32_t holdUs[] = {5, 30, 100, 500, 1200};
+
+    for (size_t i = 0; i < sizeof(holdUs) / sizeof(holdUs[0]); i++) {
+        startStream();
+
+        waitPassEnd(1);
+        fake.irqHoldNs = fake.nowNs + (holdUs[i] * 1000ull);
+        CHECK_EQ(I2C_streamStop(100000), 0);
+        fakeSpend(100);
+
+        checkWholePasses(fake.txns.back(), 1);
+        CHECK(!I2C_isBusy());
+        CHECK_EQ(fake.dropped, 0);
+    }
+}
+
+TEST(yieldWithLateInterrupt)
+{
+    static const uint8_t displayOn = 0xAF;
+
+    size_t from = startStream();
+
+    // A command queued while the interrupt at the end of the pass is held back
+    waitPassEnd(1);
+    fake.irqHoldNs = fake.nowNs + 100000u;
+    CHECK_EQ(I2C_queueWrite(FAKE_SSD1306_ADDRESS, SSD1306_WRITE_COMMAND, &displayOn, 1, 0), 0);
+
+    // The stream comes back behind it with its setup
+    while (fake.txns.size() < (from + 5u)) {
+        fakeSpend(100);
+    }
+    fakeSpend(2000);
+    CHECK_EQ(I2C_streamStop(100000), 0);
+    fakeSpend(100);
+
+    CHECK_EQ(fake.txns.size(), from + 5u);
+    CHECK_EQ(fake.txns[from].bytes.size(), 1u + sizeof(setup));
+    checkWholePasses(fake.txns[from + 1u], 0);
+    CHECK_EQ(fake.txns[from + 2u].bytes.size(), 2);
+    CHECK_EQ(fake.txns[from + 2u].bytes[1], displayOn);
+    CHECK_EQ(fake.txns[from + 3u].bytes.size(), 1u + sizeof(setup));
+    checkWholePasses(fake.txns[from + 4u], 1);
+    CHECK_EQ(fake.dropped, 0);
+}
+
+TEST(noBusyWaitInInterrupts)
+{
+    // The DMA interrupt leaves the end of the transfer to the event interrupt instead of waiting for
+    // BTF (a byte is 90 us at 100 kHz), neither handler waits on the bus
+    static uint8_t data[256];
+
+    testBoot(I2C_SPEED_STANDARD);
+    memset(fake.irqMaxNs, 0, sizeof(fake.irqMaxNs));
+
+    CHECK_EQ(I2C_transfer(FAKE_SSD1306_ADDRESS, SSD1306_WRITE_DATA, data, sizeof(data), 100000), 0);
+    CHECK_EQ(I2C_transfer(FAKE_SSD1306_ADDRESS, SSD1306_WRITE_DATA, data, sizeof(data), 100000), 0);
+    CHECK(fake.irqCount[DMA1_Stream6_IRQn] >= 2u);
+    CHECK(fake.irqMaxNs[DMA1_Stream6_IRQn] < 5000u);
+    CHECK(fake.irqMaxNs[I2C1_EV_IRQn] < 5000u);
+    CHECK_EQ(fake.dropped, 0);
+}
+
+TEST(queuedChainNoBusyWait)
+{
+    // The event interrupt starts the next queued transaction with a repeated START instead of waiting
+    // for the STOP of the last one (there is no interrupt when a STOP is done)
+    static uint8_t data[4][64];
+    const uint16_t sizes[4] = { 1, 8, 64, 20 };
+    size_t from;
+
+    testBoot(I2C_SPEED_STANDARD);
+    for (int i = 0; i < 4; i++) {
+        memset(data[i], 0x11 * (i + 1), sizeof(data[i]));
+    }
+    memset(fake.irqMaxNs, 0, sizeof(fake.irqMaxNs));
+    memset(fake.irqCount, 0, sizeof(fake.irqCount));
+    from = fake.txns.size();
+
+    for (int i = 0; i < 4; i++) {
+        CHECK_EQ(I2C_queueWrite(FAKE_SSD1306_ADDRESS, SSD1306_WRITE_DATA, data[i], sizes[i], 0), 0);
+    }
+    for (int i = 0; (i < 1000) && I2C_isBusy(); i++) {
+        fakeSpend(100);
+    }
+    fakeSpend(100);
+    CHECK(!I2C_isBusy());
+
+    CHECK_EQ(fake.txns.size(), from + 4u);
+    for (int i = 0; i < 4; i++) {
+        const FakeTxn &t = fake.txns[from + (size_t)i];
+        CHECK_EQ(t.bytes.size(), 1u + sizes[i]);
+        CHECK(memcmp(&t.bytes[1], data[i], sizes[i]) == 0);
+        CHECK_EQ(t.stopped, (i == 3));
+    }
+
+    // Well under a bit time (10 us) in every handler, a bounded number of events per transaction
+    CHECK(fake.irqMaxNs[I2C1_EV_IRQn] < 5000u);
+    CHECK(fake.irqMaxNs[I2C1_ER_IRQn] < 5000u);
+    CHECK(fake.irqMaxNs[DMA1_Stream6_IRQn] < 5000u);
+    CHECK(fake.irqCount[I2C1_EV_IRQn] <= (4u * 16u));
+    CHECK_EQ(fake.irqCount[I2C1_ER_IRQn], 0);
+    CHECK_EQ(fake.dropped, 0);
+}
@@ -0,0 +1,100 @@
+/**
+ * I2C_computeTiming() over a table of PCLK1 values, and I2C_init() programming the result from the
+ * clock tree read back from the RCC.
+*/
+
+#include "test.h"
+
+typedef struct {
+    uint32_t pclk1;
+    I2C_SPEED speed;
+    uint8_t rv;
+    uint8_t freq;
+    uint16_t ccr;
+    uint8_t trise;
+} TimingCase;
+
+// Expected values worked out by hand from RM0368 18.6.8 (CCR) and 18.6.9 (TRISE)
+static const TimingCase timingCases[] = {
+    // Standard mode: CCR = ceil(PCLK1 / 200 kHz), TRISE = FREQ + 1
+    {2000000u,  I2C_SPEED_STANDARD,  0, 2,  10,     3},
+    {8000000u,  I2C_SPEED_STANDARD,  0, 8,  40,     9},
+    {10500000u, I2C_SPEED_STANDARD,  0, 10, 53,     11},
+    {16000000u, I2C_SPEED_STANDARD,  0, 16, 80,     17},
+    {42000000u, I2C_SPEED_STANDARD,  0, 42, 210,    43},
+    {45000000u, I2C_SPEED_STANDARD,  0, 45, 225,    46},
+    {50000000u, I2C_SPEED_STANDARD,  0, 50, 250,    51},
+    // Fast mode 2:1: CCR = F/S | ceil(PCLK1 / 1.2 MHz), TRISE = floor(FREQ * 0.3) + 1
+    {4000000u,  I2C_SPEED_FAST,      0, 4,  0x8004, 2},
+    {16000000u, I2C_SPEED_FAST,      0, 16, 0x800E, 5},
+    {42000000u, I2C_SPEED_FAST,      0, 42, 0x8023, 13},
+    {45000000u, I2C_SPEED_FAST,      0, 45, 0x8026, 14},
+    {50000000u, I2C_SPEED_FAST,      0, 50, 0x802A, 16},
+    // Fast mode 16:9: CCR = F/S | DUTY | ceil(PCLK1 / 10 MHz)
+    {4000000u,  I2C_SPEED_FAST_DUTY, 0, 4,  0xC001, 2},
+    {16000000u, I2C_SPEED_FAST_DUTY, 0, 16, 0xC002, 5},
+    {45000000u, I2C_SPEED_FAST_DUTY, 0, 45, 0xC005, 14},
+    {50000000u, I2C_SPEED_FAST_DUTY, 0, 50, 0xC005, 16},
+    // Out of range
+    {1900000u,  I2C_SPEED_STANDARD,  1, 0,  0,      0},
+    {51000000u, I2C_SPEED_STANDARD,  1, 0,  0,      0},
+    {3000000u,  I2C_SPEED_FAST,      1, 0,  0,      0},
+    {3000000u,  I2C_SPEED_FAST_DUTY, 1, 0,  0,      0},
+    {45000000u, (I2C_SPEED)3,        1, 0,  0,      0},
+};
+
+TEST(timingTable)
+{
+    for (size_t i = 0; i < sizeof(timingCases) / sizeof(timingCases[0]); i++) {
+        const TimingCase *c = &timingCases[i];
+        I2C_Timing timing = {0, 0, 0};
+
+        CHECK_EQ(I2C_computeTiming(c->pclk1, c->speed, &timing), c->rv);
+        if (c->rv != 0) {
+            continue;
+        }
+        CHECK_EQ(timing.freq, c->freq);
+        CHECK_EQ(timing.ccr, c->ccr);
+        CHECK_EQ(timing.trise, c->trise);
+    }
+}
+
+TEST(timingLimits)
+{
+    // Every PCLK1 the peripheral accepts: SCL never faster than asked, rise time within the spec
+    for (uint32_t pclk1 = 2000000u; pclk1 <= 50000000u; pclk1 += 250000u) {
+        for (int speed = I2C_SPEED_STANDARD; speed <= I2C_SPEED_FAST_DUTY; speed++) {
+            I2C_Timing timing;
+
+            if (I2C_computeTiming(pclk1, (I2C_SPEED)speed, &timing) != 0) {
+                CHECK((speed != I2C_SPEED_STANDARD) && (pclk1 < 4000000u));
+                continue;
+            }
+
+            uint32_t ccr = timing.ccr & 0xFFFu;
+            uint32_t cycles = (speed == I2C_SPEED_STANDARD) ? (2u * ccr) :
+                              (speed == I2C_SPEED_FAST) ? (3u * ccr) : (25u * ccr);
+            uint32_t maxHz = (speed == I2C_SPEED_STANDARD) ? 100000u : 400000u;
+            uint32_t maxRiseNs = (speed == I2C_SPEED_STANDARD) ? 1000u : 300u;
+
+            CHECK(((uint64_t)pclk1) <= ((uint64_t)cycles * maxHz));
+            CHECK(((uint64_t)(timing.trise - 1u) * 1000u) <= ((uint64_t)timing.freq * maxRiseNs));
+        }
+    }
+}
+
+TEST(initProgramsRegisters)
+{
+    // APB1 prescaler /4 and /2 of the 180 MHz HCLK: PCLK1 45 MHz and 90 MHz (out of range)
+    CHECK_EQ(I2C_init(I2C_SPEED_STANDARD), 0);
+    CHECK_EQ(fake_I2C1.CR2.value & 0x3Fu, 45);
+    CHECK_EQ(fake_I2C1.CCR.value, 225);
+    CHECK_EQ(fake_I2C1.TRISE.value, 46);
+
+    CHECK_EQ(I2C_init(I2C_SPEED_FAST), 0);
+    CHECK_EQ(fake_I2C1.CCR.value, 0x8026);
+    CHECK_EQ(fake_I2C1.TRISE.value, 14);
+
+    fake_RCC.CFGR.value = (fake_RCC.CFGR.value & ~RCC_CFGR_PPRE1) | RCC_CFGR_PPRE1_DIV2;
+    CHECK_EQ(I2C_init(I2C_SPEED_FAST), 1);
+}
@@ -0,0 +1,92 @@
+/**
+ * Bit-band pixel writes (SSD1306_BITBAND, built with SSD1306_BITBAND_EMULATE, see the Makefile):
+ * the alias address of every bit is 0x22000000 + offset * 32 + bit * 4, and pixels plotted through
+ * the alias give the buffer, strips and panel of the shift/mask path.
+*/
+
+#include "test.h"
+
+#define RANDOM_PIXELS   200000
+
+static __ALIGNED(4) uint8_t expected[SSD1306_BUFFER_SIZE];
+
+static uint32_t seed = 1;
+
+static uint32_t nextRandom(void)
+{
+    seed = (seed * 1103515245u) + 12345u;
+    return seed >> 8;
+}
+
+TEST(aliasAddresses)
+{
+    // First and last bit of the region, of the 128 KB SRAM of the F411, and the example of PM0214
+    CHECK_EQ(SSD1306_bitbandAlias(0x20000000u, 0), 0x22000000u);
+    CHECK_EQ(SSD1306_bitbandAlias(0x20000000u, 7), 0x2200001Cu);
+    CHECK_EQ(SSD1306_bitbandAlias(0x20000001u, 0), 0x22000020u);
+    CHECK_EQ(SSD1306_bitbandAlias(0x2001FFFFu, 7), 0x223FFFFCu);
+    CHECK_EQ(SSD1306_bitbandAlias(0x200FFFFFu, 7), 0x23FFFFFCu);
+    CHECK_EQ(SSD1306_bitbandAlias(0x20000300u, 2), 0x22006008u);
+
+    // Every bit of the region owns its own word
+    int bad = 0;
+    for (uint32_t offset = 0; offset < BITBAND_REGION_SIZE; offset += 0x1F3u) {
+        for (uint8_t bit = 0; bit < 8; bit++) {
+            bad += (SSD1306_bitbandAlias(0x20000000u + offset, bit) != (0x22000000u + (offset * 32u) + (bit * 4u)));
+        }
+    }
+    CHECK_EQ(bad, 0);
+}
+
+TEST(pixelsMatchShiftMask)
+{
+    testBoot(I2C_SPEED_FAST);
+    SSD1306_fill(BLACK);
+    memset(expected, 0, sizeof(expected));
+
+    // Random plotting, e.g. a scatter chart
+    for (int n = 0; n < RANDOM_PIXELS; n++) {
+        uint8_t x = (uint8_t)(nextRandom() % 140u);
+        uint8_t y = (uint8_t)(nextRandom() % 70u);
+        SSD1306_COLOR color = (SSD1306_COLOR)(nextRandom() & 1u);
+
+        SSD1306_draw_pixel(x, y, color);
+        if ((x < SSD1306_WIDTH) && (y < SSD1306_HEIGHT)) {
+            uint8_t *byte = &expected[((y / 8) * SSD1306_WIDTH) + x];
+
+            if (color == WHITE) {
+                *byte |= (uint8_t)(1u << (y % 8));
+            } else {
+                *byte &= (uint8_t)~(1u << (y % 8));
+            }
+        }
+    }
+    CHECK(memcmp(expected, backBuffer, sizeof(expected)) == 0);
+
+    CHECK_EQ(SSD1306_update(), 0);
+    CHECK_EQ(testPanelMismatches(), 0);
+}
+
+static void drawLines(void)
+{
+    // A line chart: one pixel per column
+    for (uint8_t x = 0; x < SSD1306_WIDTH; x++) {
+        SSD1306_draw_pixel(x, (uint8_t)((x * 37u) % SSD1306_HEIGHT), WHITE);
+        SSD1306_draw_pixel(x, (uint8_t)(SSD1306_HEIGHT - 1u - (x % SSD1306_HEIGHT)), WHITE);
+    }
+}
+
+TEST(stripsMatchBuffer)
+{
+    testBoot(I2C_SPEED_FAST);
+
+    // Strips go to the page buffers of the pipelined update instead of the screenbuffer
+    CHECK_EQ(SSD1306_updateStrips(drawLines), 0);
+    uint8_t strips[8][SSD1306_WIDTH];
+    memcpy(strips, fake.panel.gram, sizeof(strips));
+
+    SSD1306_fill(BLACK);
+    drawLines();
+    CHECK_EQ(SSD1306_update(), 0);
+    CHECK(memcmp(strips, fake.panel.gram, sizeof(strips)) == 0);
+}
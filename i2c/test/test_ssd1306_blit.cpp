@@ -0,0 +1,235 @@
+/**
+ * Page byte blitter (SSD1306_blitRows() behind SSD1306_writeImg()): every image at every position
+ * gives the buffer and dirty ranges of the per-pixel path it replaced, and every draw mode matches
+ * a pixel model. The benchmark prints the host time per image of both paths.
+*/
+
+#include <vector>
+#include "test.h"
+
+#define BENCH_LOOPS     20000
+
+static __ALIGNED(4) uint8_t start[SSD1306_BUFFER_SIZE];
+static __ALIGNED(4) uint8_t expected[SSD1306_BUFFER_SIZE];
+
+static uint32_t seed = 1;
+
+static uint32_t nextRandom(void)
+{
+    seed = (seed * 1103515245u) + 12345u;
+    return seed >> 8;
+}
+
+/**
+ * @brief   SSD1306_writeImg() as it was: one SSD1306_draw_pixel() per pixel, SSD1306_DRAW_COPY only
+*/
+static void pixelPath(ImgDef Img, SSD1306_COLOR color)
+{
+    SSD1306.xpos_init = SSD1306.xpos;
+    SSD1306.ypos_init = SSD1306.ypos;
+
+    if ((SSD1306_WIDTH <= (SSD1306.xpos + Img.imgWidth)) ||
+        (SSD1306_HEIGHT <= (SSD1306.ypos + Img.imgHeight))) {
+        return;
+    }
+
+    for (uint8_t imgSection = 0; imgSection < Img.imgSections; imgSection++) {
+        for (uint32_t i = 0; i < Img.imgHeight; i++) {
+            uint32_t pixel = Img.data[i + (imgSection * Img.imgHeight)];
+
+            for (uint32_t j = 0; j < Img.imgWidth; j++) {
+                if ((pixel << j) & 0x8000) {
+                    SSD1306_draw_pixel((SSD1306.xpos + j), (SSD1306.ypos + i), color);
+                } else {
+                    SSD1306_draw_pixel((SSD1306.xpos + j), (SSD1306.ypos + i), (SSD1306_COLOR)!color);
+                }
+            }
+        }
+        SSD1306.xpos += Img.imgWidth;
+    }
+}
+
+/**
+ * @brief   Pixel model of the draw modes
+*/
+static uint8_t modelPixel(uint8_t old, uint8_t ink, uint8_t opaque, SSD1306_COLOR color, SSD1306_DRAW_MODE mode)
+{
+    uint8_t c = (color == WHITE) ? 1u : 0u;
+
+    switch (mode) {
+    case SSD1306_DRAW_OR:
+        return ink ? c : old;
+    case SSD1306_DRAW_AND_NOT:
+        return ink ? (uint8_t)!c : old;
+    case SSD1306_DRAW_XOR:
+        return ink ? (uint8_t)!old : old;
+    case SSD1306_DRAW_MASK:
+        if (!opaque) {
+            return old;
+        }
+        return ink ? c : (uint8_t)!c;
+    default:
+        return ink ? c : (uint8_t)!c;
+    }
+}
+
+/**
+ * @brief   Expected buffer after drawing an image at a position, from the pixel model
+*/
+static void modelImg(const ImgDef *img, uint8_t x, uint8_t y, SSD1306_COLOR color, SSD1306_DRAW_MODE mode)
+{
+    memcpy(expected, start, sizeof(expected));
+    if (((x + img->imgWidth) >= SSD1306_WIDTH) || ((y + img->imgHeight) >= SSD1306_HEIGHT)) {
+        return;
+    }
+
+    for (int section = 0; section < img->imgSections; section++) {
+        for (int row = 0; row < img->imgHeight; row++) {
+            uint16_t bits = img->data[(section * img->imgHeight) + row];
+            uint16_t mask = (img->mask != NULL) ? img->mask[(section * img->imgHeight) + row] : 0xFFFFu;
+
+            for (int col = 0; col < img->imgWidth; col++) {
+                int px = x + (section * img->imgWidth) + col;
+                int py = y + row;
+
+                if (px >= (int)SSD1306_WIDTH) {
+                    continue;
+                }
+                uint8_t *byte = &expected[((py / 8) * SSD1306_WIDTH) + px];
+                uint8_t old = (*byte >> (py % 8)) & 1u;
+                uint8_t now = modelPixel(old, (bits >> (15 - col)) & 1u, (mask >> (15 - col)) & 1u, color, mode);
+
+                *byte = (uint8_t)((*byte & ~(1u << (py % 8))) | (now << (py % 8)));
+            }
+        }
+    }
+}
+
+/**
+ * @brief   Random image of w x h pixels per section, with or without a mask
+*/
+static ImgDef randomImg(std::vector<uint16_t> *data, std::vector<uint16_t> *mask, uint8_t w, uint8_t h, uint8_t sections)
+{
+    ImgDef img = {w, h, NULL, sections, NULL};
+
+    data->resize((size_t)h * sections);
+    mask->resize((size_t)h * sections);
+    for (size_t i = 0; i < data->size(); i++) {
+        (*data)[i] = (uint16_t)nextRandom();
+        (*mask)[i] = (uint16_t)nextRandom() | (*data)[i];
+    }
+    img.data = data->data();
+    if (nextRandom() & 1u) {
+        img.mask = mask->data();
+    }
+    return img;
+}
+
+static void randomStart(void)
+{
+    for (size_t i = 0; i < sizeof(start); i++) {
+        start[i] = (uint8_t)nextRandom();
+    }
+}
+
+static void drawAt(const ImgDef *img, uint8_t x, uint8_t y, SSD1306_COLOR color, uint8_t pixels)
+{
+    memcpy(backBuffer, start, sizeof(start));
+    memset(dirtyMin, SSD1306_CLEAN_MIN, sizeof(dirtyMin));
+    memset(dirtyMax, SSD1306_CLEAN_MAX, sizeof(dirtyMax));
+    SSD1306_setCursor(x, y);
+    if (pixels) {
+        pixelPath(*img, color);
+    } else {
+        SSD1306_writeImg(*img, color);
+    }
+}
+
+TEST(matchesPixelPath)
+{
+    uint8_t min[SSD1306_HEIGHT / 8];
+    uint8_t max[SSD1306_HEIGHT / 8];
+    std::vector<uint16_t> data;
+    std::vector<uint16_t> mask;
+    int bad = 0;
+
+    testBoot(I2C_SPEED_FAST);
+    randomStart();
+
+    for (int n = 0; n < 60; n++) {
+        ImgDef img = (n == 0) ? Ryu_32x36 : (n == 1) ? DogDown_22x20 :
+                     randomImg(&data, &mask, (uint8_t)(1u + (nextRandom() % 16u)), (uint8_t)(1u + (nextRandom() % 40u)), (uint8_t)(1u + (nextRandom() % 3u)));
+        img.mask = NULL;
+
+        // Every row, so every offset into a page, and columns up to the right edge
+        for (uint8_t y = 0; y < SSD1306_HEIGHT; y++) {
+            for (uint8_t x = 0; x < SSD1306_WIDTH; x += 9) {
+                SSD1306_COLOR color = (SSD1306_COLOR)((x + y) & 1);
+
+                drawAt(&img, x, y, color, 1);
+                memcpy(expected, backBuffer, sizeof(expected));
+                memcpy(min, dirtyMin, sizeof(min));
+                memcpy(max, dirtyMax, sizeof(max));
+
+                drawAt(&img, x, y, color, 0);
+                bad += (memcmp(expected, backBuffer, sizeof(expected)) != 0);
+                bad += (memcmp(min, dirtyMin, sizeof(min)) != 0);
+                bad += (memcmp(max, dirtyMax, sizeof(max)) != 0);
+            }
+        }
+    }
+    CHECK_EQ(bad, 0);
+}
+
+TEST(drawModesMatchModel)
+{
+    std::vector<uint16_t> data;
+    std::vector<uint16_t> mask;
+    int bad = 0;
+
+    testBoot(I2C_SPEED_FAST);
+
+    for (int n = 0; n < 3000; n++) {
+        ImgDef img = randomImg(&data, &mask, (uint8_t)(1u + (nextRandom() % 16u)), (uint8_t)(1u + (nextRandom() % 40u)), (uint8_t)(1u + (nextRandom() % 3u)));
+        SSD1306_DRAW_MODE mode = (SSD1306_DRAW_MODE)(nextRandom() % (SSD1306_DRAW_MASK + 1u));
+        SSD1306_COLOR color = (SSD1306_COLOR)(nextRandom() & 1u);
+        uint8_t x = (uint8_t)(nextRandom() % SSD1306_WIDTH);
+        uint8_t y = (uint8_t)(nextRandom() % SSD1306_HEIGHT);
+
+        randomStart();
+        modelImg(&img, x, y, color, mode);
+        SSD1306_setDrawMode(mode);
+        drawAt(&img, x, y, color, 0);
+        SSD1306_setDrawMode(SSD1306_DRAW_COPY);
+        bad += (memcmp(expected, backBuffer, sizeof(expected)) != 0);
+    }
+    CHECK_EQ(bad, 0);
+}
+
+TEST(benchmark)
+{
+    static const ImgDef *const imgs[] = {&Ryu_32x36, &DogDown_22x20};
+    static const char *const names[] = {"Ryu_32x36", "DogDown_22x20"};
+
+    testBoot(I2C_SPEED_FAST);
+
+    for (int i = 0; i < 2; i++) {
+        uint64_t ns[2];
+
+        for (int pixels = 0; pixels < 2; pixels++) {
+            uint64_t t0 = testHostNs();
+
+            for (int n = 0; n < BENCH_LOOPS; n++) {
+                SSD1306_setCursor((uint8_t)(n % 64), (uint8_t)(n % 24));
+                if (pixels) {
+                    pixelPath(*imgs[i], WHITE);
+                } else {
+                    SSD1306_writeImg(*imgs[i], WHITE);
+                }
+            }
+            ns[pixels] = (testHostNs() - t0) / BENCH_LOOPS;
+        }
+        printf("    %s: per pixel %llu ns, page bytes %llu ns\n",
+               names[i], (unsigned long long)ns[1], (unsigned long long)ns[0]);
+    }
+}
@@ -0,0 +1,175 @@
+/**
+ * Collision tests (SSD1306_imgCollide(), SSD1306_spriteCollide(), SSD1306_spriteHitsFrame()) against
+ * a naive pixel by pixel check, for random images with and without masks at overlapping, touching
+ * and distant positions. The benchmark prints the host time of both.
+*/
+
+#include <vector>
+#include "test.h"
+
+#define RANDOM_PAIRS    200000
+#define BENCH_LOOPS     200000
+
+static uint32_t seed = 1;
+
+static uint32_t nextRandom(void)
+{
+    seed = (seed * 1103515245u) + 12345u;
+    return seed >> 8;
+}
+
+/**
+ * @brief   Pixel of an image (its mask if it has one), 0 outside
+*/
+static uint8_t imgPixel(const ImgDef *img, int x, int y)
+{
+    const uint16_t *plane = (img->mask != NULL) ? img->mask : img->data;
+
+    if ((x < 0) || (y < 0) || (x >= (img->imgWidth * img->imgSections)) || (y >= img->imgHeight)) {
+        return 0;
+    }
+    return (plane[((x / img->imgWidth) * img->imgHeight) + y] >> (15 - (x % img->imgWidth))) & 1u;
+}
+
+static uint8_t naiveCollide(const ImgDef *a, int ax, int ay, const ImgDef *b, int bx, int by)
+{
+    for (int y = 0; y < a->imgHeight; y++) {
+        for (int x = 0; x < (a->imgWidth * a->imgSections); x++) {
+            if (imgPixel(a, x, y) && imgPixel(b, (ax + x) - bx, (ay + y) - by)) {
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+static uint8_t naiveHitsFrame(const ImgDef *img, int sx, int sy, const uint8_t *frame)
+{
+    for (int y = 0; y < img->imgHeight; y++) {
+        for (int x = 0; x < (img->imgWidth * img->imgSections); x++) {
+            int px = sx + x;
+            int py = sy + y;
+
+            if ((px < (int)SSD1306_WIDTH) && (py < (int)SSD1306_HEIGHT) && imgPixel(img, x, y) &&
+                ((frame[((py / 8) * SSD1306_WIDTH) + px] >> (py % 8)) & 1u)) {
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief   Random sparse image, so that overlapping boxes often do not collide
+*/
+static ImgDef randomImg(std::vector<uint16_t> *data, std::vector<uint16_t> *mask)
+{
+    uint8_t w = (uint8_t)(1u + (nextRandom() % 16u));
+    uint8_t h = (uint8_t)(1u + (nextRandom() % 40u));
+    uint8_t sections = (uint8_t)(1u + (nextRandom() % 3u));
+    ImgDef img = {w, h, NULL, sections, NULL};
+
+    data->resize((size_t)h * sections);
+    mask->resize((size_t)h * sections);
+    for (size_t i = 0; i < data->size(); i++) {
+        (*data)[i] = (uint16_t)(nextRandom() & nextRandom() & nextRandom());
+        (*mask)[i] = (uint16_t)((*data)[i] | ((*data)[i] >> 1));
+    }
+    img.data = data->data();
+    if (nextRandom() & 1u) {
+        img.mask = mask->data();
+    }
+    return img;
+}
+
+TEST(imgCollideMatchesNaive)
+{
+    std::vector<uint16_t> dataA;
+    std::vector<uint16_t> maskA;
+    std::vector<uint16_t> dataB;
+    std::vector<uint16_t> maskB;
+    int bad = 0;
+    int hits = 0;
+
+    for (int n = 0; n < RANDOM_PAIRS; n++) {
+        ImgDef a = randomImg(&dataA, &maskA);
+        ImgDef b = randomImg(&dataB, &maskB);
+        int16_t ax = (int16_t)((int)(nextRandom() % 100u) - 20);
+        int16_t ay = (int16_t)((int)(nextRandom() % 80u) - 10);
+
+        // Mostly overlapping boxes, some just touching or apart
+        int16_t bx = (int16_t)(ax + (int)(nextRandom() % 70u) - 50);
+        int16_t by = (int16_t)(ay + (int)(nextRandom() % 60u) - 42);
+
+        uint8_t expected = naiveCollide(&a, ax, ay, &b, bx, by);
+        hits += expected;
+        bad += (SSD1306_imgCollide(&a, ax, ay, &b, bx, by) != expected);
+        bad += (SSD1306_imgCollide(&b, bx, by, &a, ax, ay) != expected);
+    }
+    CHECK_EQ(bad, 0);
+
+    // Both answers are well represented
+    CHECK(hits > (RANDOM_PAIRS / 10));
+    CHECK(hits < (RANDOM_PAIRS - (RANDOM_PAIRS / 10)));
+}
+
+TEST(spritesMatchNaive)
+{
+    static const ImgDef *framesA[1];
+    static const ImgDef *framesB[1];
+    static uint8_t frame[SSD1306_BUFFER_SIZE];
+    std::vector<uint16_t> dataA;
+    std::vector<uint16_t> maskA;
+    std::vector<uint16_t> dataB;
+    std::vector<uint16_t> maskB;
+    int bad = 0;
+
+    testBoot(I2C_SPEED_FAST);
+
+    for (int n = 0; n < 20000; n++) {
+        ImgDef a = randomImg(&dataA, &maskA);
+        ImgDef b = randomImg(&dataB, &maskB);
+        uint8_t ax = (uint8_t)(nextRandom() % SSD1306_WIDTH);
+        uint8_t ay = (uint8_t)(nextRandom() % SSD1306_HEIGHT);
+        uint8_t bx = (uint8_t)(nextRandom() % SSD1306_WIDTH);
+        uint8_t by = (uint8_t)(nextRandom() % SSD1306_HEIGHT);
+
+        framesA[0] = &a;
+        framesB[0] = &b;
+        CHECK_EQ(SSD1306_spriteSet(0, framesA, 1, ax, ay, 0), 0);
+        CHECK_EQ(SSD1306_spriteSet(1, framesB, 1, bx, by, 0), 0);
+        CHECK_EQ(SSD1306_spriteShow(0, 1), 0);
+        CHECK_EQ(SSD1306_spriteShow(1, (uint8_t)(n & 1)), 0);
+
+        uint8_t expected = (n & 1) ? naiveCollide(&a, ax, ay, &b, bx, by) : 0;
+        bad += (SSD1306_spriteCollide(0, 1) != expected);
+
+        // Sparse random background
+        for (size_t i = 0; i < sizeof(frame); i++) {
+            frame[i] = (uint8_t)(nextRandom() & nextRandom() & nextRandom() & nextRandom());
+        }
+        bad += (SSD1306_spriteHitsFrame(0, frame) != naiveHitsFrame(&a, ax, ay, frame));
+    }
+    CHECK_EQ(bad, 0);
+}
+
+TEST(benchmark)
+{
+    static const ImgDef *const imgs[] = {&Ryu_32x36, &DogDown_22x20};
+    uint32_t sum = 0;
+    uint64_t ns[2];
+
+    for (int naive = 0; naive < 2; naive++) {
+        uint64_t t0 = testHostNs();
+
+        for (int n = 0; n < BENCH_LOOPS; n++) {
+            int16_t bx = (int16_t)(n % 40);
+            int16_t by = (int16_t)(n % 30);
+
+            sum += naive ? naiveCollide(imgs[0], 0, 0, imgs[1], bx, by) : SSD1306_imgCollide(imgs[0], 0, 0, imgs[1], bx, by);
+        }
+        ns[naive] = (testHostNs() - t0) / BENCH_LOOPS;
+    }
+    printf("    Ryu_32x36 vs DogDown_22x20: naive %llu ns, rows of 32 columns %llu ns (%u hits)\n",
+           (unsigned long long)ns[1], (unsigned long long)ns[0], sum / 2u);
+}
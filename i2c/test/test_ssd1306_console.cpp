@@ -0,0 +1,208 @@
+/**
+ * Text console (SSD1306_consoleInit()/SSD1306_consoleWrite()): after thousands of lines the image
+ * the panel shows (GDDRAM read from the display start line) is the last lines of text, for every
+ * font, diff mode and update mode. SSD1306_writeString() draws the whole string, stops at the first
+ * character that does not fit on the line and wraps when asked to.
+*/
+
+#include <string>
+#include <deque>
+#include "test.h"
+
+#define CONSOLE_LINES   2000        // Lines written per configuration
+#define UPDATE_EVERY    13          // Lines between two updates
+
+typedef struct {
+    const FontDef *font;
+    int pages;                      // Pages per text line
+    int lines;                      // Text lines on the screen
+    int perLine;                    // Characters per text line
+    SSD1306_COLOR color;
+} ConsoleRef;
+
+/**
+ * @brief   Add text to the model of the console: wrap at the end of the line, scroll past the last line
+*/
+static void refWrite(const ConsoleRef *c, std::deque<std::string> *text, const std::string &str)
+{
+    for (char ch : str) {
+        if (ch == '\n') {
+            text->push_back("");
+            continue;
+        }
+        if ((int)text->back().size() == c->perLine) {
+            text->push_back("");
+        }
+        text->back() += ch;
+    }
+    while ((int)text->size() > c->lines) {
+        text->pop_front();
+    }
+}
+
+/**
+ * @brief   Pixels the panel shows differently from the model
+*/
+static int wrongPixels(const ConsoleRef *c, const std::deque<std::string> &text)
+{
+    const FontDef *font = c->font;
+    int wrong = 0;
+
+    for (int y = 0; y < (int)SSD1306_HEIGHT; y++) {
+        for (int x = 0; x < (int)SSD1306_WIDTH; x++) {
+            int line = y / (c->pages * 8);
+            int row = y % (c->pages * 8);
+            int expected = 0;
+
+            if ((line < c->lines) && (line < (int)text.size())) {
+                const std::string &str = text[line];
+                int index = x / font->FontWidth;
+
+                if ((index < (int)str.size()) && (row < font->FontHeight)) {
+                    uint16_t bits = font->data[((str[index] - 32) * font->FontHeight) + row];
+                    expected = (bits >> (15 - (x % font->FontWidth))) & 1;
+                }
+            }
+            if (c->color == BLACK) {
+                expected ^= 1;
+            }
+            wrong += (fakePixel((uint8_t)x, (uint8_t)y) != expected);
+        }
+    }
+    return wrong;
+}
+
+static void consoleRun(const FontDef *font, SSD1306_COLOR color)
+{
+    ConsoleRef c;
+
+    c.font = font;
+    c.pages = (font->FontHeight + 7) / 8;
+    c.lines = (SSD1306_HEIGHT / 8) / c.pages;
+    c.perLine = SSD1306_WIDTH / font->FontWidth;
+    c.color = color;
+
+    for (int diff = SSD1306_DIFF_NONE; diff <= SSD1306_DIFF_CRC; diff++) {
+        for (int mode = SSD1306_UPDATE_PAGE; mode <= SSD1306_UPDATE_HORIZONTAL; mode++) {
+            std::deque<std::string> text(1, "");
+            uint32_t seed = 1u + (uint32_t)(diff * 3) + (uint32_t)mode + font->FontWidth;
+            int badUpdates = 0;
+
+            // Every configuration gets the time limit of a test
+            fake.limitNs = fake.nowNs + 20000000000ull;
+            testBoot(I2C_SPEED_FAST);
+            CHECK_EQ(SSD1306_setUpdateMode((SSD1306_UPDATE_MODE)mode), 0);
+            CHECK_EQ(SSD1306_setDiffMode((SSD1306_DIFF_MODE)diff), 0);
+            CHECK_EQ(SSD1306_consoleInit(font, color), 0);
+
+            for (int n = 0; n < CONSOLE_LINES; n++) {
+                // Random printable text, sometimes longer than a line
+                std::string str;
+                seed = (seed * 1103515245u) + 12345u;
+                int len = (int)((seed >> 16) % (uint32_t)(c.perLine + 6));
+                for (int k = 0; k < len; k++) {
+                    seed = (seed * 1103515245u) + 12345u;
+                    str += (char)(32u + ((seed >> 16) % 95u));
+                }
+                str += "\n";
+
+                refWrite(&c, &text, str);
+                CHECK_EQ(SSD1306_consoleWrite(str.c_str()), 0);
+
+                if (((n % UPDATE_EVERY) == 0) || (n == (CONSOLE_LINES - 1))) {
+                    CHECK_EQ(SSD1306_update(), 0);
+                    badUpdates += (wrongPixels(&c, text) != 0);
+                }
+            }
+            CHECK_EQ(badUpdates, 0);
+
+            // Leaving the console keeps the text where it is, with the start line back at 0
+            SSD1306_consoleEnd();
+            CHECK_EQ(SSD1306_update(), 0);
+            CHECK_EQ(fake.panel.startLine, 0);
+            CHECK_EQ(wrongPixels(&c, text), 0);
+            CHECK_EQ(testPanelMismatches(), 0);
+            CHECK_EQ(fake.dropped, 0);
+        }
+    }
+}
+
+TEST(console7x10)
+{
+    consoleRun(&Font_7x10, WHITE);
+}
+
+TEST(console11x18Inverted)
+{
+    consoleRun(&Font_11x18, BLACK);
+}
+
+TEST(console16x26)
+{
+    consoleRun(&Font_16x26, WHITE);
+}
+
+TEST(scrollCostsOnePage)
+{
+    testBoot(I2C_SPEED_FAST);
+    CHECK_EQ(SSD1306_consoleInit(&Font_7x10, WHITE), 0);
+    for (int i = 0; i < 8; i++) {
+        CHECK_EQ(SSD1306_consoleWrite("line\n"), 0);
+    }
+    CHECK_EQ(SSD1306_update(), 0);
+
+    // A scroll sends the start line, the cleared page and the new text, not the whole screen
+    size_t from = fake.txns.size();
+    CHECK_EQ(SSD1306_consoleWrite("next\n"), 0);
+    CHECK_EQ(SSD1306_update(), 0);
+    CHECK(fakeWireBytes(from) < (SSD1306_WIDTH * 2u) + 32u);
+}
+
+/**
+ * @brief   Pixels of a text line written with SSD1306_writeString() that the panel shows differently
+*/
+static int wrongTextPixels(const FontDef *font, uint8_t x0, uint8_t y0, const char *str)
+{
+    int wrong = 0;
+
+    for (int i = 0; str[i]; i++) {
+        for (int row = 0; row < font->FontHeight; row++) {
+            uint16_t bits = font->data[((str[i] - 32) * font->FontHeight) + row];
+
+            for (int col = 0; col < font->FontWidth; col++) {
+                int expected = (bits >> (15 - col)) & 1;
+                uint8_t x = (uint8_t)(x0 + (i * font->FontWidth) + col);
+                uint8_t y = (uint8_t)(y0 + row);
+
+                wrong += (fakePixel(x, y) != expected);
+            }
+        }
+    }
+    return wrong;
+}
+
+TEST(writeString)
+{
+    testBoot(I2C_SPEED_FAST);
+    SSD1306_fill(BLACK);
+
+    // Wrapped: 18 characters of 7x10 fit on a line, the rest goes to the next one
+    SSD1306_setCursor(0, 0);
+    CHECK_EQ(SSD1306_writeString("0123456789abcdefghijklmn", Font_7x10, WHITE, 1), 0);
+
+    // The whole string, from the cursor
+    SSD1306_setCursor(3, 24);
+    CHECK_EQ(SSD1306_writeString("Hello, world", Font_7x10, WHITE, 0), 0);
+    CHECK_EQ(SSD1306.xpos, 3 + (12 * 7));
+
+    // Not wrapped: the first character that does not fit is returned, the ones before are drawn
+    SSD1306_setCursor(0, 40);
+    CHECK_EQ(SSD1306_writeString("ABCDEFGHIJKLMNOPQRSTUVWXYZ", Font_7x10, WHITE, 0), 'S');
+
+    CHECK_EQ(SSD1306_update(), 0);
+    CHECK_EQ(wrongTextPixels(&Font_7x10, 0, 0, "0123456789abcdefgh"), 0);
+    CHECK_EQ(wrongTextPixels(&Font_7x10, 0, 10, "ijklmn"), 0);
+    CHECK_EQ(wrongTextPixels(&Font_7x10, 3, 24, "Hello, world"), 0);
+    CHECK_EQ(wrongTextPixels(&Font_7x10, 0, 40, "ABCDEFGHIJKLMNOPQR"), 0);
+    CHECK_EQ(testPanelMismatches(), 0);
+}
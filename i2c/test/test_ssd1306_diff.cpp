@@ -0,0 +1,201 @@
+/**
+ * Change detection (SSD1306_setDiffMode()): recorded frame sequences are sent with every diff mode.
+ * The panel shows every frame, and the shadow and CRC modes skip the dirty bytes that did not
+ * change (the hit rate is printed per sequence). Also built with SSD1306_NO_SHADOW, where the
+ * shadow mode is refused.
+*/
+
+#include "test.h"
+
+#define SEQUENCE_FRAMES     40
+
+typedef void (*FrameFunc)(int n);
+
+typedef struct {
+    size_t dirty;                   // Dirty bytes handed to the updates
+    size_t data;                    // Data bytes on the wire
+} DiffCount;
+
+static __ALIGNED(4) uint8_t background[SSD1306_BUFFER_SIZE];
+static const ImgDef *const dogFrames[] = {&DogDown_22x20, &DogUp_22x20};
+
+/**
+ * @brief   Write text from a cursor position, without wrapping
+*/
+static void drawText(uint8_t x, uint8_t y, const char *str, const FontDef *font)
+{
+    SSD1306_setCursor(x, y);
+    SSD1306_writeString(str, *font, WHITE, 0);
+}
+
+/**
+ * @brief   Dog sprites walking over a text background, composed like main.c does
+*/
+static void dogWalk(int n)
+{
+    if (n == 0) {
+        SSD1306_fill(BLACK);
+        for (uint8_t line = 0; line < 6; line++) {
+            drawText(0, (uint8_t)(line * 10u), "The quick brown fox", &Font_7x10);
+        }
+        memcpy(background, backBuffer, sizeof(background));
+        SSD1306_spriteBackground(background);
+        CHECK_EQ(SSD1306_spriteSet(0, dogFrames, 2, 0, 8, 0), 0);
+        CHECK_EQ(SSD1306_spriteSet(1, dogFrames, 2, 100, 40, 1), 0);
+        CHECK_EQ(SSD1306_spriteShow(0, 1), 0);
+        CHECK_EQ(SSD1306_spriteShow(1, 1), 0);
+    } else {
+        CHECK_EQ(SSD1306_spriteMoveBy(0, 2, 0), 0);
+        CHECK_EQ(SSD1306_spriteMoveBy(1, -1, (n & 4) ? 1 : -1), 0);
+        CHECK_EQ(SSD1306_spriteNextFrame(0), 0);
+        if ((n % 3) == 0) {
+            CHECK_EQ(SSD1306_spriteNextFrame(1), 0);
+        }
+    }
+    CHECK_EQ(SSD1306_spriteCompose(), 0);
+}
+
+/**
+ * @brief   The whole screen redrawn every frame, only a counter changes
+*/
+static void redrawText(int n)
+{
+    char counter[8];
+
+    snprintf(counter, sizeof(counter), "%05d", n * 7);
+    SSD1306_fill(BLACK);
+    drawText(4, 2, "Frame", &Font_11x18);
+    drawText(4, 30, counter, &Font_16x26);
+    SSD1306_fillRect(0, 58, 128, 6, WHITE);
+}
+
+/**
+ * @brief   A marker drawn and erased again within the frame: dirty, but nothing changed
+*/
+static void blink(int n)
+{
+    if (n == 0) {
+        SSD1306_fill(BLACK);
+        drawText(10, 20, "Idle", &Font_11x18);
+        return;
+    }
+    SSD1306_setDrawMode(SSD1306_DRAW_XOR);
+    for (int i = 0; i < 2; i++) {
+        SSD1306_setCursor((uint8_t)(n % 90), (uint8_t)(n % 25));
+        SSD1306_writeImg(Ryu_32x36, WHITE);
+    }
+    SSD1306_setDrawMode(SSD1306_DRAW_COPY);
+}
+
+static size_t dirtyBytes(void)
+{
+    size_t n = 0;
+
+    for (int page = 0; page < (int)(SSD1306_HEIGHT / 8); page++) {
+        if (dirtyMin[page] <= dirtyMax[page]) {
+            n += (size_t)(dirtyMax[page] - dirtyMin[page]) + 1u;
+        }
+    }
+    return n;
+}
+
+static size_t dataBytes(size_t from)
+{
+    size_t n = 0;
+
+    for (size_t i = from; i < fake.txns.size(); i++) {
+        if (!fake.txns[i].bytes.empty() && (fake.txns[i].bytes[0] == SSD1306_WRITE_DATA)) {
+            n += fake.txns[i].bytes.size() - 1u;
+        }
+    }
+    return n;
+}
+
+/**
+ * @brief   Send a sequence with one diff mode, the first frame (full resend) is not counted
+*/
+static DiffCount runSequence(FrameFunc frame, SSD1306_DIFF_MODE diff, SSD1306_UPDATE_MODE mode)
+{
+    DiffCount count = {0, 0};
+
+    testBoot(I2C_SPEED_FAST);
+    CHECK_EQ(SSD1306_setUpdateMode(mode), 0);
+    CHECK_EQ(SSD1306_setDiffMode(diff), 0);
+    memset(sprites, 0, sizeof(sprites));
+    SSD1306_spriteBackground(NULL);
+
+    for (int n = 0; n < SEQUENCE_FRAMES; n++) {
+        frame(n);
+
+        size_t dirty = dirtyBytes();
+        size_t from = fake.txns.size();
+        CHECK_EQ(SSD1306_update(), 0);
+        CHECK_EQ(testPanelMismatches(), 0);
+        if (n > 0) {
+            count.dirty += dirty;
+            count.data += dataBytes(from);
+        }
+    }
+    CHECK_EQ(fake.dropped, 0);
+    return count;
+}
+
+/**
+ * @brief   Run a sequence with every diff mode and check what the diff modes leave out
+ * @param maxShadow     Most data bytes of the shadow mode, in percent of the dirty bytes
+ * @param maxCrc        Most data bytes of the CRC mode, in percent of the dirty bytes
+*/
+static void hitRate(const char *name, FrameFunc frame, size_t maxShadow, size_t maxCrc)
+{
+    for (int mode = SSD1306_UPDATE_PAGE; mode <= SSD1306_UPDATE_HORIZONTAL; mode++) {
+        DiffCount none = runSequence(frame, SSD1306_DIFF_NONE, (SSD1306_UPDATE_MODE)mode);
+        DiffCount crc = runSequence(frame, SSD1306_DIFF_CRC, (SSD1306_UPDATE_MODE)mode);
+
+        // Without a diff every dirty byte is sent
+        CHECK_EQ(none.data, none.dirty);
+        CHECK_EQ(crc.dirty, none.dirty);
+        CHECK((crc.data * 100u) <= (none.dirty * maxCrc));
+        printf("    %s %s: %zu dirty bytes, CRC sends %zu",
+               name, (mode == SSD1306_UPDATE_PAGE) ? "page" : "horizontal", none.dirty, crc.data);
+
+#ifndef SSD1306_NO_SHADOW
+        DiffCount shadow = runSequence(frame, SSD1306_DIFF_SHADOW, (SSD1306_UPDATE_MODE)mode);
+
+        CHECK_EQ(shadow.dirty, none.dirty);
+        CHECK((shadow.data * 100u) <= (none.dirty * maxShadow));
+        printf(", shadow sends %zu", shadow.data);
+#else
+        (void)maxShadow;
+#endif
+        printf("\n");
+    }
+}
+
+TEST(dogWalkHitRate)
+{
+    // The sprites redraw their old and new areas, the background under them is mostly unchanged
+    hitRate("dog walk", dogWalk, 60, 85);
+}
+
+TEST(redrawTextHitRate)
+{
+    // A full screen redraw where only the last digits change
+    hitRate("redraw text", redrawText, 15, 25);
+}
+
+TEST(blinkHitRate)
+{
+    // Drawn and erased again: nothing to send at all
+    hitRate("blink", blink, 0, 0);
+}
+
+TEST(shadowBuiltIn)
+{
+    testBoot(I2C_SPEED_FAST);
+#ifdef SSD1306_NO_SHADOW
+    CHECK_EQ(SSD1306_setDiffMode(SSD1306_DIFF_SHADOW), 1);
+#else
+    CHECK_EQ(SSD1306_setDiffMode(SSD1306_DIFF_SHADOW), 0);
+#endif
+    CHECK_EQ(SSD1306_setDiffMode(SSD1306_DIFF_CRC), 0);
+}
@@ -0,0 +1,6 @@
+/**
+ * The change detection tests built with SSD1306_NO_SHADOW (see the Makefile): the CRC mode works
+ * without the 1 KB shadow, the shadow mode is refused.
+*/
+
+#include "test_ssd1306_diff.cpp"
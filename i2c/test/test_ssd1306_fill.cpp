@@ -0,0 +1,160 @@
+/**
+ * Word fills (SSD1306_fill(), SSD1306_fillRect()): random rectangles, partly off-screen, in both
+ * colors give the buffer and dirty ranges of a per-pixel fill, and the panel after an update.
+ * The benchmark prints the host time per full clear of the old byte loop, of the same loop kept to
+ * one store per byte (the host compiler turns the plain loop into a memset), of the word fill and
+ * of a screen sized SSD1306_fillRect() against per-pixel plots.
+*/
+
+#include "test.h"
+
+#define RANDOM_RECTS    5000
+#define BENCH_LOOPS     20000
+
+static __ALIGNED(4) uint8_t start[SSD1306_BUFFER_SIZE];
+static __ALIGNED(4) uint8_t expected[SSD1306_BUFFER_SIZE];
+
+static uint32_t seed = 1;
+
+static uint32_t nextRandom(void)
+{
+    seed = (seed * 1103515245u) + 12345u;
+    return seed >> 8;
+}
+
+/**
+ * @brief   SSD1306_fill() as it was: one byte at a time
+*/
+static void byteFill(SSD1306_COLOR color)
+{
+    for (uint32_t i = 0; i < SSD1306_BUFFER_SIZE; i++) {
+        backBuffer[i] = (color == BLACK) ? 0x00 : 0xFF;
+    }
+    SSD1306_markDirty(0, 0, SSD1306_WIDTH - 1, SSD1306_HEIGHT - 1);
+}
+
+/**
+ * @brief   The same loop with one store per byte, as the Cortex-M4 runs it
+*/
+static void byteStoreFill(SSD1306_COLOR color)
+{
+    volatile uint8_t *dst = backBuffer;
+
+    for (uint32_t i = 0; i < SSD1306_BUFFER_SIZE; i++) {
+        dst[i] = (color == BLACK) ? 0x00 : 0xFF;
+    }
+    SSD1306_markDirty(0, 0, SSD1306_WIDTH - 1, SSD1306_HEIGHT - 1);
+}
+
+static void resetBuffer(void)
+{
+    memcpy(backBuffer, start, sizeof(start));
+    memset(dirtyMin, SSD1306_CLEAN_MIN, sizeof(dirtyMin));
+    memset(dirtyMax, SSD1306_CLEAN_MAX, sizeof(dirtyMax));
+}
+
+TEST(fillMatchesBytes)
+{
+    testBoot(I2C_SPEED_FAST);
+
+    for (int color = 0; color < 2; color++) {
+        memset(expected, color ? 0xFF : 0x00, sizeof(expected));
+        for (size_t i = 0; i < sizeof(start); i++) {
+            start[i] = (uint8_t)nextRandom();
+        }
+        resetBuffer();
+        SSD1306_fill((SSD1306_COLOR)color);
+        CHECK(memcmp(expected, backBuffer, sizeof(expected)) == 0);
+        for (uint8_t page = 0; page < (SSD1306_HEIGHT / 8); page++) {
+            CHECK_EQ(dirtyMin[page], 0);
+            CHECK_EQ(dirtyMax[page], SSD1306_WIDTH - 1);
+        }
+        CHECK_EQ(SSD1306_update(), 0);
+        CHECK_EQ(testPanelMismatches(), 0);
+    }
+}
+
+TEST(fillRectMatchesPixels)
+{
+    uint8_t min[SSD1306_HEIGHT / 8];
+    uint8_t max[SSD1306_HEIGHT / 8];
+    int bad = 0;
+
+    testBoot(I2C_SPEED_FAST);
+
+    for (int n = 0; n < RANDOM_RECTS; n++) {
+        int16_t x = (int16_t)((int)(nextRandom() % 160u) - 16);
+        int16_t y = (int16_t)((int)(nextRandom() % 96u) - 16);
+        uint16_t w = (uint16_t)(nextRandom() % 150u);
+        uint16_t h = (uint16_t)(nextRandom() % 80u);
+        SSD1306_COLOR color = (SSD1306_COLOR)(nextRandom() & 1u);
+
+        for (size_t i = 0; i < sizeof(start); i++) {
+            start[i] = (uint8_t)nextRandom();
+        }
+
+        // Per-pixel fill of the part on the screen
+        resetBuffer();
+        for (int py = y; py < (y + h); py++) {
+            for (int px = x; px < (x + w); px++) {
+                if ((px >= 0) && (py >= 0) && (px < (int)SSD1306_WIDTH) && (py < (int)SSD1306_HEIGHT)) {
+                    SSD1306_draw_pixel((uint8_t)px, (uint8_t)py, color);
+                }
+            }
+        }
+        memcpy(expected, backBuffer, sizeof(expected));
+        memcpy(min, dirtyMin, sizeof(min));
+        memcpy(max, dirtyMax, sizeof(max));
+
+        resetBuffer();
+        SSD1306_fillRect(x, y, w, h, color);
+        bad += (memcmp(expected, backBuffer, sizeof(expected)) != 0);
+        bad += (memcmp(min, dirtyMin, sizeof(min)) != 0);
+        bad += (memcmp(max, dirtyMax, sizeof(max)) != 0);
+
+        if ((n % 500) == 0) {
+            // The random start was never sent
+            SSD1306_markDirty(0, 0, SSD1306_WIDTH - 1, SSD1306_HEIGHT - 1);
+            CHECK_EQ(SSD1306_update(), 0);
+            CHECK_EQ(testPanelMismatches(), 0);
+        }
+    }
+    CHECK_EQ(bad, 0);
+}
+
+TEST(benchmark)
+{
+    uint64_t ns[5];
+
+    testBoot(I2C_SPEED_FAST);
+
+    for (int path = 0; path < 5; path++) {
+        uint64_t t0 = testHostNs();
+        int loops = (path == 4) ? (BENCH_LOOPS / 100) : BENCH_LOOPS;
+
+        for (int n = 0; n < loops; n++) {
+            SSD1306_COLOR color = (SSD1306_COLOR)(n & 1);
+
+            if (path == 0) {
+                byteFill(color);
+            } else if (path == 1) {
+                byteStoreFill(color);
+            } else if (path == 2) {
+                SSD1306_fill(color);
+            } else if (path == 3) {
+                SSD1306_fillRect(0, 0, SSD1306_WIDTH, SSD1306_HEIGHT, color);
+            } else {
+                for (uint8_t y = 0; y < SSD1306_HEIGHT; y++) {
+                    for (uint8_t x = 0; x < SSD1306_WIDTH; x++) {
+                        SSD1306_draw_pixel(x, y, color);
+                    }
+                }
+            }
+        }
+        ns[path] = (testHostNs() - t0) / (uint64_t)loops;
+    }
+    printf("    full clear: byte loop %llu ns, one store per byte %llu ns, word fill %llu ns\n",
+           (unsigned long long)ns[0], (unsigned long long)ns[1], (unsigned long long)ns[2]);
+    printf("    screen sized rectangle: per pixel %llu ns, fillRect %llu ns\n",
+           (unsigned long long)ns[4], (unsigned long long)ns[3]);
+}
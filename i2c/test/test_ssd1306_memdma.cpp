@@ -0,0 +1,268 @@
+/**
+ * Screenbuffer transfers on DMA2 (built with SSD1306_MEMDMA): the queued fill, frame load and the
+ * merged back buffer copy of SSD1306_present() give the frames of the CPU copies, also when the
+ * queue is full and the driver falls back to the CPU. MEMDMA_wait() reports a transfer error once
+ * and gives up after its timeout.
+*/
+
+#include "test.h"
+
+#define RANDOM_ROUNDS   300
+#define SCRATCH_WORDS   256
+#define LONG_WORDS      65535u      // 1.6 ms for the model DMA
+
+static __ALIGNED(4) uint8_t frames[2][SSD1306_BUFFER_SIZE];
+static __ALIGNED(4) uint8_t expected[SSD1306_BUFFER_SIZE];
+static uint32_t scratch[4][SCRATCH_WORDS];
+static uint32_t longBuffer[LONG_WORDS];
+
+static uint32_t seed = 1;
+
+static uint32_t nextRandom(void)
+{
+    seed = (seed * 1103515245u) + 12345u;
+    return seed >> 8;
+}
+
+static void makeFrames(void)
+{
+    for (int f = 0; f < 2; f++) {
+        for (size_t i = 0; i < SSD1306_BUFFER_SIZE; i++) {
+            frames[f][i] = (uint8_t)nextRandom();
+        }
+    }
+}
+
+/**
+ * @brief   Set a pixel of the expected frame, the way the CPU path draws it
+*/
+static void refPixel(int x, int y, SSD1306_COLOR color)
+{
+    if ((x < 0) || (y < 0) || (x >= (int)SSD1306_WIDTH) || (y >= (int)SSD1306_HEIGHT)) {
+        return;
+    }
+    if (color == WHITE) {
+        expected[(x + ((y / 8) * SSD1306_WIDTH))] |= (uint8_t)(1u << (y % 8));
+    } else {
+        expected[(x + ((y / 8) * SSD1306_WIDTH))] &= (uint8_t)~(1u << (y % 8));
+    }
+}
+
+/**
+ * @brief   GDDRAM bytes of the panel that differ from the expected frame
+*/
+static int panelWrong(void)
+{
+    int wrong = 0;
+
+    for (int page = 0; page < (int)(SSD1306_HEIGHT / 8); page++) {
+        for (int col = 0; col < (int)SSD1306_WIDTH; col++) {
+            wrong += (fake.panel.gram[page][col] != expected[(page * SSD1306_WIDTH) + col]);
+        }
+    }
+    return wrong;
+}
+
+/**
+ * @brief   Occupy the whole transfer queue with short fills of the scratch words
+*/
+static void fillQueue(void)
+{
+    for (int i = 0; i < 4; i++) {
+        CHECK_EQ(MEMDMA_fill(scratch[i], 0x5A5A0000u + (uint32_t)i, SCRATCH_WORDS), 0);
+    }
+    CHECK_EQ(MEMDMA_fill(scratch[0], 0, 1), 1);
+}
+
+static void checkScratch(void)
+{
+    for (int i = 0; i < 4; i++) {
+        CHECK_EQ(scratch[i][SCRATCH_WORDS - 1], 0x5A5A0000u + (uint32_t)i);
+    }
+}
+
+TEST(queuedFill)
+{
+    testBoot(I2C_SPEED_FAST);
+
+    for (int color = 0; color < 2; color++) {
+        uint32_t before = fake.memDmaTransfers;
+
+        memset(expected, color ? 0xFF : 0x00, sizeof(expected));
+        SSD1306_fill((SSD1306_COLOR)color);
+        CHECK(MEMDMA_isBusy());
+        CHECK_EQ(SSD1306_update(), 0);
+        CHECK_EQ(panelWrong(), 0);
+        CHECK_EQ(testPanelMismatches(), 0);
+        CHECK(fake.memDmaTransfers > before);
+    }
+}
+
+TEST(fillFallback)
+{
+    testBoot(I2C_SPEED_FAST);
+    SSD1306_fill(BLACK);
+    CHECK_EQ(MEMDMA_wait(1000), 0);
+
+    // Queue full: the fill waits for the queue and is done by the CPU
+    uint32_t before = fake.memDmaTransfers;
+    fillQueue();
+    SSD1306_fill(WHITE);
+    CHECK(!MEMDMA_isBusy());
+    CHECK_EQ(fake.memDmaTransfers, before + 4u);
+    checkScratch();
+
+    memset(expected, 0xFF, sizeof(expected));
+    CHECK(memcmp(backBuffer, expected, sizeof(expected)) == 0);
+    CHECK_EQ(SSD1306_update(), 0);
+    CHECK_EQ(panelWrong(), 0);
+}
+
+TEST(loadFrame)
+{
+    testBoot(I2C_SPEED_FAST);
+    makeFrames();
+
+    for (int full = 0; full < 2; full++) {
+        uint32_t before = fake.memDmaTransfers;
+
+        // Queued, or done by the CPU behind a full queue. Drawing waits for the copy, so the pixels
+        // (the other color than the frame has there) land on top of the frame.
+        SSD1306_COLOR first = (frames[full][5] & (1u << 5)) ? BLACK : WHITE;
+        SSD1306_COLOR second = (frames[full][(7 * SSD1306_WIDTH) + 6] & (1u << 4)) ? BLACK : WHITE;
+
+        if (full) {
+            fillQueue();
+        }
+        CHECK_EQ(SSD1306_loadFrame(frames[full]), 0);
+        CHECK_EQ(MEMDMA_isBusy(), !full);
+        SSD1306_draw_pixel(5, 5, first);
+        SSD1306_draw_pixel(6, 60, second);
+
+        memcpy(expected, frames[full], sizeof(expected));
+        refPixel(5, 5, first);
+        refPixel(6, 60, second);
+        CHECK_EQ(SSD1306_update(), 0);
+        CHECK_EQ(panelWrong(), 0);
+        CHECK_EQ(testPanelMismatches(), 0);
+        CHECK_EQ(fake.memDmaTransfers, before + (full ? 4u : 1u) + 1u);
+        if (full) {
+            checkScratch();
+        }
+    }
+}
+
+TEST(presentMergedCopy)
+{
+    testBoot(I2C_SPEED_FAST);
+    makeFrames();
+    CHECK_EQ(SSD1306_loadFrame(frames[0]), 0);
+    CHECK_EQ(SSD1306_update(), 0);
+    CHECK_EQ(MEMDMA_wait(1000), 0);
+
+    // Changes on two pages far apart: one copy from the first to the last dirty word
+    uint32_t before = fake.memDmaTransfers;
+    SSD1306_draw_pixel(10, 9, WHITE);
+    SSD1306_draw_pixel(100, 45, BLACK);
+    CHECK_EQ(SSD1306_update(), 0);
+    CHECK_EQ(MEMDMA_wait(1000), 0);
+    CHECK_EQ(fake.memDmaTransfers, before + 1u);
+
+    // The back buffer holds the presented frame again
+    CHECK(memcmp(backBuffer, frontBuffer, SSD1306_BUFFER_SIZE) == 0);
+    memcpy(expected, frames[0], sizeof(expected));
+    refPixel(10, 9, WHITE);
+    refPixel(100, 45, BLACK);
+    CHECK_EQ(panelWrong(), 0);
+}
+
+TEST(randomFramesMatchCpu)
+{
+    int bad = 0;
+
+    testBoot(I2C_SPEED_FAST);
+    makeFrames();
+    SSD1306_fill(BLACK);
+    memset(expected, 0x00, sizeof(expected));
+    uint32_t before = fake.memDmaTransfers;
+
+    for (int n = 0; n < RANDOM_ROUNDS; n++) {
+        int ops = 1 + (int)(nextRandom() % 4u);
+
+        for (int k = 0; k < ops; k++) {
+            uint32_t op = nextRandom() % 8u;
+            SSD1306_COLOR color = (SSD1306_COLOR)(nextRandom() & 1u);
+
+            if (op == 0) {
+                SSD1306_fill(color);
+                memset(expected, color ? 0xFF : 0x00, sizeof(expected));
+            } else if (op == 1) {
+                int f = (int)(nextRandom() & 1u);
+                CHECK_EQ(SSD1306_loadFrame(frames[f]), 0);
+                memcpy(expected, frames[f], sizeof(expected));
+            } else if (op < 5) {
+                int16_t x = (int16_t)((int)(nextRandom() % 160u) - 16);
+                int16_t y = (int16_t)((int)(nextRandom() % 96u) - 16);
+                uint16_t w = (uint16_t)(nextRandom() % 60u);
+                uint16_t h = (uint16_t)(nextRandom() % 40u);
+
+                SSD1306_fillRect(x, y, w, h, color);
+                for (int py = y; py < (y + h); py++) {
+                    for (int px = x; px < (x + w); px++) {
+                        refPixel(px, py, color);
+                    }
+                }
+            } else {
+                uint8_t x = (uint8_t)(nextRandom() % SSD1306_WIDTH);
+                uint8_t y = (uint8_t)(nextRandom() % SSD1306_HEIGHT);
+
+                SSD1306_draw_pixel(x, y, color);
+                refPixel(x, y, color);
+            }
+        }
+
+        CHECK_EQ(SSD1306_update(), 0);
+        CHECK_EQ(MEMDMA_wait(1000), 0);
+        bad += (panelWrong() != 0);
+        bad += (memcmp(backBuffer, expected, sizeof(expected)) != 0);
+    }
+    CHECK_EQ(bad, 0);
+    CHECK(fake.memDmaTransfers > (before + RANDOM_ROUNDS));
+    CHECK_EQ(fake.dropped, 0);
+}
+
+TEST(waitReportsError)
+{
+    testBoot(I2C_SPEED_FAST);
+    memset(scratch, 0, sizeof(scratch));
+
+    // The first transfer fails, the one queued behind it still runs
+    CHECK_EQ(MEMDMA_fill(scratch[0], 0x11111111u, SCRATCH_WORDS), 0);
+    CHECK_EQ(MEMDMA_fill(scratch[1], 0x22222222u, SCRATCH_WORDS), 0);
+    fake.memDmaError = 1;
+    CHECK_EQ(MEMDMA_wait(1000), 1);
+    CHECK_EQ(scratch[0][0], 0);
+    CHECK_EQ(scratch[1][SCRATCH_WORDS - 1], 0x22222222u);
+
+    // Reported once
+    CHECK_EQ(MEMDMA_wait(1000), 0);
+    CHECK_EQ(MEMDMA_copy(scratch[2], scratch[1], SCRATCH_WORDS), 0);
+    CHECK_EQ(MEMDMA_wait(1000), 0);
+    CHECK_EQ(scratch[2][SCRATCH_WORDS - 1], 0x22222222u);
+}
+
+TEST(waitTimesOut)
+{
+    testBoot(I2C_SPEED_FAST);
+
+    CHECK_EQ(MEMDMA_fill(longBuffer, 0xA5A5A5A5u, (uint16_t)LONG_WORDS), 0);
+    uint64_t t0 = fake.nowNs;
+    CHECK_EQ(MEMDMA_wait(100), 1);
+    CHECK((fake.nowNs - t0) < 200000u);
+    CHECK(MEMDMA_isBusy());
+
+    // Still running, done on a longer wait
+    CHECK_EQ(MEMDMA_wait(10000), 0);
+    CHECK(!MEMDMA_isBusy());
+    CHECK_EQ(longBuffer[LONG_WORDS - 1u], 0xA5A5A5A5u);
+}
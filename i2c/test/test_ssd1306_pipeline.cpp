@@ -0,0 +1,81 @@
+/**
+ * Timing model of the pipelined update (SSD1306_updatePipelined()): the renderer spends model time
+ * per page, and each page is rendered while the one before it is on the bus. The frame then takes
+ * about max(render, transfer) plus one page, where rendering and sending one after the other takes
+ * render + transfer. The table of measured frame times is printed per update mode.
+*/
+
+#include "test.h"
+
+static uint32_t renderUs;                   // Model time the renderer spends per page
+static uint8_t overlapped;                  // Pages rendered while the bus was busy
+
+static void renderPage(uint8_t page, uint8_t *buffer)
+{
+    if (I2C_isBusy()) {
+        overlapped++;
+    }
+    fakeSpend(renderUs);
+    memset(buffer, (page * 29) ^ 0x5A, SSD1306_WIDTH);
+}
+
+/**
+ * @brief   Model time of one pipelined frame in us
+*/
+static uint32_t frameUs(uint32_t perPage)
+{
+    renderUs = perPage;
+    overlapped = 0;
+
+    uint64_t t0 = fake.nowNs;
+    CHECK_EQ(SSD1306_updatePipelined(renderPage), 0);
+    uint32_t us = (uint32_t)((fake.nowNs - t0) / 1000u);
+
+    for (int page = 0; page < 8; page++) {
+        CHECK_EQ(fake.panel.gram[page][0], (uint8_t)((page * 29) ^ 0x5A));
+        CHECK_EQ(fake.panel.gram[page][127], (uint8_t)((page * 29) ^ 0x5A));
+    }
+    return us;
+}
+
+static void overlap(SSD1306_UPDATE_MODE mode)
+{
+    static const uint32_t perPage[] = {0, 200, 500, 1000, 2000, 3000, 4000, 6000};
+
+    testBoot(I2C_SPEED_FAST);
+    CHECK_EQ(SSD1306_setUpdateMode(mode), 0);
+
+    // Bus time alone
+    uint32_t transfer = frameUs(0);
+    uint32_t transferPage = transfer / 8u;
+    CHECK(transfer > 20000u);
+    printf("    %s: transfer %u us\n", (mode == SSD1306_UPDATE_PAGE) ? "page" : "horizontal", transfer);
+
+    for (size_t i = 1; i < sizeof(perPage) / sizeof(perPage[0]); i++) {
+        uint32_t render = perPage[i] * 8u;
+        uint32_t serial = render + transfer;
+        uint32_t pipelined = frameUs(perPage[i]);
+        uint32_t bound = ((render > transfer) ? render : transfer) + perPage[i] + transferPage;
+
+        // Pages 1-7 are rendered while the page before is still being sent
+        if (perPage[i] < transferPage) {
+            CHECK_EQ(overlapped, 7);
+        }
+        CHECK(pipelined <= (bound + 500u));
+        CHECK(pipelined < serial);
+        printf("      render %5u us/page: serial %6u us, pipelined %6u us (%u%%)\n",
+               perPage[i], serial, pipelined, (pipelined * 100u) / serial);
+    }
+
+    CHECK_EQ(fake.dropped, 0);
+}
+
+TEST(overlapPage)
+{
+    overlap(SSD1306_UPDATE_PAGE);
+}
+
+TEST(overlapHorizontal)
+{
+    overlap(SSD1306_UPDATE_HORIZONTAL);
+}
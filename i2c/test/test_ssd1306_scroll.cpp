@@ -0,0 +1,164 @@
+/**
+ * Hardware scroll (SSD1306_scrollStart()/SSD1306_scrollStop()): the panel model turns the GDDRAM
+ * of the scrolled pages in time. Updates leave the scrolling pages alone and send the others, and
+ * after a stop the next update brings the whole panel back in line with the screenbuffer.
+*/
+
+#include "test.h"
+
+static __ALIGNED(4) uint8_t frames[2][SSD1306_BUFFER_SIZE];
+
+static uint32_t seed = 1;
+
+static uint32_t nextRandom(void)
+{
+    seed = (seed * 1103515245u) + 12345u;
+    return seed >> 8;
+}
+
+/**
+ * @brief   Load a first random frame on the panel and make the second one
+*/
+static void startFrames(void)
+{
+    for (int f = 0; f < 2; f++) {
+        for (size_t i = 0; i < SSD1306_BUFFER_SIZE; i++) {
+            frames[f][i] = (uint8_t)nextRandom();
+        }
+    }
+    CHECK_EQ(SSD1306_loadFrame(frames[0]), 0);
+    CHECK_EQ(SSD1306_update(), 0);
+    CHECK_EQ(testPanelMismatches(), 0);
+}
+
+/**
+ * @brief           GDDRAM bytes of a page that differ from a page of a frame turned by some columns
+ * @param shift     Columns turned to the left (negative to the right)
+*/
+static int pageWrong(uint8_t page, const uint8_t *frame, int32_t shift)
+{
+    int wrong = 0;
+
+    for (int32_t col = 0; col < (int32_t)SSD1306_WIDTH; col++) {
+        int32_t from = (((col + shift) % 128) + 128) % 128;
+
+        wrong += (fake.panel.gram[page][col] != frame[(page * SSD1306_WIDTH) + from]);
+    }
+    return wrong;
+}
+
+/**
+ * @brief   Stop the scroll, update and check that the panel shows the screenbuffer
+*/
+static void stopAndCheck(const uint8_t *frame)
+{
+    CHECK_EQ(SSD1306_scrollStop(), 0);
+    CHECK(!fake.panel.scrolling);
+    CHECK_EQ(SSD1306_update(), 0);
+    CHECK_EQ(fake.panel.startLine, 0);
+    CHECK_EQ(testPanelMismatches(), 0);
+    for (uint8_t page = 0; page < (SSD1306_HEIGHT / 8); page++) {
+        CHECK_EQ(pageWrong(page, frame, 0), 0);
+    }
+}
+
+TEST(horizontalHoldsScrollingPages)
+{
+    testBoot(I2C_SPEED_FAST);
+    startFrames();
+
+    CHECK_EQ(SSD1306_scrollStart(SSD1306_SCROLL_LEFT, 2, 4, SSD1306_SCROLL_2_FRAMES, 0), 0);
+    CHECK(fake.panel.scrolling);
+    uint32_t steps = fake.panel.scrollSteps;
+    fakeSpend(100000);
+    CHECK(fake.panel.scrollSteps > steps);
+
+    // A new frame over the whole screen: only the pages outside the scroll are sent
+    CHECK_EQ(SSD1306_loadFrame(frames[1]), 0);
+    CHECK_EQ(SSD1306_update(), 0);
+    steps = fake.panel.scrollSteps - steps;
+    for (uint8_t page = 0; page < (SSD1306_HEIGHT / 8); page++) {
+        if ((page >= 2) && (page <= 4)) {
+            CHECK_EQ(pageWrong(page, frames[0], (int32_t)steps), 0);
+        } else {
+            CHECK_EQ(pageWrong(page, frames[1], 0), 0);
+        }
+    }
+
+    // Drawing on the held pages keeps them held until the stop
+    SSD1306_fillRect(0, 16, 64, 8, WHITE);
+    memset(&frames[1][2 * SSD1306_WIDTH], 0xFF, 64);
+    fakeSpend(50000);
+    CHECK_EQ(SSD1306_update(), 0);
+    CHECK(pageWrong(2, frames[1], 0) != 0);
+
+    stopAndCheck(frames[1]);
+}
+
+TEST(restartAddsPages)
+{
+    testBoot(I2C_SPEED_FAST);
+    startFrames();
+
+    // The second start replaces the scroll of the panel, the first pages stay turned
+    CHECK_EQ(SSD1306_scrollStart(SSD1306_SCROLL_RIGHT, 0, 1, SSD1306_SCROLL_3_FRAMES, 0), 0);
+    uint32_t steps = fake.panel.scrollSteps;
+    fakeSpend(200000);
+    uint32_t first = fake.panel.scrollSteps - steps;
+    CHECK(first > 0u);
+
+    CHECK_EQ(SSD1306_scrollStart(SSD1306_SCROLL_RIGHT, 6, 7, SSD1306_SCROLL_2_FRAMES, 0), 0);
+    steps = fake.panel.scrollSteps;
+    fakeSpend(100000);
+
+    CHECK_EQ(SSD1306_loadFrame(frames[1]), 0);
+    CHECK_EQ(SSD1306_update(), 0);
+    uint32_t second = fake.panel.scrollSteps - steps;
+    CHECK(second > 0u);
+    for (uint8_t page = 0; page < (SSD1306_HEIGHT / 8); page++) {
+        if (page <= 1) {
+            CHECK_EQ(pageWrong(page, frames[0], -(int32_t)first), 0);
+        } else if (page >= 6) {
+            CHECK_EQ(pageWrong(page, frames[0], -(int32_t)second), 0);
+        } else {
+            CHECK_EQ(pageWrong(page, frames[1], 0), 0);
+        }
+    }
+
+    stopAndCheck(frames[1]);
+}
+
+TEST(verticalHoldsEverything)
+{
+    testBoot(I2C_SPEED_FAST);
+    startFrames();
+
+    CHECK_EQ(SSD1306_scrollStart(SSD1306_SCROLL_RIGHT, 0, 7, SSD1306_SCROLL_2_FRAMES, 8), 0);
+    uint32_t steps = fake.panel.scrollSteps;
+    fakeSpend(100000);
+
+    // Every page scrolls: an update sends no GDDRAM data at all
+    uint32_t data = fake.panel.dataBytes;
+    CHECK_EQ(SSD1306_loadFrame(frames[1]), 0);
+    CHECK_EQ(SSD1306_update(), 0);
+    CHECK_EQ(fake.panel.dataBytes, data);
+    steps = fake.panel.scrollSteps - steps;
+    CHECK(steps > 0u);
+    CHECK_EQ(fake.panel.startLine, (steps * 8u) & 63u);
+
+    // The stop restores the start line and the update resends every page
+    stopAndCheck(frames[1]);
+}
+
+TEST(stopRewritesTurnedPages)
+{
+    testBoot(I2C_SPEED_FAST);
+    startFrames();
+
+    // Nothing drawn while scrolling: the stop alone has to get the turned pages resent
+    CHECK_EQ(SSD1306_scrollStart(SSD1306_SCROLL_LEFT, 3, 3, SSD1306_SCROLL_2_FRAMES, 0), 0);
+    fakeSpend(100000);
+    CHECK(pageWrong(3, frames[0], 0) != 0);
+
+    stopAndCheck(frames[0]);
+}
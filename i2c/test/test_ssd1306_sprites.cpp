@@ -0,0 +1,145 @@
+/**
+ * Sprite compositor with a full table: 16 sprites moving and animating every frame are composed
+ * (SSD1306_spriteCompose()) and sent (SSD1306_update()) within the frame budget, and every composed
+ * frame equals a full redraw. The benchmark prints the host time of the setters and the compose
+ * and the model time of the update per frame.
+*/
+
+#include "test.h"
+
+#define FRAME_BUDGET_US     33333u      // 30 frames per second
+#define BENCH_FRAMES        300         // Frames per benchmark run
+
+typedef struct {
+    uint64_t settersNs;                 // Host time of the setter calls
+    uint64_t composeNs;                 // Host time of SSD1306_spriteCompose()
+    uint64_t updateUs;                  // Model time of SSD1306_update() (bus)
+    uint64_t worstUpdateUs;
+} FrameCost;
+
+static __ALIGNED(4) uint8_t background[SSD1306_BUFFER_SIZE];
+static __ALIGNED(4) uint8_t composed[SSD1306_BUFFER_SIZE];
+
+static const ImgDef *const dogFrames[] = {&DogDown_22x20, &DogUp_22x20};
+static const ImgDef *const ryuFrames[] = {&Ryu_32x36};
+static int8_t dx[SSD1306_MAX_SPRITES];
+static int8_t dy[SSD1306_MAX_SPRITES];
+
+static void setupSprites(void)
+{
+    for (uint8_t line = 0; line < 8; line++) {
+        for (uint8_t col = 0; col < SSD1306_WIDTH; col++) {
+            background[(line * SSD1306_WIDTH) + col] = (uint8_t)(((col / 4) + line) & 1u ? 0x81 : 0x00);
+        }
+    }
+    SSD1306_spriteBackground(background);
+
+    for (uint8_t id = 0; id < SSD1306_MAX_SPRITES; id++) {
+        if (id < 2) {
+            CHECK_EQ(SSD1306_spriteSet(id, ryuFrames, 1, (uint8_t)(id * 90u), 10, id), 0);
+        } else {
+            CHECK_EQ(SSD1306_spriteSet(id, dogFrames, 2, (uint8_t)((id * 13u) % 96u), (uint8_t)((id * 7u) % 44u), (uint8_t)(id % 5u)), 0);
+        }
+        dx[id] = (int8_t)((id % 3) + 1);
+        dy[id] = (int8_t)((id & 1) ? 1 : -1);
+    }
+}
+
+/**
+ * @brief   Bounce every sprite (or only sprite 2) off the edges and step its animation
+*/
+static void stepSprites(uint8_t all)
+{
+    for (uint8_t id = all ? 0 : 2; id < (all ? SSD1306_MAX_SPRITES : 3u); id++) {
+        uint8_t x = sprites[id].x;
+        uint8_t y = sprites[id].y;
+
+        CHECK_EQ(SSD1306_spriteMoveBy(id, dx[id], dy[id]), 0);
+        if (sprites[id].x == x) {
+            dx[id] = (int8_t)-dx[id];
+        }
+        if (sprites[id].y == y) {
+            dy[id] = (int8_t)-dy[id];
+        }
+        CHECK_EQ(SSD1306_spriteNextFrame(id), 0);
+    }
+}
+
+static FrameCost runFrames(uint8_t all, int frames)
+{
+    FrameCost cost = {0, 0, 0, 0};
+
+    testBoot(I2C_SPEED_FAST);
+    CHECK_EQ(SSD1306_setUpdateMode(SSD1306_UPDATE_HORIZONTAL), 0);
+    setupSprites();
+    CHECK_EQ(SSD1306_spriteCompose(), 0);
+    CHECK_EQ(SSD1306_update(), 0);
+
+    for (int n = 0; n < frames; n++) {
+        uint64_t t0 = testHostNs();
+        stepSprites(all);
+        uint64_t t1 = testHostNs();
+        CHECK_EQ(SSD1306_spriteCompose(), 0);
+        uint64_t t2 = testHostNs();
+
+        uint64_t bus = fake.nowNs;
+        CHECK_EQ(SSD1306_update(), 0);
+        bus = (fake.nowNs - bus) / 1000u;
+
+        cost.settersNs += t1 - t0;
+        cost.composeNs += t2 - t1;
+        cost.updateUs += bus;
+        if (bus > cost.worstUpdateUs) {
+            cost.worstUpdateUs = bus;
+        }
+    }
+
+    cost.settersNs /= (uint64_t)frames;
+    cost.composeNs /= (uint64_t)frames;
+    cost.updateUs /= (uint64_t)frames;
+    CHECK_EQ(fake.dropped, 0);
+    return cost;
+}
+
+TEST(composeMatchesRedraw)
+{
+    testBoot(I2C_SPEED_FAST);
+    setupSprites();
+
+    for (int n = 0; n < 300; n++) {
+        stepSprites(1);
+        if ((n % 7) == 0) {
+            CHECK_EQ(SSD1306_spriteShow((uint8_t)(n % SSD1306_MAX_SPRITES), (uint8_t)((n / 7) & 1)), 0);
+        }
+        CHECK_EQ(SSD1306_spriteCompose(), 0);
+        memcpy(composed, backBuffer, sizeof(composed));
+
+        // Full redraw: background, then every sprite
+        memcpy(backBuffer, background, sizeof(background));
+        SSD1306_spriteDraw();
+        CHECK(memcmp(composed, backBuffer, sizeof(composed)) == 0);
+
+        CHECK_EQ(SSD1306_update(), 0);
+        CHECK_EQ(testPanelMismatches(), 0);
+    }
+}
+
+TEST(sixteenSpritesInBudget)
+{
+    FrameCost all = runFrames(1, BENCH_FRAMES);
+    FrameCost one = runFrames(0, BENCH_FRAMES);
+
+    printf("    16 sprites moving: setters %llu ns, compose %llu ns, update %llu us (worst %llu us) of %u us\n",
+           (unsigned long long)all.settersNs, (unsigned long long)all.composeNs,
+           (unsigned long long)all.updateUs, (unsigned long long)all.worstUpdateUs, FRAME_BUDGET_US);
+    printf("    1 sprite moving:   setters %llu ns, compose %llu ns, update %llu us (worst %llu us)\n",
+           (unsigned long long)one.settersNs, (unsigned long long)one.composeNs,
+           (unsigned long long)one.updateUs, (unsigned long long)one.worstUpdateUs);
+
+    // Every frame fits, with the bus the larger part by far
+    CHECK((all.worstUpdateUs + ((all.settersNs + all.composeNs) / 1000u)) < FRAME_BUDGET_US);
+    CHECK((all.composeNs / 1000u) < (all.updateUs / 10u));
+
+    // One sprite only sends its area
+    CHECK(one.worstUpdateUs < (all.worstUpdateUs / 4u));
+}
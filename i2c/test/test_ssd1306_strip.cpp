@@ -0,0 +1,182 @@
+/**
+ * Strip rendering (SSD1306_updateStrips()): the panel shows pixel for pixel the frame that
+ * SSD1306_fill(BLACK), the same draw callback and SSD1306_update() put there with the screenbuffer,
+ * for random scenes of rectangles, pixels, text, images in every draw mode and sprites.
+*/
+
+#include "test.h"
+
+#define SCENES          60          // Random scenes compared
+#define SCENE_ITEMS     12          // Primitives per scene
+
+typedef struct {
+    uint8_t kind;
+    int16_t x;
+    int16_t y;
+    uint8_t w;
+    uint8_t h;
+    uint8_t color;
+    uint8_t mode;
+    uint8_t wrap;
+    char text[12];
+} SceneItem;
+
+static SceneItem scene[SCENE_ITEMS];
+static uint8_t withSprites;
+
+static uint16_t dogMask[20 * 2];
+static ImgDef MaskedDog = {16, 20, NULL, 2, dogMask};
+static const ImgDef *const dogFrames[] = {&DogDown_22x20, &MaskedDog};
+static const FontDef *const fonts[] = {&Font_7x10, &Font_11x18, &Font_16x26};
+
+static uint32_t seed;
+
+static uint32_t nextRandom(uint32_t range)
+{
+    seed = (seed * 1103515245u) + 12345u;
+    return (seed >> 8) % range;
+}
+
+/**
+ * @brief   Draw callback of the scene, replayed once per strip
+*/
+static void drawScene(void)
+{
+    for (int i = 0; i < SCENE_ITEMS; i++) {
+        const SceneItem *item = &scene[i];
+        SSD1306_COLOR color = (SSD1306_COLOR)item->color;
+
+        SSD1306_setDrawMode((SSD1306_DRAW_MODE)item->mode);
+        switch (item->kind) {
+        case 0:
+            SSD1306_fillRect(item->x, item->y, item->w, item->h, color);
+            break;
+        case 1:
+            SSD1306_draw_pixel((uint8_t)item->x, (uint8_t)item->y, color);
+            break;
+        case 2:
+            SSD1306_setCursor((uint8_t)item->x, (uint8_t)item->y);
+            SSD1306_writeString(item->text, *fonts[item->w % 3u], color, item->wrap);
+            break;
+        default:
+            SSD1306_setCursor((uint8_t)item->x, (uint8_t)item->y);
+            SSD1306_writeImg((item->w & 1u) ? Ryu_32x36 : MaskedDog, color);
+            break;
+        }
+    }
+    SSD1306_setDrawMode(SSD1306_DRAW_COPY);
+
+    if (withSprites) {
+        SSD1306_spriteDraw();
+    }
+}
+
+static void randomScene(void)
+{
+    for (int i = 0; i < SCENE_ITEMS; i++) {
+        SceneItem *item = &scene[i];
+
+        item->kind = (uint8_t)nextRandom(4);
+        item->x = (int16_t)nextRandom(SSD1306_WIDTH + 20) - 10;
+        item->y = (int16_t)nextRandom(SSD1306_HEIGHT + 20) - 10;
+        item->w = (uint8_t)nextRandom(70);
+        item->h = (uint8_t)nextRandom(40);
+        item->color = (uint8_t)nextRandom(2);
+        item->mode = (uint8_t)nextRandom(SSD1306_DRAW_MASK + 1);
+        item->wrap = (uint8_t)nextRandom(2);
+        if (item->kind != 0) {
+            // The cursor and pixels are unsigned
+            item->x = (int16_t)nextRandom(SSD1306_WIDTH);
+            item->y = (int16_t)nextRandom(SSD1306_HEIGHT);
+        }
+
+        int len = (int)nextRandom(sizeof(item->text));
+        for (int k = 0; k < len; k++) {
+            item->text[k] = (char)(32u + nextRandom(95));
+        }
+        item->text[len] = '\0';
+    }
+
+    withSprites = (uint8_t)nextRandom(2);
+    for (uint8_t id = 0; id < 4; id++) {
+        CHECK_EQ(SSD1306_spriteSet(id, dogFrames, 2, (uint8_t)nextRandom(SSD1306_WIDTH), (uint8_t)nextRandom(SSD1306_HEIGHT), (uint8_t)nextRandom(4)), 0);
+        CHECK_EQ(SSD1306_spriteFrame(id, (uint8_t)nextRandom(2)), 0);
+        CHECK_EQ(SSD1306_spriteMoveBy(id, -(int16_t)nextRandom(30), -(int16_t)nextRandom(30)), 0);
+        CHECK_EQ(SSD1306_spriteShow(id, (uint8_t)nextRandom(2)), 0);
+    }
+}
+
+static void stripsMatch(SSD1306_UPDATE_MODE mode)
+{
+    static uint8_t strips[SSD1306_HEIGHT][SSD1306_WIDTH];
+    static uint8_t buffer[SSD1306_BUFFER_SIZE];
+
+    testBoot(I2C_SPEED_FAST);
+    CHECK_EQ(SSD1306_setUpdateMode(mode), 0);
+    MaskedDog.data = DogDown_22x20.data;
+    for (size_t i = 0; i < sizeof(dogMask) / sizeof(dogMask[0]); i++) {
+        uint16_t row = DogDown_22x20.data[i];
+        dogMask[i] = (uint16_t)(row | (row << 1) | (row >> 1));
+    }
+    seed = 7u + (uint32_t)mode;
+
+    for (int n = 0; n < SCENES; n++) {
+        randomScene();
+        memcpy(buffer, backBuffer, sizeof(buffer));
+
+        // Strips, from the cursor the screenbuffer drawing starts from as well
+        SSD1306_setCursor(3, 5);
+        CHECK_EQ(SSD1306_updateStrips(drawScene), 0);
+        for (int y = 0; y < (int)SSD1306_HEIGHT; y++) {
+            for (int x = 0; x < (int)SSD1306_WIDTH; x++) {
+                strips[y][x] = fakePixel((uint8_t)x, (uint8_t)y);
+            }
+        }
+        CHECK(memcmp(buffer, backBuffer, sizeof(buffer)) == 0);
+
+        // Screenbuffer
+        SSD1306_setCursor(3, 5);
+        SSD1306_fill(BLACK);
+        drawScene();
+        SSD1306_invalidate();
+        CHECK_EQ(SSD1306_update(), 0);
+
+        int wrong = 0;
+        for (int y = 0; y < (int)SSD1306_HEIGHT; y++) {
+            for (int x = 0; x < (int)SSD1306_WIDTH; x++) {
+                wrong += (strips[y][x] != fakePixel((uint8_t)x, (uint8_t)y));
+            }
+        }
+        CHECK_EQ(wrong, 0);
+        CHECK_EQ(testPanelMismatches(), 0);
+    }
+
+    CHECK_EQ(fake.dropped, 0);
+}
+
+TEST(stripsMatchPage)
+{
+    stripsMatch(SSD1306_UPDATE_PAGE);
+}
+
+TEST(stripsMatchHorizontal)
+{
+    stripsMatch(SSD1306_UPDATE_HORIZONTAL);
+}
+
+TEST(blackFrame)
+{
+    testBoot(I2C_SPEED_FAST);
+    SSD1306_fill(WHITE);
+    CHECK_EQ(SSD1306_update(), 0);
+
+    // No callback: every pixel cleared
+    CHECK_EQ(SSD1306_updateStrips(NULL), 0);
+    int lit = 0;
+    for (int y = 0; y < (int)SSD1306_HEIGHT; y++) {
+        for (int x = 0; x < (int)SSD1306_WIDTH; x++) {
+            lit += fakePixel((uint8_t)x, (uint8_t)y);
+        }
+    }
+    CHECK_EQ(lit, 0);
+}
@@ -0,0 +1,120 @@
+/**
+ * Every SSD1306 call that waits for the bus gives up when the bus is stuck: it returns 1 within its
+ * timeout instead of hanging, and the driver works again once the bus is released.
+*/
+
+#include "test.h"
+
+#define MAX_WAIT_NS     400000000ull    // UPDATE_TIMEOUT_US with some slack
+
+static __ALIGNED(4) uint8_t frame[SSD1306_BUFFER_SIZE];
+
+/**
+ * @brief   Queue a whole frame and stick the bus while it is being sent
+*/
+static void stickDuringUpdate(void)
+{
+    testBoot(I2C_SPEED_FAST);
+
+    for (size_t i = 0; i < sizeof(frame); i++) {
+        frame[i] = (uint8_t)((i * 37u) ^ (i >> 3));
+    }
+    CHECK_EQ(SSD1306_loadFrame(frame), 0);
+    CHECK_EQ(SSD1306_updateDMA(0), 0);
+    fakeSpend(2000);
+    CHECK(SSD1306_isBusy());
+    fake.busStuck = 1;
+}
+
+/**
+ * @brief   Release the bus and check that a full update goes through again
+*/
+static void recover(void)
+{
+    CHECK(!SSD1306_isBusy());
+    fake.busStuck = 0;
+    fakeSpend(1000);
+
+    SSD1306_invalidate();
+    CHECK_EQ(SSD1306_update(), 0);
+    CHECK_EQ(testPanelMismatches(), 0);
+}
+
+#define CHECK_GIVES_UP(call) \
+    do { \
+        stickDuringUpdate(); \
+        uint64_t t0 = fake.nowNs; \
+        CHECK_EQ((call), 1); \
+        CHECK((fake.nowNs - t0) < MAX_WAIT_NS); \
+        recover(); \
+    } while (0)
+
+static void renderPage(uint8_t page, uint8_t *buffer)
+{
+    memset(buffer, page, SSD1306_WIDTH);
+}
+
+TEST(updateGivesUp)
+{
+    CHECK_GIVES_UP(SSD1306_update());
+}
+
+TEST(updateDMAGivesUp)
+{
+    // Already busy: refused at once, the update in flight is not waited for
+    stickDuringUpdate();
+    uint64_t t0 = fake.nowNs;
+    CHECK_EQ(SSD1306_updateDMA(0), 1);
+    CHECK((fake.nowNs - t0) < 1000000u);
+    CHECK_EQ(SSD1306_update(), 1);
+    recover();
+}
+
+TEST(setUpdateModeGivesUp)
+{
+    CHECK_GIVES_UP(SSD1306_setUpdateMode(SSD1306_UPDATE_HORIZONTAL));
+}
+
+TEST(updatePipelinedGivesUp)
+{
+    CHECK_GIVES_UP(SSD1306_updatePipelined(renderPage));
+}
+
+TEST(scrollGivesUp)
+{
+    CHECK_GIVES_UP(SSD1306_scrollStart(SSD1306_SCROLL_LEFT, 0, 7, SSD1306_SCROLL_5_FRAMES, 0));
+    CHECK_GIVES_UP(SSD1306_scrollStop());
+}
+
+TEST(setDiffModeGivesUp)
+{
+    CHECK_GIVES_UP(SSD1306_setDiffMode(SSD1306_DIFF_CRC));
+}
+
+TEST(mirrorStartGivesUp)
+{
+    CHECK_GIVES_UP(SSD1306_mirrorStart());
+}
+
+TEST(polledWriteGivesUp)
+{
+    uint8_t data[4] = {0x00, 0xAF, 0x00, 0xAF};
+
+    // 16-bit memory address: START, address and both memory address bytes are polled
+    testBoot(I2C_SPEED_FAST);
+    fake.busStuck = 1;
+    uint64_t t0 = fake.nowNs;
+    CHECK_EQ(SSD1306_writeMulti(data, sizeof(data), 0x0000, I2C_MEMADD_SIZE_16BIT), 1);
+    CHECK_EQ(SSD1306_write(0xAF, 0x0000, I2C_MEMADD_SIZE_16BIT), 1);
+    CHECK((fake.nowNs - t0) < MAX_WAIT_NS);
+    fake.busStuck = 0;
+    fakeSpend(1000);
+
+    // And through when the bus is free
+    size_t from = fake.txns.size();
+    CHECK_EQ(SSD1306_writeMulti(data, sizeof(data), 0x0000, I2C_MEMADD_SIZE_16BIT), 0);
+    fakeSpend(100);
+    CHECK_EQ(fake.txns.size(), from + 1);
+    CHECK_EQ(fake.txns.back().bytes.size(), 2 + sizeof(data));
+    CHECK(fake.txns.back().stopped);
+}
@@ -0,0 +1,67 @@
+#!/usr/bin/env python3
+"""
+Generates src/ssd1306_font_pages.c from the row-major font bitmaps in src/ssd1306_fonts.c.
+
+Each row of a glyph is stored as a 16-bit word with bit 15 as the leftmost pixel. The generated
+tables hold the same glyphs in SSD1306 GDDRAM order: ceil(height / 8) pages per glyph, one byte per
+column and page, bit 0 is the top row of the page.
+
+Usage (from the i2c directory):
+    python3 tools/font_pages.py > src/ssd1306_font_pages.c
+"""
+import os
+import re
+import sys
+
+FONTS = ["Font7x10", "Font11x18", "Font16x26"]
+FIRST_CHAR = 32
+
+
+def parse(source, name):
+    match = re.search(r"static const uint16_t %s\[\] = \{(.*?)\};" % name, source, re.S)
+    if not match:
+        sys.exit("font table %s not found" % name)
+    body = re.sub(r"//[^\n]*", "", match.group(1))
+    return [int(word, 16) for word in re.findall(r"0x[0-9A-Fa-f]+", body)]
+
+
+def main():
+    here = os.path.dirname(os.path.abspath(__file__))
+    with open(os.path.join(here, "..", "src", "ssd1306_fonts.c")) as f:
+        source = f.read()
+
+    out = sys.stdout
+    out.write("/**\n")
+    out.write(" * Page-major glyph bitmaps, generated by tools/font_pages.py from ssd1306_fonts.c. Do not edit.\n")
+    out.write(" * Each glyph is ceil(height / 8) pages of width bytes in SSD1306 GDDRAM order, bit 0 is the\n")
+    out.write(" * top row of a page.\n")
+    out.write("*/\n")
+    out.write('#include "ssd1306_fonts.h"\n')
+
+    for name in FONTS:
+        width, height = (int(v) for v in re.match(r"Font(\d+)x(\d+)", name).groups())
+        pages = (height + 7) // 8
+        rows = parse(source, name)
+        if len(rows) % height:
+            sys.exit("font table %s is not a multiple of %d rows" % (name, height))
+
+        out.write("\nconst uint8_t %sPages[] = {\n" % name)
+        for glyph in range(len(rows) // height):
+            glyph_rows = rows[glyph * height:(glyph + 1) * height]
+            data = []
+            for page in range(pages):
+                for col in range(width):
+                    byte = 0
+                    for bit in range(8):
+                        row = (page * 8) + bit
+                        if row < height and (glyph_rows[row] << col) & 0x8000:
+                            byte |= 1 << bit
+                    data.append(byte)
+            char = chr(glyph + FIRST_CHAR)
+            comment = "sp" if char == " " else "'%s'" % char
+            out.write("%s,  // %s\n" % (", ".join("0x%02X" % b for b in data), comment))
+        out.write("};\n")
+
+
+if __name__ == "__main__":
+    main()